@@ -21,6 +21,8 @@ Application::Application()
 	: m_uniforms()
 	, m_camera(glm::vec3(0, 10.0f, -200.0f), glm::vec3(0, 0, 1.0f))
 	, m_theta(0)
+	, m_frameUniformOffset(0)
+	, m_bindless(false)
 {
 	s_pApp = this;
 
@@ -68,24 +70,74 @@ void Application::OnUpdate(float frameTime)
 
 	// Reorder rendering priority
 	ReorderRenderingPriority();
+
+	// Evicted meshes are streamed back in before the frame records its uploads, so a restored mesh is
+	// already in the arena when it's drawn. Meshes there is no room for are skipped this frame.
+	m_meshResident.assign(m_objects.size(), false);
+	for (size_t i = 0; i < m_objects.size(); ++i)
+	{
+		m_meshResident[i] = GetResidencyManager().Touch(m_meshStreamables[i]);
+	}
 }
 
 bool Application::OnDeviceReady()
 {
+	// Every mesh of the scene shares one vertex and one index buffer
+	if (!CreateGeometryArena(sizeof(Vertex), 1024 * 1024, 4 * 1024 * 1024, m_geometryArena))
+	{
+		return Error("Failed to create geometry arena.");
+	}
+
+	// When the device supports it transforms and materials are indexed from the bindless table, which is
+	// bound once per frame so draws only differ by the indices they push
+	m_bindless = IsBindlessSupported();
+	if (m_bindless)
+	{
+		GAP311::BindlessTable::Limits limits;
+		limits.materialStride = (sizeof(MaterialUniforms) + 15) & ~15u;	// std430 array stride
+		limits.objectStride = sizeof(glm::mat4);
+		if (!CreateBindlessTable(limits))
+		{
+			return Error("Failed to create bindless table.");
+		}
+	}
+	const char* pVertexShader = m_bindless ? "Shaders/bindless.vert.spv" : "Shaders/simple.vert.spv";
+	const char* pFragmentShader = m_bindless ? "Shaders/bindless.frag.spv" : "Shaders/simple.frag.spv";
+
+	// Camera and light, material and transform are bound separately as they change at different rates,
+	// the transform is pushed with every draw
+	if (!CreateSceneLayout(sizeof(Uniforms), sizeof(MaterialUniforms), sizeof(ObjectConstants)))
+	{
+		return Error("Failed to create scene layout.");
+	}
+
 	// Add Sun
 	GAP311::PipelineDescription descSun;
 	descSun.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descSun.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descSun.vertexStride = sizeof(Vertex);
-	descSun.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descSun.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descSun.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descSun.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descSun.vertexShaderFilename = pVertexShader;
+	descSun.fragmentShaderFilename = pFragmentShader;
+	descSun.useSceneLayout = true;
 	descSun.wireframeMode = false;
+	// The sun is emissive, every other body is lit by it
+	descSun.specializationConstants.push_back({ "ENABLE_LIGHTING", 0 });
+
+	// The planets share one lit permutation of the sun's pipeline, both compile on worker threads while the
+	// meshes load. Objects draw through the generic ubershader permutation until theirs is ready.
+	GAP311::PipelineDescription descLit = descSun;
+	descLit.specializationConstants = { { "ENABLE_LIGHTING", 1 } };
+	auto pendingPipelines = AcquirePipelines({ descSun, descLit });	// held until every object has acquired its pipeline
+
+	m_pFallbackPipeline = AcquirePipeline(MakeFallbackDescription(descSun));
+	if (!m_pFallbackPipeline)
+	{
+		return Error("Failed to create fallback pipeline.");
+	}
 
 	std::vector<Vertex> sunVertices;
 	std::vector<uint32_t> sunIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/sun.obj", sunVertices, sunIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/sun.obj", sunVertices, sunIndices))
 	{
 		return Error("Failed to load sun obj file.");
 	}
@@ -102,22 +154,21 @@ bool Application::OnDeviceReady()
 	pSun->SetMaterialSpecular({ 0.2f, 0.2f, 0.2f, 1.0f });
 	pSun->SetMaterialShininess(100.f);
 	pSun->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.005f));
-	pSun->DisableLighting();
 
 	// Add Mercury
 	GAP311::PipelineDescription descMercury;
 	descMercury.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descMercury.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descMercury.vertexStride = sizeof(Vertex);
-	descMercury.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descMercury.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descMercury.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descMercury.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descMercury.vertexShaderFilename = pVertexShader;
+	descMercury.fragmentShaderFilename = pFragmentShader;
+	descMercury.useSceneLayout = true;
 	descMercury.wireframeMode = false;
+	descMercury.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> mercuryVertices;
 	std::vector<uint32_t> mercuryIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/mercury.obj", mercuryVertices, mercuryIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/mercury.obj", mercuryVertices, mercuryIndices))
 	{
 		return Error("Failed to load mercury obj file.");
 	}
@@ -133,22 +184,21 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.003f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.02f));
-	m_objects.back()->EnableLighting();
 
 	// Add Venus
 	GAP311::PipelineDescription descVenus;
 	descVenus.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descVenus.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descVenus.vertexStride = sizeof(Vertex);
-	descVenus.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descVenus.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descVenus.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descVenus.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descVenus.vertexShaderFilename = pVertexShader;
+	descVenus.fragmentShaderFilename = pFragmentShader;
+	descVenus.useSceneLayout = true;
 	descVenus.wireframeMode = false;
+	descVenus.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> venusVertices;
 	std::vector<uint32_t> venusIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/venus.obj", venusVertices, venusIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/venus.obj", venusVertices, venusIndices))
 	{
 		return Error("Failed to load venus obj file.");
 	}
@@ -164,22 +214,21 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.001f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.015f));
-	m_objects.back()->EnableLighting();
 
 	// Add Earth
 	GAP311::PipelineDescription descEarth;
 	descEarth.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descEarth.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descEarth.vertexStride = sizeof(Vertex);
-	descEarth.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descEarth.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descEarth.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descEarth.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descEarth.vertexShaderFilename = pVertexShader;
+	descEarth.fragmentShaderFilename = pFragmentShader;
+	descEarth.useSceneLayout = true;
 	descEarth.wireframeMode = false;
+	descEarth.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> earthVertices;
 	std::vector<uint32_t> earthIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/earth.obj", earthVertices, earthIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/earth.obj", earthVertices, earthIndices))
 	{
 		return Error("Failed to load earth obj file.");
 	}
@@ -196,22 +245,21 @@ bool Application::OnDeviceReady()
 	pEarth->SetMaterialShininess(32.f);
 	pEarth->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.015f));
 	pEarth->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.012f));
-	pEarth->EnableLighting();
 
 	// Add Moon
 	GAP311::PipelineDescription descMoon;
 	descMoon.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descMoon.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descMoon.vertexStride = sizeof(Vertex);
-	descMoon.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descMoon.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descMoon.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descMoon.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descMoon.vertexShaderFilename = pVertexShader;
+	descMoon.fragmentShaderFilename = pFragmentShader;
+	descMoon.useSceneLayout = true;
 	descMoon.wireframeMode = false;
+	descMoon.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> moonVertices;
 	std::vector<uint32_t> moonIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/moon.obj", moonVertices, moonIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/moon.obj", moonVertices, moonIndices))
 	{
 		return Error("Failed to load moon obj file.");
 	}
@@ -227,7 +275,6 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.01f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pEarth, 0.1f));
-	m_objects.back()->EnableLighting();
 
 	pEarth->AddChild(m_objects.back());
 
@@ -236,15 +283,15 @@ bool Application::OnDeviceReady()
 	descMars.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descMars.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descMars.vertexStride = sizeof(Vertex);
-	descMars.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descMars.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descMars.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descMars.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descMars.vertexShaderFilename = pVertexShader;
+	descMars.fragmentShaderFilename = pFragmentShader;
+	descMars.useSceneLayout = true;
 	descMars.wireframeMode = false;
+	descMars.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> marsVertices;
 	std::vector<uint32_t> marsIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/mars.obj", marsVertices, marsIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/mars.obj", marsVertices, marsIndices))
 	{
 		return Error("Failed to load mars obj file.");
 	}
@@ -260,22 +307,21 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.015f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.01f));
-	m_objects.back()->EnableLighting();
 
 	// Add Jupiter
 	GAP311::PipelineDescription descJupiter;
 	descJupiter.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descJupiter.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descJupiter.vertexStride = sizeof(Vertex);
-	descJupiter.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descJupiter.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descJupiter.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descJupiter.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descJupiter.vertexShaderFilename = pVertexShader;
+	descJupiter.fragmentShaderFilename = pFragmentShader;
+	descJupiter.useSceneLayout = true;
 	descJupiter.wireframeMode = false;
+	descJupiter.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> jupiterVertices;
 	std::vector<uint32_t> jupiterIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/jupiter.obj", jupiterVertices, jupiterIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/jupiter.obj", jupiterVertices, jupiterIndices))
 	{
 		return Error("Failed to load jupiter obj file.");
 	}
@@ -291,22 +337,21 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.02f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.005f));
-	m_objects.back()->EnableLighting();
 
 	// Add Saturn
 	GAP311::PipelineDescription descSaturn;
 	descSaturn.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descSaturn.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descSaturn.vertexStride = sizeof(Vertex);
-	descSaturn.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descSaturn.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descSaturn.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descSaturn.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descSaturn.vertexShaderFilename = pVertexShader;
+	descSaturn.fragmentShaderFilename = pFragmentShader;
+	descSaturn.useSceneLayout = true;
 	descSaturn.wireframeMode = false;
+	descSaturn.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> saturnVertices;
 	std::vector<uint32_t> saturnIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/saturn.obj", saturnVertices, saturnIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/saturn.obj", saturnVertices, saturnIndices))
 	{
 		return Error("Failed to load saturn obj file.");
 	}
@@ -322,22 +367,21 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.019f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.002f));
-	m_objects.back()->EnableLighting();
 
 	// Add Uranus
 	GAP311::PipelineDescription descUranus;
 	descUranus.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descUranus.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descUranus.vertexStride = sizeof(Vertex);
-	descUranus.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descUranus.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descUranus.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descUranus.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descUranus.vertexShaderFilename = pVertexShader;
+	descUranus.fragmentShaderFilename = pFragmentShader;
+	descUranus.useSceneLayout = true;
 	descUranus.wireframeMode = false;
+	descUranus.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> uranusVertices;
 	std::vector<uint32_t> uranusIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/uranus.obj", uranusVertices, uranusIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/uranus.obj", uranusVertices, uranusIndices))
 	{
 		return Error("Failed to load uranus obj file.");
 	}
@@ -353,22 +397,21 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.016f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.001f));
-	m_objects.back()->EnableLighting();
 
 	// Add Neptune
 	GAP311::PipelineDescription descNeptune;
 	descNeptune.vertexAttributes.push_back({ 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos) });
 	descNeptune.vertexAttributes.push_back({ 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal) });
 	descNeptune.vertexStride = sizeof(Vertex);
-	descNeptune.vertexShaderFilename = "Shaders/simple.vert.spv";
-	descNeptune.fragmentShaderFilename = "Shaders/simple.frag.spv";
-	descNeptune.uniformBuffers.push_back({ 0, sizeof(Uniforms) });
-	descNeptune.uniformBuffers.push_back({ 1, sizeof(ObjectUniforms) });
+	descNeptune.vertexShaderFilename = pVertexShader;
+	descNeptune.fragmentShaderFilename = pFragmentShader;
+	descNeptune.useSceneLayout = true;
 	descNeptune.wireframeMode = false;
+	descNeptune.specializationConstants.push_back({ "ENABLE_LIGHTING", 1 });
 
 	std::vector<Vertex> neptuneVertices;
 	std::vector<uint32_t> neptuneIndices;
-	if (!m_graphicLoader.LoadOBJFile("TestFiles/SolarSystem/neptune.obj", neptuneVertices, neptuneIndices))
+	if (!m_graphicLoader.LoadMesh("TestFiles/SolarSystem/neptune.obj", neptuneVertices, neptuneIndices))
 	{
 		return Error("Failed to load neptune obj file.");
 	}
@@ -384,93 +427,241 @@ bool Application::OnDeviceReady()
 	m_objects.back()->SetMaterialShininess(32.f);
 	m_objects.back()->AddComponent(std::make_unique<SpinningComponent>(m_objects.back(), glm::vec3(0.f, 1.f, 0.f), 0.017f));
 	m_objects.back()->AddComponent(std::make_unique<SatelliteComponent>(m_objects.back(), pSun, 0.0005f));
-	m_objects.back()->EnableLighting();
 
 	return true;
 }
 
 void Application::OnDeviceLost()
 {
-	auto device = GetDevice();
-
 	for (int i = 0; i < m_pipelines.size(); ++i)
 	{
-		DestroyPipeline(m_pipelines[i]);
-		if (m_objects[i]->VertexBuffer())       device.destroyBuffer(m_objects[i]->VertexBuffer());
-		if (m_objects[i]->VertexBufferMemory()) device.freeMemory(m_objects[i]->VertexBufferMemory());
-		if (m_objects[i]->IndexBuffer())        device.destroyBuffer(m_objects[i]->IndexBuffer());
-		if (m_objects[i]->IndexBufferMemory())  device.freeMemory(m_objects[i]->IndexBufferMemory());
+		m_pipelines[i] = GAP311::AsyncPipeline();
+		m_geometryArena.Free(m_objects[i]->Geometry());
+		FreeUniformSlot(m_objects[i]->MaterialSlot());
 	}
-}
 
-void Application::OnPreRender(vk::CommandBuffer& cb)
-{
-	for (int i = 0; i < m_renderingPriority.size(); ++i)
+	for (auto id : m_meshStreamables)
 	{
-		int index = m_renderingPriority[i];
-		cb.updateBuffer(m_pipelines[index].uniformBuffers[0].buffer, 0, sizeof(m_uniforms), &m_uniforms);
+		GetResidencyManager().Unregister(id);
 	}
+	m_meshStreamables.clear();
+	m_meshResident.clear();
 
-	for (int i = 0; i < m_renderingPriority.size(); ++i)
-	{
-		int index = m_renderingPriority[i];
-		cb.updateBuffer(m_pipelines[index].uniformBuffers[1].buffer, 0, sizeof(m_objects[index]->m_objectUniform), &m_objects[index]->m_objectUniform);
-	}
+	// OnDeviceReady builds the scene from scratch, nothing may be left behind
+	m_pipelines.clear();
+	m_pFallbackPipeline.reset();
+	m_objects.clear();
+	m_renderingPriority.clear();
+
+	DestroySceneLayout();
+	DestroyBindlessTable();
+	DestroyGeometryArena(m_geometryArena);
+}
+
+bool Application::OnSwapchainReady()
+{
+	// Only the projection depends on the window size, the scene itself is left alone on resize
+	vk::Extent2D extent = GetSwapchainExtent();
+	m_camera.SetPerspectiveView(90.0f, extent.width * 1.0f, extent.height * 1.0f, 0.1f, 1000.0f);
+
+	m_uniforms.projMatrix = m_camera.ProjMatrix();
+	m_uniforms.projMatrix[1][1] *= -1;
+
+	return true;
+}
+
+void Application::OnPreRender(vk::CommandBuffer& cb)
+{
+	// The frame uniforms are shared by every object, so they are written once
+	PushUniforms(m_uniforms, m_frameUniformOffset);
 }
 
 void Application::OnRender(vk::CommandBuffer& cb)
 {
+	m_geometryArena.Bind(cb);
+	BindSceneSet(cb, SceneSet::eFrame, m_frameUniformOffset);
+	if (m_bindless)
+	{
+		BindSceneSet(cb, SceneSet::eBindless, 0);
+	}
+
+	uint32_t frameIndex = GetFrameIndex();
+	const GAP311::PipelineObjects* pBoundPipeline = nullptr;
+	uint32_t boundMaterialOffset = ~0u;
 	for (int i = 0; i < m_renderingPriority.size(); ++i)
 	{
 		int index = m_renderingPriority[i];
-		m_pipelines[index].Bind(cb);
-		m_objects[index]->Draw(cb);
+
+		// Restored in OnUpdate, meshes without room in the arena wait for a later frame
+		if (index >= m_meshResident.size() || !m_meshResident[index])
+			continue;
+
+		// Each frame in flight has its own copy of the material, only rewritten after a change
+		GraphicObject& object = *m_objects[index];
+		object.SetIndices((uint32_t)index, (uint32_t)index);
+		if (object.IsMaterialDirty(frameIndex))
+		{
+			if (m_bindless)
+				GetBindlessTable().WriteMaterial(frameIndex, (uint32_t)index, &object.MaterialUniform(), sizeof(MaterialUniforms));
+			else
+				WriteUniformSlot(object.MaterialSlot(), &object.MaterialUniform(), sizeof(MaterialUniforms));
+			object.ClearMaterialDirty(frameIndex);
+		}
+		if (m_bindless)
+		{
+			GetBindlessTable().WriteObject(frameIndex, (uint32_t)index, &object.Constants().worldMatrix, sizeof(glm::mat4));
+		}
+
+		// Objects sharing a pipeline only bind it once in a row
+		GAP311::PipelineObjects* pPipeline = m_pipelines[index].Get();
+		if (!pPipeline)
+			continue;
+		if (pPipeline != pBoundPipeline)
+		{
+			pPipeline->Bind(cb, frameIndex);
+			pBoundPipeline = pPipeline;
+		}
+
+		// Bindless draws find their material through the index they push
+		uint32_t materialOffset = m_bindless ? 0 : GetUniformSlotOffset(object.MaterialSlot());
+		if (!m_bindless && materialOffset != boundMaterialOffset)
+		{
+			BindSceneSet(cb, SceneSet::eMaterial, materialOffset);
+			boundMaterialOffset = materialOffset;
+		}
+
+		// The transform goes into the command buffer, no buffer write or descriptor bind per object
+		pPipeline->PushConstants(cb, object.Constants());
+
+		object.Draw(cb);
 	}
 }
 
 bool Application::AddGraphicObject(std::shared_ptr<GraphicObject> object, const GAP311::PipelineDescription& desc)
 {
-	m_pipelines.emplace_back(GAP311::PipelineObjects());
-	if (!CreatePipeline(desc, m_pipelines.back()))
+	// Objects with equivalent descriptions share one pipeline, compiled in the background when it's new
+	GAP311::AsyncPipeline pipeline;
+	if (!AcquirePipelineAsync(desc, pipeline))
 	{
-		m_pipelines.pop_back();
 		return Error("Failed to create pipeline objects.");
 	}
+	m_pipelines.emplace_back(std::move(pipeline));
 
+	// The ubershader permutation reads from the material what the specialized pipeline has baked in
+	uint32_t materialFeatures = 0;
+	for (auto& constant : desc.specializationConstants)
+	{
+		if (constant.name == "ENABLE_LIGHTING" && constant.value)
+			materialFeatures |= kMaterialFeatureLighting;
+	}
+	object->SetMaterialFeatures(materialFeatures);
+
+	// Objects are indexed by their position in the scene, which has to fit the bindless arrays
 	size_t index = m_objects.size();
+	if (m_bindless && (index >= GetBindlessTable().GetLimits().maxObjects || index >= GetBindlessTable().GetLimits().maxMaterials))
+	{
+		m_pipelines.pop_back();
+		return Error("The bindless table has no room for another object.");
+	}
 	m_objects.emplace_back(std::move(object));
 	
-	if (!CreateVertexBuffer(m_objects[index]->Vertices(), m_objects[index]->VertexBuffer(), m_objects[index]->VertexBufferMemory()))
+	if (!AllocateGeometry(*m_objects[index]))
 	{
 		m_objects.pop_back();
-		return Error("Failed to create vertex buffer.");
+		m_pipelines.pop_back();
+		return Error("Failed to allocate geometry for object.");
 	}
 
-	if (m_objects[index]->Indices().size() > 0 &&
-		!CreateIndexBuffer(m_objects[index]->Indices(), m_objects[index]->IndexBuffer(), m_objects[index]->IndexBufferMemory()))
+	if (!m_bindless && !AllocateUniformSlot(sizeof(MaterialUniforms), m_objects[index]->MaterialSlot()))
 	{
+		m_geometryArena.Free(m_objects[index]->Geometry());
 		m_objects.pop_back();
-		return Error("Failed to create index buffer.");
+		m_pipelines.pop_back();
+		return Error("Failed to allocate uniforms for object.");
 	}
+	m_objects[index]->MarkMaterialDirty();
+
+	// The mesh can be evicted from the arena while it isn't drawn, the CPU copy is kept to restore it
+	GraphicObject* pObject = m_objects[index].get();
+	vk::DeviceSize meshBytes = sizeof(Vertex) * pObject->Vertices().size() + sizeof(uint32_t) * pObject->Indices().size();
+	m_meshStreamables.emplace_back(GetResidencyManager().Register(GAP311::MemoryCategory::eMeshes, meshBytes,
+		[this, pObject]() { m_geometryArena.Free(pObject->Geometry()); },
+		[this, pObject]() { return AllocateGeometry(*pObject); }));
 
 	m_renderingPriority.emplace_back((int)index);
 
 	return true;
 }
 
-bool Application::CreateSceneResources()
+bool Application::RemoveGraphicObject(const std::shared_ptr<GraphicObject>& object)
 {
-	m_camera.SetPerspectiveView(90.0f, GetWindowWidth() * 1.0f, GetWindowHeight() * 1.0f, 0.1f, 1000.0f);
+	auto it = std::find(m_objects.begin(), m_objects.end(), object);
+	if (it == m_objects.end())
+		return false;
+
+	size_t index = it - m_objects.begin();
 
+	// Frames in flight may still draw the object, its GPU resources go once they are done
+	GetResidencyManager().Unregister(m_meshStreamables[index]);
+
+	GAP311::GeometryRange geometry = object->Geometry();
+	object->Geometry() = GAP311::GeometryRange();
+	GAP311::UniformRing::Slot materialSlot = object->MaterialSlot();
+	object->MaterialSlot() = GAP311::UniformRing::Slot();
+	DeferDestroy([this, geometry, materialSlot]() mutable
+	{
+		m_geometryArena.Free(geometry);
+		FreeUniformSlot(materialSlot);
+	});
+
+	// The pipeline goes through the deferred deletion queue once no other object shares it
+	m_objects.erase(it);
+	m_pipelines.erase(m_pipelines.begin() + index);
+	m_meshStreamables.erase(m_meshStreamables.begin() + index);
+	if (index < m_meshResident.size())
+	{
+		m_meshResident.erase(m_meshResident.begin() + index);
+	}
+
+	// Objects after the removed one move down an index, their bindless materials are rewritten there
+	for (size_t i = index; i < m_objects.size(); ++i)
+	{
+		m_objects[i]->MarkMaterialDirty();
+	}
+
+	m_renderingPriority.erase(std::remove(m_renderingPriority.begin(), m_renderingPriority.end(), (int)index), m_renderingPriority.end());
+	for (int& priority : m_renderingPriority)
+	{
+		if (priority > (int)index)
+			priority -= 1;
+	}
+
+	return true;
+}
+
+bool Application::CreateSceneResources()
+{
+	// The projection follows the swapchain, see OnSwapchainReady
 	m_uniforms.lightPosition = glm::vec4(0.0f, 0.0f, 0.0f, 1.f);
 	m_uniforms.lightColor = glm::vec4(1.0f, 1.0f, 0.8f, 0.4f);
 	m_uniforms.viewMatrix = m_camera.ViewMatrix();
-	m_uniforms.projMatrix = m_camera.ProjMatrix();
-	m_uniforms.projMatrix[1][1] *= -1;
 
 	return true;
 }
 
+bool Application::AllocateGeometry(GraphicObject& object)
+{
+	auto& vertices = object.Vertices();
+	auto& indices = object.Indices();
+	if (m_geometryArena.Allocate(vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size(), object.Geometry()))
+		return true;
+
+	// The arena is full, make room by evicting meshes that haven't been drawn recently
+	vk::DeviceSize meshBytes = sizeof(Vertex) * vertices.size() + sizeof(uint32_t) * indices.size();
+	return GetResidencyManager().MakeRoom(GAP311::MemoryCategory::eMeshes, meshBytes) &&
+		m_geometryArena.Allocate(vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size(), object.Geometry());
+}
+
 void Application::ReorderRenderingPriority()
 {
 	if (m_objects.size() < 2)
@@ -17,13 +17,19 @@ class Application : public GAP311::VulkanApp
 
 	float m_theta;
 
-	std::vector<GAP311::PipelineObjects> m_pipelines;
+	GAP311::GeometryArena m_geometryArena;
+	std::vector<GAP311::AsyncPipeline> m_pipelines;	// shared between objects with equivalent descriptions
+	std::shared_ptr<GAP311::PipelineObjects> m_pFallbackPipeline;	// kept warm so new objects never wait on a compile
 	std::vector<std::shared_ptr<GraphicObject>> m_objects;
 	std::vector<int> m_renderingPriority;	// value == index of graphic object
+	std::vector<GAP311::ResidencyManager::StreamableId> m_meshStreamables;	// parallel to m_objects
+	std::vector<bool> m_meshResident;	// parallel to m_objects, whether the mesh may be drawn this frame
 
 	GraphicsFileLoader m_graphicLoader;
 	Camera m_camera;
 	Uniforms m_uniforms;
+	uint32_t m_frameUniformOffset;	// dynamic offset of this frame's m_uniforms
+	bool m_bindless;	// transforms and materials live in the bindless table instead of per object bindings
 
 public:
 	Application();
@@ -41,13 +47,16 @@ public:
 	void OnUpdate(float frameTime) final override;
 	bool OnDeviceReady() final override;
 	void OnDeviceLost() final override;
+	bool OnSwapchainReady() final override;
 	void OnPreRender(vk::CommandBuffer& cb) final override;
 	void OnRender(vk::CommandBuffer& cb) final override;
 
 	bool AddGraphicObject(std::shared_ptr<GraphicObject> object, const GAP311::PipelineDescription&);
+	bool RemoveGraphicObject(const std::shared_ptr<GraphicObject>& object);
 
 private:
 	bool CreateSceneResources();
+	bool AllocateGeometry(GraphicObject& object);
 	void ReorderRenderingPriority();
 
 	void UpdateInput(float frameTime);
@@ -0,0 +1,220 @@
+#include "BindlessTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+#pragma warning(disable: 4834) // allow ignoring nodiscard
+
+namespace GAP311
+{
+
+static vk::DeviceSize AlignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool BindlessTable::Initialize(vk::Device device, DeviceMemoryAllocator& allocator, uint32_t frameCount, const Limits& limits,
+    vk::DeviceSize storageOffsetAlignment)
+{
+    m_device = device;
+    m_pAllocator = &allocator;
+    m_limits = limits;
+    m_textureCount = 0;
+    m_freeTextures.clear();
+
+    if (m_limits.materialStride == 0 || m_limits.objectStride == 0 || m_limits.maxTextures == 0)
+        return false;
+
+    // Only the texture array is written while sets are bound, the buffers are written once below
+    vk::DescriptorSetLayoutBinding bindings[3];
+    bindings[s_kTextureBinding].binding = s_kTextureBinding;
+    bindings[s_kTextureBinding].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    bindings[s_kTextureBinding].descriptorCount = m_limits.maxTextures;
+    bindings[s_kTextureBinding].stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
+    bindings[s_kMaterialBinding].binding = s_kMaterialBinding;
+    bindings[s_kMaterialBinding].descriptorType = vk::DescriptorType::eStorageBuffer;
+    bindings[s_kMaterialBinding].descriptorCount = 1;
+    bindings[s_kMaterialBinding].stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
+    bindings[s_kObjectBinding].binding = s_kObjectBinding;
+    bindings[s_kObjectBinding].descriptorType = vk::DescriptorType::eStorageBuffer;
+    bindings[s_kObjectBinding].descriptorCount = 1;
+    bindings[s_kObjectBinding].stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
+
+    vk::DescriptorBindingFlagsEXT bindingFlags[3] =
+    {
+        vk::DescriptorBindingFlagBitsEXT::ePartiallyBound | vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind,
+        {},
+        {},
+    };
+    vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo;
+    bindingFlagsInfo.bindingCount = 3;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
+    m_layout = device.createDescriptorSetLayout(layoutInfo);
+    if (!m_layout)
+        return false;
+
+    // The sets need an update-after-bind pool of their own, the app's DescriptorAllocator pools aren't
+    vk::DescriptorPoolSize poolSizes[] =
+    {
+        { vk::DescriptorType::eCombinedImageSampler, m_limits.maxTextures * frameCount },
+        { vk::DescriptorType::eStorageBuffer, 2 * frameCount },
+    };
+    vk::DescriptorPoolCreateInfo poolInfo;
+    poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT;
+    poolInfo.maxSets = frameCount;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+    m_pool = device.createDescriptorPool(poolInfo);
+    if (!m_pool)
+        return false;
+
+    std::vector<vk::DescriptorSetLayout> setLayouts(frameCount, m_layout);
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = m_pool;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = setLayouts.data();
+    m_sets = device.allocateDescriptorSets(allocInfo);
+    if (m_sets.size() != frameCount)
+        return false;
+
+    // Each frame's region holds the materials followed by the objects
+    vk::DeviceSize alignment = std::max<vk::DeviceSize>(storageOffsetAlignment, 1);
+    vk::DeviceSize materialBytes = vk::DeviceSize(m_limits.materialStride) * m_limits.maxMaterials;
+    vk::DeviceSize objectBytes = vk::DeviceSize(m_limits.objectStride) * m_limits.maxObjects;
+    m_objectsOffset = AlignUp(materialBytes, alignment);
+    m_bytesPerFrame = AlignUp(m_objectsOffset + objectBytes, alignment);
+
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = m_bytesPerFrame * frameCount;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+    m_buffer = device.createBuffer(bufferInfo);
+    if (!m_buffer)
+        return false;
+
+    auto bufferMemoryReq = device.getBufferMemoryRequirements(m_buffer);
+    if (!allocator.Allocate(bufferMemoryReq, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, ResourceTiling::eLinear, MemoryCategory::eUniforms, m_allocation))
+        return false;
+
+    device.bindBufferMemory(m_buffer, m_allocation.memory, m_allocation.offset);
+    std::memset(m_allocation.pMapped, 0, static_cast<size_t>(bufferInfo.size));
+
+    for (uint32_t frameIndex = 0; frameIndex < frameCount; ++frameIndex)
+    {
+        vk::DescriptorBufferInfo bufferInfos[2];
+        bufferInfos[0] = { m_buffer, m_bytesPerFrame * frameIndex, materialBytes };
+        bufferInfos[1] = { m_buffer, m_bytesPerFrame * frameIndex + m_objectsOffset, objectBytes };
+
+        vk::WriteDescriptorSet updates[2];
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            updates[i].dstSet = m_sets[frameIndex];
+            updates[i].dstBinding = i == 0 ? s_kMaterialBinding : s_kObjectBinding;
+            updates[i].descriptorCount = 1;
+            updates[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+            updates[i].pBufferInfo = &bufferInfos[i];
+        }
+        device.updateDescriptorSets(2, updates, 0, nullptr);
+    }
+
+    return true;
+}
+
+void BindlessTable::Shutdown()
+{
+    if (!m_device)
+        return;
+
+    // Destroying the pool frees the sets
+    if (m_pool)
+        m_device.destroyDescriptorPool(m_pool);
+    if (m_layout)
+        m_device.destroyDescriptorSetLayout(m_layout);
+    if (m_buffer)
+        m_device.destroyBuffer(m_buffer);
+    if (m_pAllocator)
+        m_pAllocator->Free(m_allocation);
+
+    m_pool = nullptr;
+    m_layout = nullptr;
+    m_buffer = nullptr;
+    m_sets.clear();
+    m_freeTextures.clear();
+    m_textureCount = 0;
+    m_pAllocator = nullptr;
+    m_device = nullptr;
+}
+
+uint32_t BindlessTable::AddTexture(vk::ImageView imageView, vk::Sampler sampler)
+{
+    uint32_t index;
+    if (!m_freeTextures.empty())
+    {
+        index = m_freeTextures.back();
+        m_freeTextures.pop_back();
+    }
+    else if (m_textureCount < m_limits.maxTextures)
+    {
+        index = m_textureCount++;
+    }
+    else
+    {
+        return s_kInvalidIndex;
+    }
+
+    // Update-after-bind lets the element change while the sets are bound by frames in flight,
+    // none of which can be sampling an element that was free
+    vk::DescriptorImageInfo imageInfo(sampler, imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+    std::vector<vk::WriteDescriptorSet> updates(m_sets.size());
+    for (size_t i = 0; i < m_sets.size(); ++i)
+    {
+        updates[i].dstSet = m_sets[i];
+        updates[i].dstBinding = s_kTextureBinding;
+        updates[i].dstArrayElement = index;
+        updates[i].descriptorCount = 1;
+        updates[i].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+        updates[i].pImageInfo = &imageInfo;
+    }
+    m_device.updateDescriptorSets(updates, {});
+
+    return index;
+}
+
+void BindlessTable::RemoveTexture(uint32_t index)
+{
+    // The stale descriptor stays behind, partially bound arrays only require the elements in use to be valid
+    if (index < m_textureCount)
+        m_freeTextures.push_back(index);
+}
+
+void BindlessTable::WriteMaterial(uint32_t frameIndex, uint32_t index, const void* pData, size_t dataSize)
+{
+    if (index < m_limits.maxMaterials)
+        Write(frameIndex, 0, m_limits.materialStride, index, pData, dataSize);
+}
+
+void BindlessTable::WriteObject(uint32_t frameIndex, uint32_t index, const void* pData, size_t dataSize)
+{
+    if (index < m_limits.maxObjects)
+        Write(frameIndex, m_objectsOffset, m_limits.objectStride, index, pData, dataSize);
+}
+
+void BindlessTable::Bind(vk::CommandBuffer& cb, vk::PipelineLayout layout, uint32_t setIndex, uint32_t frameIndex) const
+{
+    cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, setIndex, 1, &m_sets[frameIndex], 0, nullptr);
+}
+
+void BindlessTable::Write(uint32_t frameIndex, vk::DeviceSize arrayOffset, uint32_t stride, uint32_t index, const void* pData, size_t dataSize)
+{
+    vk::DeviceSize offset = m_bytesPerFrame * frameIndex + arrayOffset + vk::DeviceSize(stride) * index;
+    std::memcpy(static_cast<uint8_t*>(m_allocation.pMapped) + offset, pData, std::min<size_t>(dataSize, stride));
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+namespace GAP311
+{
+    /// One descriptor set per frame in flight holding every resource draws may reference, indexed in
+    /// the shaders instead of being bound per draw. Requires VK_EXT_descriptor_indexing.
+    ///
+    ///   binding 0 - sampler2D textures[], a partially bound, update-after-bind array
+    ///   binding 1 - storage buffer of materials, indexed by material index
+    ///   binding 2 - storage buffer of objects, indexed by object index
+    ///
+    /// The set is bound once per frame, so draws only differ by the indices they push and objects with
+    /// different materials or textures can be merged into one indirect or multi-draw call. Textures may be
+    /// added while sets are bound. Materials and objects live in a persistently mapped, host coherent
+    /// buffer with a region per frame in flight, written for the frame being recorded like UniformRing.
+    class BindlessTable
+    {
+    public:
+        static constexpr uint32_t s_kTextureBinding = 0;
+        static constexpr uint32_t s_kMaterialBinding = 1;
+        static constexpr uint32_t s_kObjectBinding = 2;
+        static constexpr uint32_t s_kInvalidIndex = ~0u;
+
+        struct Limits
+        {
+            uint32_t maxTextures = 1024;
+            uint32_t maxMaterials = 4096;
+            uint32_t materialStride = 0;    // array stride of the std430 material struct in the shaders
+            uint32_t maxObjects = 4096;
+            uint32_t objectStride = 0;      // array stride of the std430 object struct in the shaders
+        };
+
+        bool Initialize(vk::Device device, DeviceMemoryAllocator& allocator, uint32_t frameCount, const Limits& limits,
+            vk::DeviceSize storageOffsetAlignment);
+        void Shutdown();
+
+        vk::DescriptorSetLayout GetLayout() const { return m_layout; }
+        const Limits& GetLimits() const { return m_limits; }
+
+        /// Returns the array element the texture was written to, s_kInvalidIndex when the array is full.
+        /// The image must be in eShaderReadOnlyOptimal layout whenever a draw samples it.
+        uint32_t AddTexture(vk::ImageView imageView, vk::Sampler sampler);
+        /// Makes the element available again, only once no frame in flight samples it
+        void RemoveTexture(uint32_t index);
+
+        /// Write element index of the frame's arrays, dataSize is clamped to the stride
+        void WriteMaterial(uint32_t frameIndex, uint32_t index, const void* pData, size_t dataSize);
+        void WriteObject(uint32_t frameIndex, uint32_t index, const void* pData, size_t dataSize);
+
+        void Bind(vk::CommandBuffer& cb, vk::PipelineLayout layout, uint32_t setIndex, uint32_t frameIndex) const;
+
+    private:
+        void Write(uint32_t frameIndex, vk::DeviceSize arrayOffset, uint32_t stride, uint32_t index, const void* pData, size_t dataSize);
+
+        vk::Device m_device;
+        DeviceMemoryAllocator* m_pAllocator = nullptr;
+        Limits m_limits;
+
+        vk::DescriptorSetLayout m_layout;
+        vk::DescriptorPool m_pool;
+        std::vector<vk::DescriptorSet> m_sets;     // one per frame in flight
+
+        vk::Buffer m_buffer;
+        MemoryAllocation m_allocation;
+        vk::DeviceSize m_bytesPerFrame = 0;
+        vk::DeviceSize m_objectsOffset = 0;        // within a frame's region, materials start at 0
+
+        uint32_t m_textureCount = 0;               // elements handed out so far, including freed ones
+        std::vector<uint32_t> m_freeTextures;
+    };
+}
@@ -0,0 +1,196 @@
+#include "BufferDefragmenter.h"
+
+#pragma warning(disable: 4834) // allow ignoring nodiscard
+
+namespace GAP311
+{
+
+bool BufferDefragmenter::Initialize(vk::Device device, DeviceMemoryAllocator& allocator, UploadQueue& uploadQueue, uint32_t frameCount,
+    const Settings& settings)
+{
+    m_device = device;
+    m_pAllocator = &allocator;
+    m_pUploadQueue = &uploadQueue;
+    m_settings = settings;
+    m_sourceBlock = s_kNoBlock;
+    m_retired.resize(frameCount);
+    m_stats = Stats();
+    return true;
+}
+
+void BufferDefragmenter::Shutdown()
+{
+    for (auto& frame : m_retired)
+    {
+        for (Retired& retired : frame)
+        {
+            m_device.destroyBuffer(retired.buffer);
+            m_pAllocator->Free(retired.allocation);
+        }
+    }
+    m_retired.clear();
+    m_movables.clear();
+    m_sourceBlock = s_kNoBlock;
+    m_pAllocator = nullptr;
+    m_pUploadQueue = nullptr;
+    m_device = nullptr;
+}
+
+void BufferDefragmenter::Register(vk::Buffer buffer, vk::DeviceSize size, vk::BufferUsageFlags usage, const MemoryAllocation& allocation,
+    MoveCallback onMoved)
+{
+    Movable& movable = m_movables[static_cast<VkBuffer>(buffer)];
+    movable.size = size;
+    movable.usage = usage;
+    movable.allocation = allocation;
+    movable.onMoved = std::move(onMoved);
+}
+
+void BufferDefragmenter::Unregister(vk::Buffer buffer)
+{
+    m_movables.erase(static_cast<VkBuffer>(buffer));
+}
+
+void BufferDefragmenter::BeginFrame(uint32_t frameIndex)
+{
+    m_stats.movesThisFrame = 0;
+    m_stats.bytesMovedThisFrame = 0;
+
+    std::vector<Retired>& retiredBuffers = m_retired[frameIndex];
+    if (retiredBuffers.empty())
+        return;
+
+    // The copies reading these buffers, and any older frame drawing from them, have completed
+    for (Retired& retired : retiredBuffers)
+    {
+        m_device.destroyBuffer(retired.buffer);
+        m_pAllocator->Free(retired.allocation);
+    }
+    retiredBuffers.clear();
+
+    if (m_sourceBlock != s_kNoBlock && m_pAllocator->GetBlockAllocationCount(m_sourceBlock) == 0)
+    {
+        m_pAllocator->ReleaseBlockIfEmpty(m_sourceBlock);
+        m_stats.blocksReleased += 1;
+        m_sourceBlock = s_kNoBlock;
+    }
+}
+
+void BufferDefragmenter::Record(vk::CommandBuffer& cb, uint32_t frameIndex)
+{
+    if (!m_enabled || m_movables.empty())
+        return;
+
+    if (m_sourceBlock != s_kNoBlock)
+    {
+        // New allocations may land in the block being emptied, give up on it if anything unmovable did
+        uint32_t accounted = 0;
+        for (const auto& frame : m_retired)
+        {
+            for (const Retired& retired : frame)
+                accounted += retired.allocation.blockIndex == m_sourceBlock ? 1 : 0;
+        }
+        for (const auto& entry : m_movables)
+            accounted += entry.second.allocation.blockIndex == m_sourceBlock ? 1 : 0;
+
+        if (accounted != m_pAllocator->GetBlockAllocationCount(m_sourceBlock))
+            m_sourceBlock = s_kNoBlock;
+    }
+
+    if (m_sourceBlock == s_kNoBlock && !PickSourceBlock())
+        return;
+
+    std::vector<VkBuffer> toMove;
+    vk::DeviceSize budget = 0;
+    for (const auto& entry : m_movables)
+    {
+        if (entry.second.allocation.blockIndex != m_sourceBlock || m_pUploadQueue->HasPendingUploads(vk::Buffer(entry.first)))
+            continue;
+        if (!toMove.empty() && budget + entry.second.size > m_settings.bytesPerFrame)
+            break;
+
+        toMove.push_back(entry.first);
+        budget += entry.second.size;
+    }
+
+    if (toMove.empty())
+        return;
+
+    // Earlier frames may still be writing the sources or reading the ranges the copies land in
+    vk::MemoryBarrier before(vk::AccessFlagBits::eMemoryWrite, vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {}, before, nullptr, nullptr);
+
+    std::vector<Retired>& retired = m_retired[frameIndex];
+    for (VkBuffer buffer : toMove)
+    {
+        auto node = m_movables.extract(buffer);
+        vk::Buffer newBuffer;
+        if (!Move(cb, vk::Buffer(buffer), node.mapped(), newBuffer, retired))
+        {
+            // The other blocks filled up, try a different block later
+            m_movables.insert(std::move(node));
+            m_sourceBlock = s_kNoBlock;
+            break;
+        }
+
+        node.key() = static_cast<VkBuffer>(newBuffer);
+        m_movables.insert(std::move(node));
+    }
+
+    vk::MemoryBarrier after(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, after, nullptr, nullptr);
+}
+
+bool BufferDefragmenter::PickSourceBlock()
+{
+    for (uint32_t blockIndex : m_pAllocator->GetDefragmentationCandidates(m_settings.maxBlockUsage))
+    {
+        uint32_t movableCount = 0;
+        for (const auto& entry : m_movables)
+            movableCount += entry.second.allocation.blockIndex == blockIndex ? 1 : 0;
+
+        if (movableCount > 0 && movableCount == m_pAllocator->GetBlockAllocationCount(blockIndex))
+        {
+            m_sourceBlock = blockIndex;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool BufferDefragmenter::Move(vk::CommandBuffer& cb, vk::Buffer buffer, Movable& movable, vk::Buffer& newBuffer, std::vector<Retired>& retired)
+{
+    MemoryAllocation newAllocation;
+    if (!m_pAllocator->AllocateForMove(movable.allocation, newAllocation))
+        return false;
+
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = movable.size;
+    bufferInfo.usage = movable.usage;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+    m_pUploadQueue->ShareWithTransferQueue(bufferInfo);
+
+    newBuffer = m_device.createBuffer(bufferInfo);
+    if (!newBuffer)
+    {
+        m_pAllocator->Free(newAllocation);
+        return false;
+    }
+    m_device.bindBufferMemory(newBuffer, newAllocation.memory, newAllocation.offset);
+
+    cb.copyBuffer(buffer, newBuffer, vk::BufferCopy(0, 0, movable.size));
+    m_pUploadQueue->SyncWithGraphicsQueue(newBuffer);
+
+    retired.push_back({ buffer, movable.allocation });
+    movable.allocation = newAllocation;
+    movable.onMoved(newBuffer, newAllocation);
+
+    m_stats.movesThisFrame += 1;
+    m_stats.bytesMovedThisFrame += movable.size;
+    m_stats.totalMoves += 1;
+    m_stats.totalBytesMoved += movable.size;
+    return true;
+}
+
+}
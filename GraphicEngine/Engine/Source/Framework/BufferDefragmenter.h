@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+#include "UploadQueue.h"
+
+namespace GAP311
+{
+    /// Compacts device memory by emptying sparse allocator blocks a few buffers at a time.
+    ///
+    /// Buddy allocations can't slide within a block, so compaction works on whole blocks:
+    /// the sparsest block whose contents fit elsewhere is picked and each of its buffers is
+    /// recreated in a fuller block, copied over on the GPU and handed back to its owner
+    /// through a callback. The old buffer lives on until the frame which copied it has
+    /// finished, after which its memory is freed and the emptied block is released.
+    ///
+    /// Only buffers registered here can be moved, a block holding anything else is never picked.
+    class BufferDefragmenter
+    {
+    public:
+        /// Called while recording the copy, the owner must switch over to newBuffer right away.
+        /// The old buffer and its memory are released by the defragmenter. Uploads into newBuffer
+        /// stay on the graphics queue, behind the copy, until the frame which recorded it finished.
+        using MoveCallback = std::function<void(vk::Buffer newBuffer, const MemoryAllocation& newAllocation)>;
+
+        struct Settings
+        {
+            vk::DeviceSize bytesPerFrame = 8ull * 1024 * 1024;  // copy budget, at least one buffer moves per frame
+            float maxBlockUsage = 0.5f;                         // fuller blocks are left alone
+        };
+
+        struct Stats
+        {
+            uint32_t movesThisFrame = 0;
+            vk::DeviceSize bytesMovedThisFrame = 0;
+            uint64_t totalMoves = 0;
+            uint64_t totalBytesMoved = 0;
+            uint32_t blocksReleased = 0;
+        };
+
+        bool Initialize(vk::Device device, DeviceMemoryAllocator& allocator, UploadQueue& uploadQueue, uint32_t frameCount,
+            const Settings& settings = Settings());
+        void Shutdown();
+
+        /// The buffer must have been created with transfer source and destination usage
+        void Register(vk::Buffer buffer, vk::DeviceSize size, vk::BufferUsageFlags usage, const MemoryAllocation& allocation, MoveCallback onMoved);
+        void Unregister(vk::Buffer buffer);
+
+        /// Call once the fence of frameIndex has signalled, releases the buffers that frame moved away from
+        void BeginFrame(uint32_t frameIndex);
+
+        /// Records this frame's share of copies into cb, ahead of any other use of the moved buffers
+        void Record(vk::CommandBuffer& cb, uint32_t frameIndex);
+
+        void SetEnabled(bool enabled) { m_enabled = enabled; }
+        Stats GetStats() const { return m_stats; }
+
+    private:
+        static constexpr uint32_t s_kNoBlock = ~0u;
+
+        struct Movable
+        {
+            vk::DeviceSize size = 0;
+            vk::BufferUsageFlags usage;
+            MemoryAllocation allocation;
+            MoveCallback onMoved;
+        };
+
+        struct Retired
+        {
+            vk::Buffer buffer;
+            MemoryAllocation allocation;
+        };
+
+        bool PickSourceBlock();
+        bool Move(vk::CommandBuffer& cb, vk::Buffer buffer, Movable& movable, vk::Buffer& newBuffer, std::vector<Retired>& retired);
+
+        vk::Device m_device;
+        DeviceMemoryAllocator* m_pAllocator = nullptr;
+        UploadQueue* m_pUploadQueue = nullptr;
+        Settings m_settings;
+        bool m_enabled = true;
+
+        std::unordered_map<VkBuffer, Movable> m_movables;
+        uint32_t m_sourceBlock = s_kNoBlock;
+        std::vector<std::vector<Retired>> m_retired;    // per frame in flight
+        Stats m_stats;
+    };
+}
@@ -0,0 +1,45 @@
+#include "DeletionQueue.h"
+
+namespace GAP311
+{
+
+void DeletionQueue::Enqueue(uint64_t frame, Deleter deleter)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.push_back({ frame, std::move(deleter) });
+}
+
+void DeletionQueue::Flush(uint64_t completedFrame)
+{
+    // Deleters run without the lock held, they may well release resources which enqueue further deletions
+    Deleter deleter;
+    while (PopReady(completedFrame, false, deleter))
+        deleter();
+}
+
+void DeletionQueue::FlushAll()
+{
+    Deleter deleter;
+    while (PopReady(0, true, deleter))
+        deleter();
+}
+
+size_t DeletionQueue::GetPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+bool DeletionQueue::PopReady(uint64_t completedFrame, bool all, Deleter& deleter)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_entries.empty() || (!all && m_entries.front().frame > completedFrame))
+        return false;
+
+    deleter = std::move(m_entries.front().deleter);
+    m_entries.pop_front();
+    return true;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <functional>
+
+namespace GAP311
+{
+    /// Holds on to the destruction of GPU resources until the frames which may use them have finished.
+    ///
+    /// Each deletion is tagged with the number of the frame being recorded when it was requested.
+    /// Once the fence of a later frame has been waited on, every deletion tagged with a frame
+    /// submitted before it is run, so resources can be dropped at any point without a device stall.
+    class DeletionQueue
+    {
+    public:
+        using Deleter = std::function<void()>;
+
+        /// frame is the number of the last frame which may use the resources
+        void Enqueue(uint64_t frame, Deleter deleter);
+
+        /// Runs the deletions of every frame up to and including completedFrame
+        void Flush(uint64_t completedFrame);
+        /// Runs every deletion, the device must be idle
+        void FlushAll();
+
+        size_t GetPendingCount() const;
+
+    private:
+        struct Entry
+        {
+            uint64_t frame = 0;
+            Deleter deleter;
+        };
+
+        bool PopReady(uint64_t completedFrame, bool all, Deleter& deleter);
+
+        std::deque<Entry> m_entries;    // sorted by frame, deletions are only ever requested for the current frame
+        mutable std::mutex m_mutex;
+    };
+}
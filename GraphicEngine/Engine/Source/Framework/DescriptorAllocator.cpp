@@ -0,0 +1,347 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+
+#pragma warning(disable: 4834)
+
+namespace GAP311
+{
+
+// Descriptors reserved per set in every pool, sets of the engine hold a couple of uniform buffers
+static constexpr std::pair<vk::DescriptorType, uint32_t> s_kDescriptorsPerSet[] =
+{
+    { vk::DescriptorType::eUniformBuffer, 2 },
+    { vk::DescriptorType::eUniformBufferDynamic, 2 },
+    { vk::DescriptorType::eCombinedImageSampler, 1 },
+    { vk::DescriptorType::eSampler, 1 },
+};
+
+static constexpr uint32_t s_kFirstPoolSize = 64;
+static constexpr uint32_t s_kMaxPoolSize = 4096;
+static constexpr uint32_t s_kTransientPoolSize = 256;
+
+static void HashCombine(uint64_t& seed, uint64_t value)
+{
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+bool DescriptorAllocator::Initialize(vk::Device device)
+{
+    m_device = device;
+    m_nextPoolSize = s_kFirstPoolSize;
+    m_sharedSetHits = 0;
+    return static_cast<bool>(m_device);
+}
+
+void DescriptorAllocator::Shutdown()
+{
+    if (!m_device)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Destroying the pools frees every set allocated from them
+    for (auto& pool : m_pools)
+        m_device.destroyDescriptorPool(pool.pool);
+    m_pools.clear();
+    m_setPools.clear();
+    m_sharedSets.clear();
+    m_sharedSetHashes.clear();
+
+    for (auto& frame : m_framePools)
+    {
+        std::lock_guard<std::mutex> frameLock(frame.mutex);
+        for (auto& [thread, threadPools] : frame.threads)
+        {
+            for (auto pool : threadPools.pools)
+                m_device.destroyDescriptorPool(pool);
+        }
+        frame.threads.clear();
+    }
+
+    for (auto& [hash, layout] : m_layouts)
+        m_device.destroyDescriptorSetLayout(layout.layout);
+    m_layouts.clear();
+
+    m_device = nullptr;
+}
+
+vk::DescriptorSetLayout DescriptorAllocator::GetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t hash = HashBindings(bindings);
+    auto range = m_layouts.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (SameBindings(it->second.bindings, bindings))
+            return it->second.layout;
+    }
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.pBindings = bindings.data();
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    vk::DescriptorSetLayout layout = m_device.createDescriptorSetLayout(layoutInfo);
+    if (layout)
+        m_layouts.emplace(hash, Layout{ layout, bindings });
+    return layout;
+}
+
+vk::DescriptorSet DescriptorAllocator::Allocate(vk::DescriptorSetLayout layout)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return AllocateLocked(layout);
+}
+
+vk::DescriptorSet DescriptorAllocator::AcquireShared(vk::DescriptorSetLayout layout, const std::vector<BufferWrite>& writes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t hash = HashWrites(layout, writes);
+    auto range = m_sharedSets.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second.layout != layout || !SameWrites(it->second.writes, writes))
+            continue;
+
+        it->second.refCount += 1;
+        m_sharedSetHits += 1;
+        return it->second.set;
+    }
+
+    vk::DescriptorSet set = AllocateLocked(layout);
+    if (!set)
+        return nullptr;
+
+    std::vector<vk::DescriptorBufferInfo> bufferInfos(writes.size());
+    std::vector<vk::WriteDescriptorSet> updates(writes.size());
+    for (size_t i = 0; i < writes.size(); ++i)
+    {
+        bufferInfos[i].buffer = writes[i].buffer;
+        bufferInfos[i].offset = writes[i].offset;
+        bufferInfos[i].range = writes[i].range;
+
+        updates[i].dstSet = set;
+        updates[i].dstBinding = writes[i].binding;
+        updates[i].descriptorCount = 1;
+        updates[i].descriptorType = writes[i].type;
+        updates[i].pBufferInfo = &bufferInfos[i];
+    }
+    m_device.updateDescriptorSets(updates, {});
+
+    m_sharedSets.emplace(hash, SharedSet{ set, 1, layout, writes });
+    m_sharedSetHashes[set] = hash;
+    return set;
+}
+
+void DescriptorAllocator::Free(vk::DescriptorSet set)
+{
+    if (!set)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto sharedIt = m_sharedSetHashes.find(set);
+    if (sharedIt != m_sharedSetHashes.end())
+    {
+        auto range = m_sharedSets.equal_range(sharedIt->second);
+        auto it = std::find_if(range.first, range.second, [set](const auto& entry) { return entry.second.set == set; });
+        if (it != range.second && --it->second.refCount > 0)
+            return;
+
+        if (it != range.second)
+            m_sharedSets.erase(it);
+        m_sharedSetHashes.erase(sharedIt);
+    }
+
+    FreeLocked(set);
+}
+
+vk::DescriptorSet DescriptorAllocator::AllocateTransient(uint32_t frameIndex, vk::DescriptorSetLayout layout)
+{
+    FramePools& frame = m_framePools[frameIndex];
+
+    ThreadPools* pThreadPools = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(frame.mutex);
+        pThreadPools = &frame.threads[std::this_thread::get_id()];
+    }
+
+    // Only this thread touches its pools until the frame is reset
+    while (true)
+    {
+        if (pThreadPools->current == pThreadPools->pools.size())
+        {
+            vk::DescriptorPool pool = CreatePool(s_kTransientPoolSize, false);
+            if (!pool)
+                return nullptr;
+            pThreadPools->pools.push_back(pool);
+        }
+
+        vk::Result result;
+        vk::DescriptorSet set = AllocateFrom(pThreadPools->pools[pThreadPools->current], layout, result);
+        if (set)
+            return set;
+        if (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)
+            return nullptr;
+
+        pThreadPools->current += 1;
+    }
+}
+
+void DescriptorAllocator::BeginFrame(uint32_t frameIndex)
+{
+    FramePools& frame = m_framePools[frameIndex];
+
+    std::lock_guard<std::mutex> lock(frame.mutex);
+    for (auto& [thread, threadPools] : frame.threads)
+    {
+        for (size_t i = 0; i < std::min(threadPools.current + 1, threadPools.pools.size()); ++i)
+            m_device.resetDescriptorPool(threadPools.pools[i]);
+        threadPools.current = 0;
+    }
+}
+
+DescriptorAllocator::Stats DescriptorAllocator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Stats stats;
+    stats.poolCount = m_pools.size();
+    stats.setCount = m_setPools.size();
+    stats.sharedSetCount = m_sharedSets.size();
+    stats.sharedSetHits = m_sharedSetHits;
+    stats.layoutCount = m_layouts.size();
+    for (auto& frame : m_framePools)
+    {
+        std::lock_guard<std::mutex> frameLock(const_cast<std::mutex&>(frame.mutex));
+        for (auto& [thread, threadPools] : frame.threads)
+            stats.transientPoolCount += threadPools.pools.size();
+    }
+    return stats;
+}
+
+vk::DescriptorPool DescriptorAllocator::CreatePool(uint32_t maxSets, bool freeable)
+{
+    std::vector<vk::DescriptorPoolSize> poolSizes;
+    for (auto& [type, count] : s_kDescriptorsPerSet)
+        poolSizes.emplace_back(type, count * maxSets);
+
+    vk::DescriptorPoolCreateInfo poolInfo;
+    if (freeable)
+        poolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    poolInfo.maxSets = maxSets;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    vk::DescriptorPool pool;
+    if (m_device.createDescriptorPool(&poolInfo, nullptr, &pool) != vk::Result::eSuccess)
+        return nullptr;
+    return pool;
+}
+
+vk::DescriptorSet DescriptorAllocator::AllocateFrom(vk::DescriptorPool pool, vk::DescriptorSetLayout layout, vk::Result& outResult)
+{
+    vk::DescriptorSetAllocateInfo allocInfo;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    // The non throwing overload, running out of pool memory is expected here
+    vk::DescriptorSet set;
+    outResult = m_device.allocateDescriptorSets(&allocInfo, &set);
+    return outResult == vk::Result::eSuccess ? set : vk::DescriptorSet();
+}
+
+vk::DescriptorSet DescriptorAllocator::AllocateLocked(vk::DescriptorSetLayout layout)
+{
+    // Newest pools are the most likely to have room
+    for (size_t i = m_pools.size(); i-- > 0;)
+    {
+        if (m_pools[i].exhausted)
+            continue;
+
+        vk::Result result;
+        vk::DescriptorSet set = AllocateFrom(m_pools[i].pool, layout, result);
+        if (set)
+        {
+            m_setPools[set] = i;
+            return set;
+        }
+        if (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)
+            return nullptr;
+
+        m_pools[i].exhausted = true;
+    }
+
+    // Every pool is full, chain a bigger one
+    vk::DescriptorPool pool = CreatePool(m_nextPoolSize, true);
+    if (!pool)
+        return nullptr;
+    m_pools.push_back({ pool, false });
+    m_nextPoolSize = std::min(m_nextPoolSize * 2, s_kMaxPoolSize);
+
+    vk::Result result;
+    vk::DescriptorSet set = AllocateFrom(pool, layout, result);
+    if (set)
+        m_setPools[set] = m_pools.size() - 1;
+    return set;
+}
+
+void DescriptorAllocator::FreeLocked(vk::DescriptorSet set)
+{
+    auto it = m_setPools.find(set);
+    if (it == m_setPools.end())
+        return;
+
+    // Freeing makes room again, the pool is worth trying before chaining another
+    Pool& pool = m_pools[it->second];
+    m_device.freeDescriptorSets(pool.pool, 1, &set);
+    pool.exhausted = false;
+    m_setPools.erase(it);
+}
+
+uint64_t DescriptorAllocator::HashWrites(vk::DescriptorSetLayout layout, const std::vector<BufferWrite>& writes)
+{
+    uint64_t hash = reinterpret_cast<uint64_t>(static_cast<VkDescriptorSetLayout>(layout));
+    for (auto& write : writes)
+    {
+        HashCombine(hash, write.binding);
+        HashCombine(hash, static_cast<uint64_t>(write.type));
+        HashCombine(hash, reinterpret_cast<uint64_t>(static_cast<VkBuffer>(write.buffer)));
+        HashCombine(hash, write.offset);
+        HashCombine(hash, write.range);
+    }
+    return hash;
+}
+
+bool DescriptorAllocator::SameWrites(const std::vector<BufferWrite>& a, const std::vector<BufferWrite>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const BufferWrite& x, const BufferWrite& y)
+    {
+        return x.binding == y.binding && x.type == y.type && x.buffer == y.buffer && x.offset == y.offset && x.range == y.range;
+    });
+}
+
+bool DescriptorAllocator::SameBindings(const std::vector<vk::DescriptorSetLayoutBinding>& a, const std::vector<vk::DescriptorSetLayoutBinding>& b)
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const vk::DescriptorSetLayoutBinding& x, const vk::DescriptorSetLayoutBinding& y)
+    {
+        return x.binding == y.binding && x.descriptorType == y.descriptorType && x.descriptorCount == y.descriptorCount && x.stageFlags == y.stageFlags;
+    });
+}
+
+uint64_t DescriptorAllocator::HashBindings(const std::vector<vk::DescriptorSetLayoutBinding>& bindings)
+{
+    uint64_t hash = bindings.size();
+    for (auto& binding : bindings)
+    {
+        HashCombine(hash, binding.binding);
+        HashCombine(hash, static_cast<uint64_t>(binding.descriptorType));
+        HashCombine(hash, binding.descriptorCount);
+        HashCombine(hash, static_cast<uint64_t>(static_cast<VkShaderStageFlags>(binding.stageFlags)));
+    }
+    return hash;
+}
+
+}
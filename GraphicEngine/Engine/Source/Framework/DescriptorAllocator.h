@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+#include "PerFrame.h"
+
+namespace GAP311
+{
+    /// Hands out descriptor sets from pools which are created as they are needed.
+    ///
+    /// Long lived sets come from a chain of pools, when every pool is exhausted a new one twice the
+    /// size of the last is added, so the number of sets is only bounded by memory. Sets whose layout
+    /// and contents are identical are shared, callers acquiring the same content get the same set.
+    /// Sets which only live for one frame come from pools owned by the thread and frame in flight
+    /// allocating them, which are reset in bulk once that frame has finished on the GPU.
+    class DescriptorAllocator
+    {
+    public:
+        struct BufferWrite
+        {
+            uint32_t binding = 0;
+            vk::DescriptorType type = vk::DescriptorType::eUniformBuffer;
+            vk::Buffer buffer;
+            vk::DeviceSize offset = 0;
+            vk::DeviceSize range = 0;
+        };
+
+        struct Stats
+        {
+            size_t poolCount = 0;           // pools of long lived sets
+            size_t transientPoolCount = 0;
+            size_t setCount = 0;            // long lived sets, shared ones counted once
+            size_t sharedSetCount = 0;
+            uint64_t sharedSetHits = 0;     // acquisitions served by an existing set
+            size_t layoutCount = 0;
+        };
+
+        bool Initialize(vk::Device device);
+        void Shutdown();
+
+        /// Layouts are cached by their bindings and stay alive until Shutdown, don't destroy them
+        vk::DescriptorSetLayout GetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+
+        /// A long lived set which the caller writes, null if the device is out of memory
+        vk::DescriptorSet Allocate(vk::DescriptorSetLayout layout);
+        /// A set holding writes, shared with everyone asking for the same layout and contents.
+        /// The contents must not be changed by the caller.
+        vk::DescriptorSet AcquireShared(vk::DescriptorSetLayout layout, const std::vector<BufferWrite>& writes);
+        /// Returns a set from Allocate or AcquireShared, shared sets are freed with their last user.
+        /// The set must no longer be used by frames in flight.
+        void Free(vk::DescriptorSet set);
+
+        /// A set which is only valid while frameIndex is recorded, may be called from any thread
+        vk::DescriptorSet AllocateTransient(uint32_t frameIndex, vk::DescriptorSetLayout layout);
+        /// Call once the fence of frameIndex has signalled, resets every transient pool of that frame
+        void BeginFrame(uint32_t frameIndex);
+
+        Stats GetStats() const;
+
+    private:
+        struct Pool
+        {
+            vk::DescriptorPool pool;
+            bool exhausted = false;
+        };
+
+        struct ThreadPools
+        {
+            std::vector<vk::DescriptorPool> pools;
+            size_t current = 0;     // pools before this one are full until the next reset
+        };
+
+        struct FramePools
+        {
+            std::mutex mutex;       // guards the map only, each thread allocates from its own pools
+            std::unordered_map<std::thread::id, ThreadPools> threads;
+        };
+
+        struct SharedSet
+        {
+            vk::DescriptorSet set;
+            uint32_t refCount = 0;
+            vk::DescriptorSetLayout layout;     // compared on a hash match, different contents may hash alike
+            std::vector<BufferWrite> writes;
+        };
+
+        struct Layout
+        {
+            vk::DescriptorSetLayout layout;
+            std::vector<vk::DescriptorSetLayoutBinding> bindings;  // compared on a hash match like SharedSet's writes
+        };
+
+        vk::DescriptorPool CreatePool(uint32_t maxSets, bool freeable);
+        vk::DescriptorSet AllocateFrom(vk::DescriptorPool pool, vk::DescriptorSetLayout layout, vk::Result& outResult);
+        vk::DescriptorSet AllocateLocked(vk::DescriptorSetLayout layout);
+        void FreeLocked(vk::DescriptorSet set);
+        static uint64_t HashWrites(vk::DescriptorSetLayout layout, const std::vector<BufferWrite>& writes);
+        static bool SameWrites(const std::vector<BufferWrite>& a, const std::vector<BufferWrite>& b);
+        static uint64_t HashBindings(const std::vector<vk::DescriptorSetLayoutBinding>& bindings);
+        static bool SameBindings(const std::vector<vk::DescriptorSetLayoutBinding>& a, const std::vector<vk::DescriptorSetLayoutBinding>& b);
+
+        vk::Device m_device;
+
+        std::vector<Pool> m_pools;
+        std::unordered_map<VkDescriptorSet, size_t> m_setPools;                     // set -> index into m_pools
+        uint32_t m_nextPoolSize = 0;
+
+        std::unordered_multimap<uint64_t, SharedSet> m_sharedSets;                  // content hash -> sets
+        std::unordered_map<VkDescriptorSet, uint64_t> m_sharedSetHashes;            // set -> content hash
+        uint64_t m_sharedSetHits = 0;
+
+        std::unordered_multimap<uint64_t, Layout> m_layouts;                        // bindings hash -> layouts
+
+        PerFrame<FramePools> m_framePools;
+        mutable std::mutex m_mutex;
+    };
+}
@@ -1,8 +1,13 @@
 #include "Framework.h"
+#include "PipelineLibrary.h"
 
 #include <vector>
 #include <cstdarg>
-#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <unordered_set>
 
 #include <VkBootstrap.h>
 
@@ -103,6 +108,7 @@ bool VulkanApp::InitializeVulkan()
     vkb::InstanceBuilder instBuilder;
     auto instResult = instBuilder
         .set_app_name("Vulkan VulkanApp")
+        .require_api_version(1, 1, 0)
         .request_validation_layers()
         .use_default_debug_messenger()
         .build();
@@ -125,20 +131,73 @@ bool VulkanApp::InitializeVulkan()
     vkb::PhysicalDeviceSelector selector(m_vkbInstance);
     auto selectResult = selector
         .set_surface(m_vkWindowSurface)
+        .set_minimum_version(1, 1)
         .set_required_features(deviceFeatures)
+        .add_desired_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+        .add_desired_extension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)
+        .add_desired_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
         .select();
     if (!selectResult)
         return Error("Failed to choose suitable PhysicalDevice.");
 
+    // Bindless resources index a partially bound texture array that is written while bound, only enable
+    // them when the device supports every feature that needs
+
+    vk::PhysicalDevice selectedDevice(selectResult.value().physical_device);
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures;
+    m_bindlessSupported = false;
+    for (auto& extension : selectedDevice.enumerateDeviceExtensionProperties())
+    {
+        if (std::strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0)
+        {
+            auto features = selectedDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+            auto& supported = features.get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+            m_bindlessSupported = supported.runtimeDescriptorArray && supported.descriptorBindingPartiallyBound &&
+                supported.descriptorBindingSampledImageUpdateAfterBind && supported.shaderSampledImageArrayNonUniformIndexing;
+        }
+    }
+    indexingFeatures.runtimeDescriptorArray = m_bindlessSupported;
+    indexingFeatures.descriptorBindingPartiallyBound = m_bindlessSupported;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = m_bindlessSupported;
+    indexingFeatures.shaderSampledImageArrayNonUniformIndexing = m_bindlessSupported;
+
     // Finally, we can create a logical device using the physical device, all our commands will go through the logical device
 
     vkb::DeviceBuilder deviceBuilder(selectResult.value());
+    if (m_bindlessSupported)
+        deviceBuilder.add_pNext(&indexingFeatures);
     auto deviceResult = deviceBuilder.build();
     if (!deviceResult)
         return Error("Failed to create Vulkan device.");
 
     m_vkbDevice = deviceResult.value();
 
+    // Buffers are sub-allocated from a handful of large memory blocks rather than
+    // one vkAllocateMemory per buffer. Desired extensions are enabled whenever the
+    // device supports them, which tells us whether heap budgets can be queried.
+
+    vk::PhysicalDevice physicalDevice(m_vkbDevice.physical_device.physical_device);
+    bool memoryBudgetEnabled = false;
+    bool creationFeedbackEnabled = false;
+    for (auto& extension : physicalDevice.enumerateDeviceExtensionProperties())
+    {
+        if (std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            memoryBudgetEnabled = true;
+        if (std::strcmp(extension.extensionName, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME) == 0)
+            creationFeedbackEnabled = true;
+    }
+
+    if (!m_memoryAllocator.Initialize(physicalDevice, m_vkbDevice.device, memoryBudgetEnabled))
+        return Error("Failed to initialize device memory allocator.");
+
+    m_residencyManager.Initialize(m_memoryAllocator, s_kMaxFramesInFlight);
+
+    // Integrated and software devices share memory with the CPU, so static data can be
+    // written in place. Everything else is staged into device local memory.
+
+    vk::PhysicalDeviceType deviceType = vk::PhysicalDeviceType(m_vkbDevice.physical_device.properties.deviceType);
+    m_unifiedMemory = deviceType == vk::PhysicalDeviceType::eIntegratedGpu || deviceType == vk::PhysicalDeviceType::eCpu;
+
     // Different commands might need to go into different queues, so lets look those up
 
     auto graphicsResult = m_vkbDevice.get_queue(vkb::QueueType::graphics);
@@ -153,6 +212,65 @@ bool VulkanApp::InitializeVulkan()
 
     m_vkPresentQueue = presentResult.value();
 
+    // Uploads go to a queue family of their own when the device has one, so copies run on the
+    // DMA engines instead of occupying the graphics queue. A dedicated transfer family is
+    // preferred, then any other family without graphics support. The device builder creates
+    // one queue in every family, so the queue only needs to be looked up.
+
+    UploadQueue::QueueInfo uploadQueues;
+    uploadQueues.graphicsFamily = m_vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
+
+    auto dedicatedTransferResult = m_vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer);
+    auto separateTransferResult = m_vkbDevice.get_queue_index(vkb::QueueType::transfer);
+    if (dedicatedTransferResult || separateTransferResult)
+    {
+        uploadQueues.transferFamily = dedicatedTransferResult ? dedicatedTransferResult.value() : separateTransferResult.value();
+        m_vkTransferQueue = vk::Device(m_vkbDevice.device).getQueue(uploadQueues.transferFamily, 0);
+        uploadQueues.transferQueue = m_vkTransferQueue;
+    }
+
+    if (!m_uploadQueue.Initialize(m_vkbDevice.device, m_memoryAllocator, s_kMaxFramesInFlight, uploadQueues))
+        return Error("Failed to initialize upload queue.");
+
+    if (!m_defragmenter.Initialize(m_vkbDevice.device, m_memoryAllocator, m_uploadQueue, s_kMaxFramesInFlight))
+        return Error("Failed to initialize buffer defragmenter.");
+
+    // Per-object uniforms are written straight into a mapped buffer, with room for a few thousand objects per frame.
+    // The first megabyte of each frame holds persistent slots for data which is only rewritten when it changes.
+
+    vk::DeviceSize uniformAlignment = m_vkbDevice.physical_device.properties.limits.minUniformBufferOffsetAlignment;
+    if (!m_uniformRing.Initialize(m_vkbDevice.device, m_memoryAllocator, s_kMaxFramesInFlight, 4 * 1024 * 1024, 1024 * 1024, uniformAlignment))
+        return Error("Failed to initialize uniform ring buffer.");
+
+    // Pipelines are compiled through a cache kept on disk, so later runs can skip most shader compilation
+
+    if (!m_pipelineCache.Initialize(m_vkbDevice.device, physicalDevice.getProperties(), s_kPipelineCacheFilename, creationFeedbackEnabled))
+        return Error("Failed to create pipeline cache.");
+
+    // The cache only helps pipelines that are created, the manifest lists which ones earlier runs created
+    // so they can be compiled before the app gets to them
+
+    if (!m_pipelineManifestFilename.empty())
+        m_pipelineManifest.Initialize(m_pipelineManifestFilename);
+
+    // Shader code stays resident once loaded, pipelines using the same shader don't touch the disk again
+
+    if (!m_shaderLibrary.Initialize(m_vkbDevice.device))
+        return Error("Failed to initialize shader library.");
+    m_frameShaderLease = m_shaderLibrary.BeginLease();
+    if (!m_cookedAssetDirectory.empty())
+        m_shaderLibrary.AddSearchPath(m_cookedAssetDirectory);
+
+    // GLSL sources are compiled as they are loaded instead of relying on SPIR-V rebuilt by hand. The code is
+    // cached on disk by source hash, unchanged shaders skip the compiler on later runs.
+
+    if (m_shaderCompiler.Initialize(s_kShaderCacheDirectory))
+    {
+        m_shaderLibrary.SetCompiler(&m_shaderCompiler);
+        if (m_shaderHotReload)
+            m_shaderWatcher.Start(m_shaderCompiler, s_kShaderWatchInterval);
+    }
+
     // Now with basic device setup out of the way we need to finish creating the objects
     // that will allow us to issue rendering commands to the window that will be displayed
 
@@ -167,17 +285,9 @@ bool VulkanApp::InitializeVulkan()
     if (!m_vkGraphicsCommandPool)
         return Error("Failed to create command pool.");
 
-    std::vector<vk::DescriptorPoolSize> descriptorPoolSizes;
-    descriptorPoolSizes.emplace_back(vk::DescriptorType::eUniformBuffer, 128);
-
-    vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo;
-    descriptorPoolCreateInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
-    descriptorPoolCreateInfo.maxSets = 256;
-    descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());
-    descriptorPoolCreateInfo.pPoolSizes = descriptorPoolSizes.data();
-    m_vkDescriptorPool = device.createDescriptorPool(descriptorPoolCreateInfo);
-    if (!m_vkDescriptorPool)
-        return Error("Failed to create descriptor pool.");
+    // Pools are chained as sets run out, the object count is bounded by memory rather than a pool size
+    if (!m_descriptorAllocator.Initialize(device))
+        return Error("Failed to initialize descriptor allocator.");
 
     // The objects that handle drawing into the window are dependent upon the swap chain, so lets create those
     // The swap chain and related objects must be recreated when the window is resized, as some dependent
@@ -189,7 +299,7 @@ bool VulkanApp::InitializeVulkan()
     // Finally, we need to allocate some synchronization objects to keep our commands ordered, especially
     // since the GPU will execute things at a different rate than the CPU
 
-    m_frames.resize(2); // we'll only allow the CPU to have two frames of rendering commands in progress
+    // we'll only allow the CPU to have two frames of rendering commands in progress
     m_currentFrameIndex = 0;
     for (auto& frameData : m_frames)
     {
@@ -221,8 +331,22 @@ void VulkanApp::ShutdownVulkan()
     if (device)
     {
         device.waitIdle();
-
-        OnDeviceLost();
+        m_shaderWatcher.Stop();
+        WaitForPipelineCompiler();
+        DiscardPipelineSwaps();
+        m_warmPipelines.clear();
+        m_warmScenePipelines.clear();
+
+        m_deletionQueue.FlushAll();
+        if (m_deviceReady)
+        {
+            OnSwapchainLost();
+            OnDeviceLost();
+            m_deviceReady = false;
+        }
+        m_deletionQueue.FlushAll();
+        m_pPipelineLibrary.reset();
+        m_pPipelineCompiler.reset();
 
         for (auto& frame : m_frames)
         {
@@ -233,7 +357,7 @@ void VulkanApp::ShutdownVulkan()
             if (frame.fenceInFlight)
                 device.destroyFence(frame.fenceInFlight);
         }
-        m_frames.clear();
+        m_frames = PerFrame<FrameData>();
 
         if (m_vkWindowRenderPass)
         {
@@ -246,12 +370,28 @@ void VulkanApp::ShutdownVulkan()
 
     if (device)
     {
-        if (m_vkDescriptorPool)
-            device.destroyDescriptorPool(m_vkDescriptorPool);
+        DestroySceneLayout();
+        DestroyBindlessTable();
+        if (m_pipelineCache.Get())
+        {
+            LogPipelineCacheStats();
+            m_pipelineCache.Shutdown();
+        }
+        m_pipelineManifest.Shutdown();
+        m_shaderLibrary.Shutdown();
+        m_shaderCompiler.Shutdown();
+        m_descriptorAllocator.Shutdown();
         if (m_vkGraphicsCommandPool)
             device.destroyCommandPool(m_vkGraphicsCommandPool);
     }
 
+    m_residencyManager.Shutdown();
+    m_uniformRing.Shutdown();
+    m_defragmenter.Shutdown();
+    m_uploadQueue.Shutdown();
+    m_memoryAllocator.Shutdown();
+
+    m_vkTransferQueue = nullptr;
     m_vkPresentQueue = nullptr;
     m_vkGraphicsQueue = nullptr;
 
@@ -270,55 +410,49 @@ bool VulkanApp::RebuildSwapchain()
     vk::Device device(m_vkbDevice.device);
     device.waitIdle();
 
-    OnDeviceLost();
+    // Only resources sized to the window are rebuilt, pipelines and buffers survive a resize
+
+    m_deletionQueue.FlushAll();
+    if (m_deviceReady)
+        OnSwapchainLost();
+    m_deletionQueue.FlushAll();
 
     DestroyFramebuffers();
 
+    vkb::Swapchain oldSwapchain = m_vkbSwapchain;
+
     vkb::SwapchainBuilder swapchainBuilder(m_vkbDevice);
     auto swapchainResult = swapchainBuilder
-        .set_old_swapchain(m_vkbSwapchain)
+        .set_old_swapchain(oldSwapchain)
         .build();
     if (!swapchainResult)
         return Error("Failed to build swapchain.");
 
     m_vkbSwapchain = swapchainResult.value();
+    vkb::destroy_swapchain(oldSwapchain);
 
-    // Rebuild window render pass?
-
-    vk::AttachmentDescription colorAttachment;
-    colorAttachment.format = vk::Format(m_vkbSwapchain.image_format);
-    colorAttachment.samples = vk::SampleCountFlagBits::e1;
-    colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
-    colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
-    colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
-
-    vk::AttachmentReference colorAttachmentRef;
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = vk::ImageLayout::eColorAttachmentOptimal;
+    // Pipelines are only compatible with render passes using the same attachment formats, should the
+    // surface format ever change every device resource has to be recreated along with the render pass
 
-    vk::SubpassDescription subpass;
-    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
+    if (m_vkWindowRenderPass && vk::Format(m_vkbSwapchain.image_format) != m_vkWindowFormat)
+    {
+        if (m_deviceReady)
+        {
+            WaitForPipelineCompiler();
+            DiscardPipelineSwaps();
+            m_warmPipelines.clear();
+            m_warmScenePipelines.clear();
+            OnDeviceLost();
+            m_deletionQueue.FlushAll();
+            m_deviceReady = false;
+        }
 
-    vk::SubpassDependency subpassDep;
-    subpassDep.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDep.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    subpassDep.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    subpassDep.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+        device.destroyRenderPass(m_vkWindowRenderPass);
+        m_vkWindowRenderPass = nullptr;
+    }
 
-    vk::RenderPassCreateInfo renderpassCreateInfo;
-    renderpassCreateInfo.attachmentCount = 1;
-    renderpassCreateInfo.pAttachments = &colorAttachment;
-    renderpassCreateInfo.subpassCount = 1;
-    renderpassCreateInfo.pSubpasses = &subpass;
-    renderpassCreateInfo.dependencyCount = 1;
-    renderpassCreateInfo.pDependencies = &subpassDep;
-    m_vkWindowRenderPass = device.createRenderPass(renderpassCreateInfo);
-    if (!m_vkWindowRenderPass)
-        return Error("Failed to create default render pass.");
+    if (!m_vkWindowRenderPass && !CreateWindowRenderPass())
+        return false;
 
     auto imageViews = m_vkbSwapchain.get_image_views().value();
     if (imageViews.empty())
@@ -355,7 +489,60 @@ bool VulkanApp::RebuildSwapchain()
 
     m_targetFramebufferIndex = 0;
 
-    return OnDeviceReady();
+    if (!m_deviceReady)
+    {
+        // Scene layout pipelines follow once the app has created the layout in OnDeviceReady
+        WarmUpPipelines(false);
+        if (!OnDeviceReady())
+            return false;
+        m_deviceReady = true;
+    }
+
+    return OnSwapchainReady();
+}
+
+bool VulkanApp::CreateWindowRenderPass()
+{
+    vk::Device device(m_vkbDevice.device);
+
+    m_vkWindowFormat = vk::Format(m_vkbSwapchain.image_format);
+
+    vk::AttachmentDescription colorAttachment;
+    colorAttachment.format = m_vkWindowFormat;
+    colorAttachment.samples = vk::SampleCountFlagBits::e1;
+    colorAttachment.loadOp = vk::AttachmentLoadOp::eClear;
+    colorAttachment.storeOp = vk::AttachmentStoreOp::eStore;
+    colorAttachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+    colorAttachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+
+    vk::AttachmentReference colorAttachmentRef;
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = vk::ImageLayout::eColorAttachmentOptimal;
+
+    vk::SubpassDescription subpass;
+    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    vk::SubpassDependency subpassDep;
+    subpassDep.srcSubpass = VK_SUBPASS_EXTERNAL;
+    subpassDep.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    subpassDep.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+    subpassDep.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+
+    vk::RenderPassCreateInfo renderpassCreateInfo;
+    renderpassCreateInfo.attachmentCount = 1;
+    renderpassCreateInfo.pAttachments = &colorAttachment;
+    renderpassCreateInfo.subpassCount = 1;
+    renderpassCreateInfo.pSubpasses = &subpass;
+    renderpassCreateInfo.dependencyCount = 1;
+    renderpassCreateInfo.pDependencies = &subpassDep;
+    m_vkWindowRenderPass = device.createRenderPass(renderpassCreateInfo);
+    if (!m_vkWindowRenderPass)
+        return Error("Failed to create default render pass.");
+
+    return true;
 }
 
 void VulkanApp::DestroyFramebuffers()
@@ -387,11 +574,31 @@ void VulkanApp::RenderFrame()
 {
     auto device = GetDevice();
 
-    auto& currentFrame = m_frames[m_currentFrameIndex];
+    auto& currentFrame = m_frames[static_cast<uint32_t>(m_currentFrameIndex)];
 
     // Wait for our the frame to complete before we start changing it
     device.waitForFences(1, &currentFrame.fenceInFlight, true, UINT64_MAX);
 
+    // Frames are submitted in order, so every frame up to the last user of this slot has completed
+    if (m_frameNumber >= s_kMaxFramesInFlight)
+        m_deletionQueue.Flush(m_frameNumber - s_kMaxFramesInFlight);
+
+    m_uploadQueue.BeginFrame(static_cast<uint32_t>(m_currentFrameIndex));
+    m_uniformRing.BeginFrame(static_cast<uint32_t>(m_currentFrameIndex));
+    m_descriptorAllocator.BeginFrame(static_cast<uint32_t>(m_currentFrameIndex));
+    m_defragmenter.BeginFrame(static_cast<uint32_t>(m_currentFrameIndex));
+    m_residencyManager.Update(m_frameNumber);
+
+    // Pipelines rebuilt after shaders were edited replace the old ones here, before anything is recorded
+    ReloadChangedShaders();
+
+    // Pipelines created since the last save are written out every so often, not just at shutdown
+    if (m_frameNumber > 0 && m_frameNumber % s_kPipelineCacheSaveInterval == 0)
+    {
+        m_pipelineCache.SaveIfChanged();
+        m_pipelineManifest.SaveIfChanged();
+    }
+
     // get next image to render into
     uint32_t imageIndex = 0;
     auto acquireResult = device.acquireNextImageKHR(m_vkbSwapchain.swapchain, UINT64_MAX,
@@ -411,6 +618,10 @@ void VulkanApp::RenderFrame()
 
     vk::CommandBufferBeginInfo commandBufferBeginInfo;
     commandBuffer.begin(&commandBufferBeginInfo);
+    // Moves go first so that uploads and draws recorded afterwards use the new buffers
+    m_defragmenter.Record(commandBuffer, static_cast<uint32_t>(m_currentFrameIndex));
+    vk::PipelineStageFlags uploadWaitStages;
+    vk::Semaphore uploadSemaphore = m_uploadQueue.Record(commandBuffer, static_cast<uint32_t>(m_currentFrameIndex), uploadWaitStages);
     OnPreRender(commandBuffer);
     BeginWindowRenderPass(commandBuffer);
     OnRender(commandBuffer);
@@ -421,13 +632,16 @@ void VulkanApp::RenderFrame()
     // Submit
     //
 
+    // Uploads submitted to the transfer queue this frame only hold up the stages reading them
     vk::Semaphore waitSemaphores[] =
     {
         currentFrame.semaphoreImageAvailable,
+        uploadSemaphore,
     };
     vk::PipelineStageFlags waitFlags[] =
     {
         vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        uploadWaitStages,
     };
     vk::Semaphore signalSemaphores[] =
     {
@@ -436,7 +650,7 @@ void VulkanApp::RenderFrame()
 
     vk::SubmitInfo submitInfo;
     submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = uploadSemaphore ? 2 : 1;
     submitInfo.pWaitDstStageMask = waitFlags;
     submitInfo.pSignalSemaphores = signalSemaphores;
     submitInfo.signalSemaphoreCount = 1;
@@ -462,14 +676,14 @@ void VulkanApp::RenderFrame()
     presentInfo.pSwapchains = swapchains;
     presentInfo.pImageIndices = &imageIndex;
 
-    auto presentResult = m_vkPresentQueue.presentKHR(presentInfo);
-    if (presentResult == vk::Result::eErrorOutOfDateKHR)
-    {
-        RebuildSwapchain();
-        return;
-    }
+    // The frame has been submitted either way, it still counts when the swapchain needs rebuilding
+    auto presentResult = m_vkPresentQueue.presentKHR(&presentInfo);
 
     m_currentFrameIndex = (m_currentFrameIndex + 1) % m_frames.size();
+    m_frameNumber += 1;
+
+    if (presentResult == vk::Result::eErrorOutOfDateKHR || presentResult == vk::Result::eSuboptimalKHR)
+        RebuildSwapchain();
 }
 
 void VulkanApp::BeginWindowRenderPass(vk::CommandBuffer& cb)
@@ -520,6 +734,35 @@ int32_t VulkanApp::FindMemoryTypeIndex(vk::MemoryRequirements requirements, vk::
 
 bool VulkanApp::CreatePipeline(const PipelineDescription& desc, PipelineObjects& obj)
 {
+    if (!PreparePipeline(desc, obj))
+        return false;
+
+    if (!CompilePipeline(desc, obj))
+        return Error("Failed to create graphics pipeline.");
+
+    return true;
+}
+
+bool VulkanApp::PreparePipeline(const PipelineDescription& desc, PipelineObjects& obj)
+{
+    if (desc.useSceneLayout)
+    {
+        if (!m_sceneLayout.pipelineLayout)
+            return Error("Pipeline uses the scene layout before CreateSceneLayout was called.");
+
+        // The descriptor sets are owned by the app and bound by update frequency
+        obj.pipelineLayout = m_sceneLayout.pipelineLayout;
+        obj.sharedLayout = true;
+        obj.pushConstantRanges = m_sceneLayout.pushConstantRanges;
+        return true;
+    }
+
+    return CreatePipelineDescriptors(desc, obj);
+}
+
+bool VulkanApp::CompilePipeline(const PipelineDescription& desc, PipelineObjects& obj)
+{
+    // May run on a pipeline compiler thread, only thread safe state is touched and errors aren't reported here
     auto device = GetDevice();
 
     vk::GraphicsPipelineCreateInfo pipelineInfo;
@@ -563,123 +806,72 @@ bool VulkanApp::CreatePipeline(const PipelineDescription& desc, PipelineObjects&
 
     /// Uniform Inputs (descriptors) ///
 
-    std::vector<vk::DescriptorSetLayoutBinding> descriptorSetBindings;
-    descriptorSetBindings.reserve(desc.uniformBuffers.size() + desc.uniformImages.size());
-
-    for (auto& uniformBuffer : desc.uniformBuffers)
-    {
-        vk::DescriptorSetLayoutBinding binding;
-        binding.binding = uniformBuffer.binding;
-        binding.descriptorType = vk::DescriptorType::eUniformBuffer;
-        binding.descriptorCount = 1;
-        binding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
-        descriptorSetBindings.emplace_back(binding);
-    }
-
-    for (auto& uniformImage : desc.uniformImages)
-    {
-        vk::DescriptorSetLayoutBinding binding;
-        binding.binding = uniformImage.binding;
-        binding.descriptorType = vk::DescriptorType::eSampler;
-        binding.descriptorCount = 1;
-        binding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
-        descriptorSetBindings.emplace_back(binding);
-    }
-
-    vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutInfo;
-    descriptorSetLayoutInfo.pBindings = descriptorSetBindings.data();
-    descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(descriptorSetBindings.size());
-    obj.descriptorSetLayout = device.createDescriptorSetLayout(descriptorSetLayoutInfo);
-    if (!obj.descriptorSetLayout)
-        return Error("Failed to create descriptor set layout.");
-
-    vk::PipelineLayoutCreateInfo layoutInfo;
-    layoutInfo.pSetLayouts = &obj.descriptorSetLayout;
-    layoutInfo.setLayoutCount = 1;
-
-    pipelineInfo.layout = obj.pipelineLayout = device.createPipelineLayout(layoutInfo);
-    if (!obj.pipelineLayout)
-        return Error("Failed to create pipeline layout.");
-
-    // Create buffers and associate with the descriptor set
-
-    vk::DescriptorSetAllocateInfo descriptorSetAllocInfo;
-    descriptorSetAllocInfo.descriptorPool = m_vkDescriptorPool;
-    descriptorSetAllocInfo.descriptorSetCount = 1;
-    descriptorSetAllocInfo.pSetLayouts = &obj.descriptorSetLayout;
-    auto descriptorSets = device.allocateDescriptorSets(descriptorSetAllocInfo);
-    if (descriptorSets.empty())
-        return Error("Failed to allocate descriptor set.");
-    obj.descriptorSet = descriptorSets[0];
-
-    for (auto& bufferDesc : desc.uniformBuffers)
-    {
-        obj.uniformBuffers.push_back({});
-        PipelineObjects::UniformBuffer& bufferObjects = obj.uniformBuffers.back();
-        bufferObjects.binding = bufferDesc.binding;
-
-        vk::BufferCreateInfo bufferInfo;
-        bufferInfo.size = bufferDesc.byteSize;
-        bufferInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer |
-            vk::BufferUsageFlagBits::eTransferDst; // TransferDst means we can copy data TO the buffer
-        bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-        
-        bufferObjects.buffer = device.createBuffer(bufferInfo);
-        if (!bufferObjects.buffer)
-            return Error("Failed to create uniform buffer.");
-
-        auto bufferMemoryReq = device.getBufferMemoryRequirements(bufferObjects.buffer);
-
-        vk::MemoryPropertyFlags bufferMemoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
-
-        vk::MemoryAllocateInfo bufferAllocInfo;
-        bufferAllocInfo.allocationSize = bufferMemoryReq.size;
-        bufferAllocInfo.memoryTypeIndex = FindMemoryTypeIndex(bufferMemoryReq, bufferMemoryFlags);
-        bufferObjects.bufferMemory = device.allocateMemory(bufferAllocInfo);
-        if (!bufferObjects.bufferMemory)
-            return Error("Failed to allocate memory for uniform buffer.");
-
-        device.bindBufferMemory(bufferObjects.buffer, bufferObjects.bufferMemory, 0);
-
-        vk::WriteDescriptorSet update;
-        update.dstSet = obj.descriptorSet;
-        update.dstBinding = bufferObjects.binding;
-        update.dstArrayElement = 0;
-        update.descriptorCount = 1;
-        update.descriptorType = vk::DescriptorType::eUniformBuffer;
-
-        vk::DescriptorBufferInfo descriptorBufferInfo;
-        descriptorBufferInfo.buffer = bufferObjects.buffer;
-        descriptorBufferInfo.offset = 0;
-        descriptorBufferInfo.range = bufferDesc.byteSize;
-        update.pBufferInfo = &descriptorBufferInfo;
-
-        device.updateDescriptorSets({ update }, {});
-    }
+    // Created by PreparePipeline on the thread which asked for the pipeline
+    pipelineInfo.layout = obj.pipelineLayout;
 
     /// Shaders ///
 
+    // A reload on another thread can't destroy the modules before the pipeline is created from them
+    ShaderLibrary::Lease shaderLease = m_shaderLibrary.BeginLease();
+
     std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+    std::vector<const std::string*> shaderFilenames;
 
     vk::PipelineShaderStageCreateInfo vertexShaderStage;
     vertexShaderStage.stage = vk::ShaderStageFlagBits::eVertex;
-    vertexShaderStage.module = LoadShaderModule(desc.vertexShaderFilename.c_str());
+    vertexShaderStage.module = m_shaderLibrary.GetModule(desc.vertexShaderFilename);
     vertexShaderStage.pName = "main";
     shaderStages.emplace_back(vertexShaderStage);
+    shaderFilenames.emplace_back(&desc.vertexShaderFilename);
 
     vk::PipelineShaderStageCreateInfo fragmentShaderStage;
     fragmentShaderStage.stage = vk::ShaderStageFlagBits::eFragment;
-    fragmentShaderStage.module = LoadShaderModule(desc.fragmentShaderFilename.c_str());
+    fragmentShaderStage.module = m_shaderLibrary.GetModule(desc.fragmentShaderFilename);
     fragmentShaderStage.pName = "main";
     shaderStages.emplace_back(fragmentShaderStage);
+    shaderFilenames.emplace_back(&desc.fragmentShaderFilename);
 
     if (!desc.geometryShaderFilename.empty())
     {
         vk::PipelineShaderStageCreateInfo geometryShaderStage;
         geometryShaderStage.stage = vk::ShaderStageFlagBits::eGeometry;
-        geometryShaderStage.module = LoadShaderModule(desc.geometryShaderFilename.c_str());
+        geometryShaderStage.module = m_shaderLibrary.GetModule(desc.geometryShaderFilename);
         geometryShaderStage.pName = "main";
         shaderStages.emplace_back(geometryShaderStage);
+        shaderFilenames.emplace_back(&desc.geometryShaderFilename);
+    }
+
+    for (auto& shaderStage : shaderStages)
+    {
+        if (!shaderStage.module)
+            return false;
+    }
+
+    // Every stage reads the values from the same block, but only maps the constants it declares
+
+    std::vector<uint32_t> specializationData;
+    for (auto& constant : desc.specializationConstants)
+        specializationData.emplace_back(constant.value);
+
+    std::vector<std::vector<vk::SpecializationMapEntry>> specializationEntries(shaderStages.size());
+    std::vector<vk::SpecializationInfo> specializationInfos(shaderStages.size());
+    for (size_t stage = 0; stage < shaderStages.size(); ++stage)
+    {
+        for (size_t i = 0; i < desc.specializationConstants.size(); ++i)
+        {
+            uint32_t constantId = 0;
+            if (m_shaderLibrary.FindSpecializationConstant(*shaderFilenames[stage], desc.specializationConstants[i].name, constantId))
+                specializationEntries[stage].emplace_back(constantId, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t));
+        }
+
+        if (specializationEntries[stage].empty())
+            continue;
+
+        specializationInfos[stage].mapEntryCount = static_cast<uint32_t>(specializationEntries[stage].size());
+        specializationInfos[stage].pMapEntries = specializationEntries[stage].data();
+        specializationInfos[stage].dataSize = specializationData.size() * sizeof(uint32_t);
+        specializationInfos[stage].pData = specializationData.data();
+        shaderStages[stage].pSpecializationInfo = &specializationInfos[stage];
     }
 
     pipelineInfo.pStages = shaderStages.data();
@@ -702,18 +894,17 @@ bool VulkanApp::CreatePipeline(const PipelineDescription& desc, PipelineObjects&
     
     pipelineInfo.renderPass = GetWindowRenderPass();
 
+    // Viewport and scissor are set when the window render pass begins, so pipelines outlive a resize
     vk::PipelineViewportStateCreateInfo viewportInfo;
-    pipelineInfo.pViewportState = &viewportInfo;
-
-    vk::Viewport viewport = GetViewport();
     viewportInfo.viewportCount = 1;
-    viewportInfo.pViewports = &viewport;
-
-    vk::Rect2D scissor;
-    scissor.extent.setWidth(static_cast<uint32_t>(viewport.width));
-    scissor.extent.setHeight(static_cast<uint32_t>(viewport.height));
     viewportInfo.scissorCount = 1;
-    viewportInfo.pScissors = &scissor;
+    pipelineInfo.pViewportState = &viewportInfo;
+
+    vk::DynamicState dynamicStates[] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    vk::PipelineDynamicStateCreateInfo dynamicStateInfo;
+    dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(std::size(dynamicStates));
+    dynamicStateInfo.pDynamicStates = dynamicStates;
+    pipelineInfo.pDynamicState = &dynamicStateInfo;
 
     vk::PipelineColorBlendAttachmentState colorBlendAttachment;
     colorBlendAttachment.colorWriteMask =
@@ -721,6 +912,16 @@ bool VulkanApp::CreatePipeline(const PipelineDescription& desc, PipelineObjects&
         vk::ColorComponentFlagBits::eR |
         vk::ColorComponentFlagBits::eG |
         vk::ColorComponentFlagBits::eB;
+    if (desc.alphaBlend)
+    {
+        colorBlendAttachment.blendEnable = true;
+        colorBlendAttachment.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+        colorBlendAttachment.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+        colorBlendAttachment.colorBlendOp = vk::BlendOp::eAdd;
+        colorBlendAttachment.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+        colorBlendAttachment.dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+        colorBlendAttachment.alphaBlendOp = vk::BlendOp::eAdd;
+    }
 
     vk::PipelineColorBlendStateCreateInfo blendInfo;
     blendInfo.logicOp = vk::LogicOp::eCopy;
@@ -728,145 +929,751 @@ bool VulkanApp::CreatePipeline(const PipelineDescription& desc, PipelineObjects&
     blendInfo.pAttachments = &colorBlendAttachment;
     pipelineInfo.pColorBlendState = &blendInfo;
 
+    // The driver reports through creation feedback whether the pipeline came out of the cache
+
+    vk::PipelineCreationFeedbackEXT creationFeedback;
+    std::vector<vk::PipelineCreationFeedbackEXT> stageFeedbacks(shaderStages.size());
+    vk::PipelineCreationFeedbackCreateInfoEXT feedbackInfo;
+    if (m_pipelineCache.IsFeedbackEnabled())
+    {
+        feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+        feedbackInfo.pipelineStageCreationFeedbackCount = static_cast<uint32_t>(stageFeedbacks.size());
+        feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks.data();
+        pipelineInfo.pNext = &feedbackInfo;
+    }
+
     // Create vulkan object
 
-    obj.pipeline = device.createGraphicsPipeline(nullptr, pipelineInfo).value;
+    auto createStart = std::chrono::steady_clock::now();
+    obj.pipeline = device.createGraphicsPipeline(m_pipelineCache.Get(), pipelineInfo).value;
+    std::chrono::duration<double, std::milli> createTime = std::chrono::steady_clock::now() - createStart;
     if (!obj.pipeline)
-        return Error("Failed to create graphics pipeline.");
+        return false;
 
-    // Now that the pipeline has been created we do not need to hold on to our shader modules
-    for (auto& shaderStage : shaderStages)
-    {
-        if (shaderStage.module)
-            device.destroyShaderModule(shaderStage.module);
-    }
+    m_pipelineCache.RecordCreation(creationFeedback, createTime.count());
 
     return true;
 }
 
-void VulkanApp::DestroyPipeline(PipelineObjects& obj)
+bool VulkanApp::CreatePipelineDescriptors(const PipelineDescription& desc, PipelineObjects& obj)
 {
     auto device = GetDevice();
 
-    for (auto& uniformBuffer : obj.uniformBuffers)
+    std::vector<vk::DescriptorSetLayoutBinding> descriptorSetBindings;
+    descriptorSetBindings.reserve(desc.uniformBuffers.size() + desc.uniformImages.size());
+
+    for (auto& uniformBuffer : desc.uniformBuffers)
     {
-        if (uniformBuffer.buffer)       device.destroyBuffer(uniformBuffer.buffer);
-        if (uniformBuffer.bufferMemory) device.freeMemory(uniformBuffer.bufferMemory);
+        vk::DescriptorSetLayoutBinding binding;
+        binding.binding = uniformBuffer.binding;
+        binding.descriptorType = uniformBuffer.dynamic ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eUniformBuffer;
+        binding.descriptorCount = 1;
+        binding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
+        descriptorSetBindings.emplace_back(binding);
     }
 
-    if (obj.descriptorSet)       device.freeDescriptorSets(m_vkDescriptorPool, 1, &obj.descriptorSet);
-    if (obj.descriptorSetLayout) device.destroyDescriptorSetLayout(obj.descriptorSetLayout);
-    if (obj.pipelineLayout)      device.destroyPipelineLayout(obj.pipelineLayout);
-    if (obj.pipeline)            device.destroyPipeline(obj.pipeline);
-}
+    for (auto& uniformImage : desc.uniformImages)
+    {
+        vk::DescriptorSetLayoutBinding binding;
+        binding.binding = uniformImage.binding;
+        binding.descriptorType = vk::DescriptorType::eSampler;
+        binding.descriptorCount = 1;
+        binding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
+        descriptorSetBindings.emplace_back(binding);
+    }
 
-bool VulkanApp::CreateVertexBuffer(const void* pData, vk::DeviceSize dataSize, vk::Buffer& buffer, vk::DeviceMemory& memory)
-{
-    auto device = GetDevice();
+    // Layouts are shared by every pipeline with the same bindings and owned by the allocator
+    obj.descriptorSetLayout = m_descriptorAllocator.GetLayout(descriptorSetBindings);
+    if (!obj.descriptorSetLayout)
+        return Error("Failed to create descriptor set layout.");
 
-    vk::BufferCreateInfo bufferInfo;
-    bufferInfo.size = dataSize;
-    bufferInfo.usage = vk::BufferUsageFlagBits::eVertexBuffer;
-    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-    
-    buffer = device.createBuffer(bufferInfo);
-    if (!buffer)
-        return Error("Failed to create vertex buffer.");
+    uint32_t maxPushConstantsSize = m_vkbDevice.physical_device.properties.limits.maxPushConstantsSize;
+    for (auto& pushConstant : desc.pushConstants)
+    {
+        if (pushConstant.offset + pushConstant.byteSize > maxPushConstantsSize)
+            return Error("Push constants end at %u bytes, the device supports %u.", pushConstant.offset + pushConstant.byteSize, maxPushConstantsSize);
+        obj.pushConstantRanges.emplace_back(pushConstant.stages, pushConstant.offset, pushConstant.byteSize);
+    }
 
-    auto bufferMemoryReq = device.getBufferMemoryRequirements(buffer);
+    vk::PipelineLayoutCreateInfo layoutInfo;
+    layoutInfo.pSetLayouts = &obj.descriptorSetLayout;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pPushConstantRanges = obj.pushConstantRanges.data();
+    layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(obj.pushConstantRanges.size());
+
+    obj.pipelineLayout = device.createPipelineLayout(layoutInfo);
+    if (!obj.pipelineLayout)
+        return Error("Failed to create pipeline layout.");
 
-    vk::MemoryPropertyFlags bufferMemoryFlags = vk::MemoryPropertyFlagBits::eHostVisible;
+    // Create buffers and associate with the descriptor sets, every frame in flight gets its own
+    // copy of each buffer so the CPU never writes data a frame in flight reads
 
-    vk::MemoryAllocateInfo bufferAllocInfo;
-    bufferAllocInfo.allocationSize = bufferMemoryReq.size;
-    bufferAllocInfo.memoryTypeIndex = FindMemoryTypeIndex(bufferMemoryReq, bufferMemoryFlags);
-    memory = device.allocateMemory(bufferAllocInfo);
-    if (!memory)
-        return Error("Failed to allocate memory for vertex buffer.");
+    bool ownsBuffers = false;
+    for (auto& bufferDesc : desc.uniformBuffers)
+    {
+        if (bufferDesc.dynamic)
+            continue;
 
-    device.bindBufferMemory(buffer, memory, 0);
+        obj.uniformBuffers.push_back({});
+        obj.uniformBuffers.back().binding = bufferDesc.binding;
+        obj.uniformBuffers.back().size = bufferDesc.byteSize;
+        ownsBuffers = true;
+    }
+
+    for (uint32_t frameIndex = 0; frameIndex < s_kMaxFramesInFlight; ++frameIndex)
+    {
+        std::vector<DescriptorAllocator::BufferWrite> writes;
+        writes.reserve(desc.uniformBuffers.size());
 
-    // Upload
-    void* pBufferData = device.mapMemory(memory, 0, bufferInfo.size);
-    memcpy(pBufferData, pData, bufferInfo.size);
-    vk::MappedMemoryRange mappedRange;
-    mappedRange.memory = memory;
-    mappedRange.offset = 0;
-    mappedRange.size = VK_WHOLE_SIZE;
-    device.flushMappedMemoryRanges(mappedRange);
-    device.unmapMemory(memory);
+        auto ownedBuffer = obj.uniformBuffers.begin();
+        for (auto& bufferDesc : desc.uniformBuffers)
+        {
+            DescriptorAllocator::BufferWrite write;
+            write.binding = bufferDesc.binding;
+            write.type = bufferDesc.dynamic ? vk::DescriptorType::eUniformBufferDynamic : vk::DescriptorType::eUniformBuffer;
+            write.range = bufferDesc.byteSize;
+
+            if (bufferDesc.dynamic)
+            {
+                // Dynamic bindings all read from the uniform ring, the offset is chosen at bind time
+                write.buffer = m_uniformRing.GetBuffer();
+            }
+            else
+            {
+                // Written through a mapping by UpdateUniformBuffer, TransferDst still allows updateBuffer
+                auto& copy = (ownedBuffer++)->copies[frameIndex];
+                if (!CreateBuffer(bufferDesc.byteSize, vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                    vk::MemoryPropertyFlagBits::eHostVisible, vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostCoherent,
+                    MemoryCategory::eUniforms, copy.buffer, copy.allocation))
+                    return Error("Failed to create uniform buffer.");
+
+                write.buffer = copy.buffer;
+            }
+            writes.push_back(write);
+        }
+
+        if (!ownsBuffers)
+        {
+            // Nothing in the set belongs to this pipeline, so every frame and every pipeline with the
+            // same layout can bind the same set
+            obj.descriptorSets[frameIndex] = m_descriptorAllocator.AcquireShared(obj.descriptorSetLayout, writes);
+            if (!obj.descriptorSets[frameIndex])
+                return Error("Failed to allocate descriptor set.");
+            continue;
+        }
+
+        obj.descriptorSets[frameIndex] = m_descriptorAllocator.Allocate(obj.descriptorSetLayout);
+        if (!obj.descriptorSets[frameIndex])
+            return Error("Failed to allocate descriptor set.");
+
+        std::vector<vk::DescriptorBufferInfo> descriptorBufferInfos(writes.size());
+        std::vector<vk::WriteDescriptorSet> updates(writes.size());
+        for (size_t i = 0; i < writes.size(); ++i)
+        {
+            descriptorBufferInfos[i].buffer = writes[i].buffer;
+            descriptorBufferInfos[i].offset = writes[i].offset;
+            descriptorBufferInfos[i].range = writes[i].range;
+
+            updates[i].dstSet = obj.descriptorSets[frameIndex];
+            updates[i].dstBinding = writes[i].binding;
+            updates[i].dstArrayElement = 0;
+            updates[i].descriptorCount = 1;
+            updates[i].descriptorType = writes[i].type;
+            updates[i].pBufferInfo = &descriptorBufferInfos[i];
+        }
+        device.updateDescriptorSets(updates, {});
+    }
 
     return true;
 }
 
-bool VulkanApp::CreateIndexBuffer(const std::vector<uint32_t>& indicies, vk::Buffer& buffer, vk::DeviceMemory& memory)
+std::shared_ptr<PipelineObjects> VulkanApp::AcquirePipeline(const PipelineDescription& desc)
+{
+    RecordPipeline(desc);
+    auto pPipeline = GetPipelineLibrary().Acquire(desc);
+    if (!pPipeline)
+        Error("Failed to acquire pipeline.");
+    return pPipeline;
+}
+
+std::vector<std::shared_future<std::shared_ptr<PipelineObjects>>> VulkanApp::AcquirePipelines(const std::vector<PipelineDescription>& descs)
+{
+    // Compiler threads are only started once something asks for them
+    if (!m_pPipelineCompiler)
+        m_pPipelineCompiler = std::make_unique<ThreadPool>();
+
+    std::vector<std::shared_future<std::shared_ptr<PipelineObjects>>> pipelines;
+    pipelines.reserve(descs.size());
+    for (const auto& desc : descs)
+    {
+        RecordPipeline(desc);
+        pipelines.emplace_back(GetPipelineLibrary().AcquireAsync(desc, *m_pPipelineCompiler));
+    }
+    return pipelines;
+}
+
+bool VulkanApp::AcquirePipelineAsync(const PipelineDescription& desc, AsyncPipeline& outPipeline)
+{
+    if (!m_pPipelineCompiler)
+        m_pPipelineCompiler = std::make_unique<ThreadPool>();
+
+    // The library only locks around its bookkeeping, a compile in flight on any thread doesn't hold this up
+    RecordPipeline(desc);
+    auto pending = GetPipelineLibrary().AcquirePending(desc, *m_pPipelineCompiler);
+    if (!pending.pipeline)
+        return Error("Failed to acquire pipeline.");
+
+    outPipeline = AsyncPipeline();
+    outPipeline.specialized = std::move(pending.pipeline);
+    outPipeline.compiled = std::move(pending.compiled);
+
+    // Already compiled, by an earlier request or on the spot, no fallback needed
+    if (!outPipeline.compiled.valid() ||
+        (outPipeline.compiled.wait_for(std::chrono::seconds(0)) == std::future_status::ready && outPipeline.compiled.get()))
+    {
+        outPipeline.compiled = std::shared_future<bool>();
+        return true;
+    }
+
+    outPipeline.fallback = AcquirePipeline(MakeFallbackDescription(desc));
+    return outPipeline.fallback != nullptr;
+}
+
+PipelineDescription VulkanApp::MakeFallbackDescription(const PipelineDescription& desc)
+{
+    PipelineDescription fallback = desc;
+    fallback.specializationConstants = { { PipelineDescription::s_kUbershaderConstant, 1 } };
+    return fallback;
+}
+
+PipelineLibrary& VulkanApp::GetPipelineLibrary()
+{
+    if (!m_pPipelineLibrary)
+    {
+        m_pPipelineLibrary = std::make_shared<PipelineLibrary>(
+            [this](const PipelineDescription& pipelineDesc, PipelineObjects& obj) { return PreparePipeline(pipelineDesc, obj); },
+            [this](const PipelineDescription& pipelineDesc, PipelineObjects& obj) { return CompilePipeline(pipelineDesc, obj); },
+            [this](PipelineObjects& obj) { DeferDestroyPipeline(obj); });
+    }
+    return *m_pPipelineLibrary;
+}
+
+void VulkanApp::WaitForPipelineCompiler()
+{
+    if (m_pPipelineCompiler)
+        m_pPipelineCompiler->WaitIdle();
+}
+
+void VulkanApp::RecordPipeline(const PipelineDescription& desc)
+{
+    // Pipelines owning uniform buffers belong to one object, there is nothing to share ahead of time
+    if (!m_pipelineManifestFilename.empty() && !PipelineLibrary::OwnsResources(desc))
+        m_pipelineManifest.Record(desc);
+}
+
+void VulkanApp::WarmUpPipelines(bool sceneLayout)
+{
+    std::vector<PipelineDescription> descs;
+    for (auto& desc : m_pipelineManifest.GetEntries())
+    {
+        if (desc.useSceneLayout == sceneLayout)
+            descs.push_back(std::move(desc));
+    }
+    if (descs.empty())
+        return;
+
+    // Only the layouts are created here, compiling happens on the pipeline compiler threads
+    auto& warmPipelines = sceneLayout ? m_warmScenePipelines : m_warmPipelines;
+    warmPipelines = AcquirePipelines(descs);
+}
+
+void VulkanApp::ReloadChangedShaders()
+{
+    ApplyPipelineSwaps();
+
+    // Modules looked up on this thread last frame may be destroyed once a reload replaced them
+    m_frameShaderLease = m_shaderLibrary.BeginLease();
+
+    // Pipelines which were compiling across a reload are rebuilt once done, they may have used the old code
+    std::vector<ShaderRebuild> pipelines;
+    {
+        std::lock_guard<std::mutex> lock(m_shaderReloadMutex);
+        auto compiling = std::stable_partition(m_compilingShaderRebuilds.begin(), m_compilingShaderRebuilds.end(), [](const ShaderRebuild& rebuild)
+        {
+            return rebuild.compiled.valid() && rebuild.compiled.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+        });
+        std::move(compiling, m_compilingShaderRebuilds.end(), std::back_inserter(pipelines));
+        m_compilingShaderRebuilds.erase(compiling, m_compilingShaderRebuilds.end());
+    }
+
+    std::vector<std::string> sources;
+    if (m_shaderWatcher.IsRunning())
+        sources = m_shaderWatcher.TakeChanged();
+    if (sources.empty() && pipelines.empty())
+        return;
+
+    if (!m_pPipelineCompiler)
+        m_pPipelineCompiler = std::make_unique<ThreadPool>();
+
+    // The library is kept alive by the task, it only goes away once the compiler threads are idle anyway
+    m_pPipelineCompiler->Submit([this, sources = std::move(sources), pipelines = std::move(pipelines), pLibrary = m_pPipelineLibrary]() mutable
+    {
+        RebuildShaderPipelines(sources, std::move(pipelines), pLibrary.get());
+    });
+}
+
+void VulkanApp::RebuildShaderPipelines(const std::vector<std::string>& sources, std::vector<ShaderRebuild> pipelines, PipelineLibrary* pLibrary)
+{
+    // Runs on a pipeline compiler thread, errors are handed to the main thread rather than reported here
+    std::vector<std::string> changedPaths;
+    std::vector<std::string> errors;
+    for (const std::string& source : sources)
+    {
+        std::string log;
+        if (!m_shaderLibrary.Reload(source, changedPaths, log))
+            errors.emplace_back("Failed to compile shader " + source + ":\n" + log);
+    }
+
+    for (const std::string& path : changedPaths)
+    {
+        if (!pLibrary)
+            break;
+
+        for (auto& compiled : pLibrary->FindUsingShader(path))
+            pipelines.push_back({ std::move(compiled.desc), std::move(compiled.pipeline), std::move(compiled.compiled) });
+    }
+
+    std::vector<PipelineSwap> swaps;
+    std::vector<ShaderRebuild> compiling;
+    std::unordered_set<PipelineObjects*> rebuilt;
+    for (auto& rebuild : pipelines)
+    {
+        // Pipelines using several of the shaders are only rebuilt once
+        if (!rebuilt.insert(rebuild.pipeline.get()).second)
+            continue;
+
+        if (rebuild.compiled.valid())
+        {
+            if (rebuild.compiled.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                compiling.push_back(std::move(rebuild));
+                continue;
+            }
+            if (!rebuild.compiled.get())
+                continue;
+        }
+
+        // Compiled into a copy sharing the layout, the pipeline in use stays untouched until the swap
+        PipelineObjects replacement;
+        replacement.pipelineLayout = rebuild.pipeline->pipelineLayout;
+        if (CompilePipeline(rebuild.desc, replacement))
+            swaps.push_back({ std::move(rebuild.pipeline), replacement.pipeline });
+        else
+            errors.emplace_back("Failed to rebuild a pipeline using " + rebuild.desc.vertexShaderFilename + " and " + rebuild.desc.fragmentShaderFilename);
+    }
+
+    std::lock_guard<std::mutex> lock(m_shaderReloadMutex);
+    std::move(swaps.begin(), swaps.end(), std::back_inserter(m_pipelineSwaps));
+    std::move(errors.begin(), errors.end(), std::back_inserter(m_shaderReloadErrors));
+    std::move(compiling.begin(), compiling.end(), std::back_inserter(m_compilingShaderRebuilds));
+}
+
+void VulkanApp::ApplyPipelineSwaps()
+{
+    std::vector<PipelineSwap> swaps;
+    std::vector<std::string> errors;
+    {
+        std::lock_guard<std::mutex> lock(m_shaderReloadMutex);
+        swaps.swap(m_pipelineSwaps);
+        errors.swap(m_shaderReloadErrors);
+    }
+
+    // Shaders being edited fail to compile every so often, these are logged without breaking into the debugger
+    for (const std::string& error : errors)
+        OnError(error.c_str());
+
+    for (auto& swap : swaps)
+    {
+        // Frames in flight may still be drawing with the old pipeline
+        vk::Pipeline retired = swap.target->pipeline;
+        swap.target->pipeline = swap.pipeline;
+        if (retired)
+            DeferDestroy([this, retired]() { GetDevice().destroyPipeline(retired); });
+    }
+}
+
+void VulkanApp::DiscardPipelineSwaps()
+{
+    std::vector<PipelineSwap> swaps;
+    std::vector<ShaderRebuild> compiling;
+    {
+        std::lock_guard<std::mutex> lock(m_shaderReloadMutex);
+        swaps.swap(m_pipelineSwaps);
+        compiling.swap(m_compilingShaderRebuilds);
+        m_shaderReloadErrors.clear();
+    }
+    // Lets the shader library destroy the modules retired since the last frame
+    m_frameShaderLease = {};
+
+    // Only called with the device idle, pipelines which were never swapped in are simply destroyed
+    for (auto& swap : swaps)
+        GetDevice().destroyPipeline(swap.pipeline);
+}
+
+void VulkanApp::LogPipelineCacheStats()
+{
+    auto stats = m_pipelineCache.GetStats();
+
+    char buffer[256];
+    if (stats.feedbackAvailable)
+    {
+        float hitRate = stats.pipelinesCreated ? 100.0f * stats.cacheHits / stats.pipelinesCreated : 0.0f;
+        std::snprintf(buffer, _countof(buffer), "Pipeline cache: %u pipelines, %u cache hits (%.1f%%), %.1f ms creating, %zu bytes loaded",
+            stats.pipelinesCreated, stats.cacheHits, hitRate, stats.creationMilliseconds, stats.loadedBytes);
+    }
+    else
+    {
+        std::snprintf(buffer, _countof(buffer), "Pipeline cache: %u pipelines, %.1f ms creating, %zu bytes loaded",
+            stats.pipelinesCreated, stats.creationMilliseconds, stats.loadedBytes);
+    }
+    m_pFramework->Log(buffer);
+
+    // Pipelines first requested this run compiled on demand, the next run warms them up
+    auto manifestStats = m_pipelineManifest.GetStats();
+    std::snprintf(buffer, _countof(buffer), "Pipeline manifest: %zu pipelines, %zu warmed up, %zu first requested this run",
+        manifestStats.pipelineCount, manifestStats.loadedCount, manifestStats.recordedCount);
+    m_pFramework->Log(buffer);
+}
+
+size_t VulkanApp::GetSharedPipelineCount() const
+{
+    return m_pPipelineLibrary ? m_pPipelineLibrary->GetStats().pipelineCount : 0;
+}
+
+bool VulkanApp::UpdateUniformBuffer(PipelineObjects& obj, uint32_t binding, const void* pData, vk::DeviceSize dataSize)
+{
+    for (auto& uniformBuffer : obj.uniformBuffers)
+    {
+        if (uniformBuffer.binding != binding)
+            continue;
+
+        // The fence of this frame index has been waited on, so nothing reads this copy anymore
+        auto& copy = uniformBuffer.copies[GetFrameIndex()];
+        if (dataSize > uniformBuffer.size || !copy.allocation.pMapped)
+            return Error("Uniform buffer update does not fit binding %u.", binding);
+
+        std::memcpy(copy.allocation.pMapped, pData, dataSize);
+        m_memoryAllocator.Flush(copy.allocation, 0, dataSize);
+        return true;
+    }
+
+    return Error("Pipeline has no uniform buffer at binding %u.", binding);
+}
+
+bool VulkanApp::CreateSceneLayout(vk::DeviceSize frameUniformSize, vk::DeviceSize materialUniformSize, uint32_t objectConstantSize)
 {
     auto device = GetDevice();
+    DestroySceneLayout();
 
-    vk::BufferCreateInfo bufferInfo;
-    bufferInfo.size = sizeof(uint32_t) * indicies.size();
-    bufferInfo.usage = vk::BufferUsageFlagBits::eIndexBuffer;
-    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-    
-    buffer = device.createBuffer(bufferInfo);
-    if (!buffer)
-        return Error("Failed to create index buffer.");
+    vk::DeviceSize ranges[] = { frameUniformSize, materialUniformSize };
+    for (size_t i = 0; i < size_t(SceneSet::eBindless); ++i)
+    {
+        vk::DescriptorSetLayoutBinding binding;
+        binding.binding = 0;
+        binding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+        binding.descriptorCount = 1;
+        binding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics;
 
-    auto bufferMemoryReq = device.getBufferMemoryRequirements(buffer);
+        m_sceneLayout.setLayouts[i] = m_descriptorAllocator.GetLayout({ binding });
+        if (!m_sceneLayout.setLayouts[i])
+            return Error("Failed to create scene descriptor set layout.");
+
+        // Every set reads from the uniform ring, the dynamic offset picks the data
+        DescriptorAllocator::BufferWrite write;
+        write.binding = 0;
+        write.type = vk::DescriptorType::eUniformBufferDynamic;
+        write.buffer = m_uniformRing.GetBuffer();
+        write.range = ranges[i];
+        m_sceneLayout.sets[i] = m_descriptorAllocator.AcquireShared(m_sceneLayout.setLayouts[i], { write });
+        if (!m_sceneLayout.sets[i])
+            return Error("Failed to allocate scene descriptor set.");
+    }
 
-    vk::MemoryPropertyFlags bufferMemoryFlags = vk::MemoryPropertyFlagBits::eHostVisible;
+    // Object data changes every draw, recording it into the command buffer saves a buffer write and
+    // a descriptor set bind per object
+    uint32_t maxPushConstantsSize = m_vkbDevice.physical_device.properties.limits.maxPushConstantsSize;
+    if (objectConstantSize > maxPushConstantsSize)
+        return Error("Object constants are %u bytes, the device supports %u.", objectConstantSize, maxPushConstantsSize);
+    if (objectConstantSize > 0)
+        m_sceneLayout.pushConstantRanges.emplace_back(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, objectConstantSize);
+
+    // The bindless table follows the uniform sets when there is one
+    uint32_t setLayoutCount = static_cast<uint32_t>(SceneSet::eBindless);
+    if (m_bindlessTable.GetLayout())
+    {
+        m_sceneLayout.setLayouts[size_t(SceneSet::eBindless)] = m_bindlessTable.GetLayout();
+        setLayoutCount += 1;
+    }
 
-    vk::MemoryAllocateInfo bufferAllocInfo;
-    bufferAllocInfo.allocationSize = bufferMemoryReq.size;
-    bufferAllocInfo.memoryTypeIndex = FindMemoryTypeIndex(bufferMemoryReq, bufferMemoryFlags);
-    memory = device.allocateMemory(bufferAllocInfo);
-    if (!memory)
-        return Error("Failed to allocate memory for index buffer.");
+    vk::PipelineLayoutCreateInfo layoutInfo;
+    layoutInfo.pSetLayouts = m_sceneLayout.setLayouts;
+    layoutInfo.setLayoutCount = setLayoutCount;
+    layoutInfo.pPushConstantRanges = m_sceneLayout.pushConstantRanges.data();
+    layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(m_sceneLayout.pushConstantRanges.size());
+    m_sceneLayout.pipelineLayout = device.createPipelineLayout(layoutInfo);
+    if (!m_sceneLayout.pipelineLayout)
+        return Error("Failed to create scene pipeline layout.");
+
+    WarmUpPipelines(true);
+    return true;
+}
 
-    device.bindBufferMemory(buffer, memory, 0);
+bool VulkanApp::CreateBindlessTable(const BindlessTable::Limits& limits)
+{
+    DestroyBindlessTable();
+    if (!m_bindlessSupported)
+        return Error("Bindless resources need VK_EXT_descriptor_indexing, which the device doesn't support.");
+
+    // Descriptors in update-after-bind sets have limits of their own
+    vk::PhysicalDevice physicalDevice(m_vkbDevice.physical_device.physical_device);
+    auto properties = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    auto& indexingProperties = properties.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
 
-    // Upload
-    void* pBufferData = device.mapMemory(memory, 0, bufferInfo.size);
-    memcpy(pBufferData, indicies.data(), bufferInfo.size);
-    vk::MappedMemoryRange mappedRange;
-    mappedRange.memory = memory;
-    mappedRange.offset = 0;
-    mappedRange.size = VK_WHOLE_SIZE;
-    device.flushMappedMemoryRanges(mappedRange);
-    device.unmapMemory(memory);
+    BindlessTable::Limits clamped = limits;
+    clamped.maxTextures = std::min({ limits.maxTextures, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+        indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages });
+
+    vk::DeviceSize storageAlignment = m_vkbDevice.physical_device.properties.limits.minStorageBufferOffsetAlignment;
+    if (!m_bindlessTable.Initialize(GetDevice(), m_memoryAllocator, s_kMaxFramesInFlight, clamped, storageAlignment))
+    {
+        m_bindlessTable.Shutdown();
+        return Error("Failed to create bindless table.");
+    }
 
     return true;
 }
 
-bool VulkanApp::CreateUniformBuffer(vk::DeviceSize dataSize, vk::Buffer& buffer, vk::DeviceMemory& memory)
+void VulkanApp::DestroyBindlessTable()
+{
+    m_bindlessTable.Shutdown();
+}
+
+void VulkanApp::DestroySceneLayout()
+{
+    auto device = GetDevice();
+
+    // Warm pipelines may still be compiling against the layout
+    if (!m_warmScenePipelines.empty())
+    {
+        WaitForPipelineCompiler();
+        m_warmScenePipelines.clear();
+    }
+
+    for (size_t i = 0; i < size_t(SceneSet::eBindless); ++i)
+    {
+        if (m_sceneLayout.sets[i])       m_descriptorAllocator.Free(m_sceneLayout.sets[i]);
+    }
+    if (m_sceneLayout.pipelineLayout)    device.destroyPipelineLayout(m_sceneLayout.pipelineLayout);
+
+    m_sceneLayout = SceneLayout();
+}
+
+void VulkanApp::BindSceneSet(vk::CommandBuffer& cb, SceneSet set, uint32_t dynamicOffset)
+{
+    uint32_t index = static_cast<uint32_t>(set);
+    if (set == SceneSet::eBindless)
+    {
+        m_bindlessTable.Bind(cb, m_sceneLayout.pipelineLayout, index, GetFrameIndex());
+        return;
+    }
+    cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_sceneLayout.pipelineLayout, index, 1, &m_sceneLayout.sets[index], 1, &dynamicOffset);
+}
+
+void VulkanApp::DestroyPipeline(PipelineObjects& obj)
+{
+    auto device = GetDevice();
+
+    for (auto& uniformBuffer : obj.uniformBuffers)
+    {
+        for (auto& copy : uniformBuffer.copies)
+            DestroyBuffer(copy.buffer, copy.allocation);
+    }
+
+    // Layouts stay with the allocator, they are shared with other pipelines
+    for (auto& descriptorSet : obj.descriptorSets)
+    {
+        if (descriptorSet) m_descriptorAllocator.Free(descriptorSet);
+    }
+    if (obj.pipelineLayout && !obj.sharedLayout) device.destroyPipelineLayout(obj.pipelineLayout);
+    if (obj.pipeline)            device.destroyPipeline(obj.pipeline);
+}
+
+bool VulkanApp::CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags requiredFlags,
+    vk::MemoryPropertyFlags preferredFlags, MemoryCategory category, vk::Buffer& buffer, MemoryAllocation& allocation)
 {
     auto device = GetDevice();
 
     vk::BufferCreateInfo bufferInfo;
-    bufferInfo.size = dataSize;
-    bufferInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer |
-        vk::BufferUsageFlagBits::eTransferDst; // TransferDst means we can copy data TO the buffer
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
     bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-    
+    if (usage & vk::BufferUsageFlagBits::eTransferDst)
+        m_uploadQueue.ShareWithTransferQueue(bufferInfo);
+
     buffer = device.createBuffer(bufferInfo);
     if (!buffer)
-        return Error("Failed to create uniform buffer.");
+        return false;
 
     auto bufferMemoryReq = device.getBufferMemoryRequirements(buffer);
+    if (!m_memoryAllocator.Allocate(bufferMemoryReq, requiredFlags, preferredFlags, ResourceTiling::eLinear, category, allocation))
+    {
+        device.destroyBuffer(buffer);
+        buffer = nullptr;
+        return false;
+    }
 
-    vk::MemoryPropertyFlags bufferMemoryFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+    return true;
+}
 
-    vk::MemoryAllocateInfo bufferAllocInfo;
-    bufferAllocInfo.allocationSize = bufferMemoryReq.size;
-    bufferAllocInfo.memoryTypeIndex = FindMemoryTypeIndex(bufferMemoryReq, bufferMemoryFlags);
-    memory = device.allocateMemory(bufferAllocInfo);
-    if (!memory)
-        return Error("Failed to allocate memory for uniform buffer.");
+void VulkanApp::DestroyBuffer(vk::Buffer& buffer, MemoryAllocation& allocation)
+{
+    if (buffer)
+    {
+        m_uploadQueue.Cancel(buffer);
+        GetDevice().destroyBuffer(buffer);
+        buffer = nullptr;
+    }
+    m_memoryAllocator.Free(allocation);
+}
+
+void VulkanApp::DeferDestroy(DeletionQueue::Deleter deleter)
+{
+    // Anything recorded up to and including the current frame may still reference the resources
+    m_deletionQueue.Enqueue(m_frameNumber, std::move(deleter));
+}
+
+void VulkanApp::DeferDestroyPipeline(PipelineObjects& obj)
+{
+    for (auto& uniformBuffer : obj.uniformBuffers)
+    {
+        for (auto& copy : uniformBuffer.copies)
+        {
+            if (copy.buffer)
+                m_uploadQueue.Cancel(copy.buffer);
+        }
+    }
+
+    DeferDestroy([this, retired = obj]() mutable { DestroyPipeline(retired); });
+    obj = PipelineObjects();
+}
+
+void VulkanApp::DeferDestroyBuffer(vk::Buffer& buffer, MemoryAllocation& allocation)
+{
+    if (buffer)
+        m_uploadQueue.Cancel(buffer);
+
+    DeferDestroy([this, retiredBuffer = buffer, retiredAllocation = allocation]() mutable { DestroyBuffer(retiredBuffer, retiredAllocation); });
+    buffer = nullptr;
+    allocation = MemoryAllocation();
+}
+
+bool VulkanApp::CreateStaticBuffer(const void* pData, vk::DeviceSize dataSize, vk::BufferUsageFlags usage,
+    vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess, vk::Buffer& buffer, MemoryAllocation& allocation)
+{
+    // On unified memory write straight into memory which is both device local and host visible
+    if (m_unifiedMemory && !m_forceStagedUploads &&
+        CreateBuffer(dataSize, usage, vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible, {}, MemoryCategory::eMeshes, buffer, allocation))
+    {
+        memcpy(allocation.pMapped, pData, dataSize);
+        m_memoryAllocator.Flush(allocation);
+        return true;
+    }
+
+    if (!CreateBuffer(dataSize, usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, {}, MemoryCategory::eMeshes, buffer, allocation))
+        return false;
+
+    if (!m_uploadQueue.EnqueueBufferUpload(buffer, 0, pData, dataSize, dstStages, dstAccess))
+    {
+        DestroyBuffer(buffer, allocation);
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanApp::CreateVertexBuffer(const void* pData, vk::DeviceSize dataSize, vk::Buffer& buffer, MemoryAllocation& allocation)
+{
+    if (!CreateStaticBuffer(pData, dataSize, vk::BufferUsageFlagBits::eVertexBuffer,
+        vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead, buffer, allocation))
+        return Error("Failed to create vertex buffer.");
 
-    device.bindBufferMemory(buffer, memory, 0);
     return true;
 }
 
+bool VulkanApp::CreateIndexBuffer(const std::vector<uint32_t>& indicies, vk::Buffer& buffer, MemoryAllocation& allocation)
+{
+    if (!CreateStaticBuffer(indicies.data(), sizeof(uint32_t) * indicies.size(), vk::BufferUsageFlagBits::eIndexBuffer,
+        vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead, buffer, allocation))
+        return Error("Failed to create index buffer.");
+
+    return true;
+}
+
+bool VulkanApp::CreateUniformBuffer(vk::DeviceSize dataSize, vk::Buffer& buffer, MemoryAllocation& allocation)
+{
+    // TransferDst means we can copy data TO the buffer
+    if (!CreateBuffer(dataSize, vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, {}, MemoryCategory::eUniforms, buffer, allocation))
+        return Error("Failed to create uniform buffer.");
+
+    return true;
+}
+
+bool VulkanApp::CreateGeometryArena(uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, GeometryArena& arena)
+{
+    bool writeDirectly = m_unifiedMemory && !m_forceStagedUploads;
+    if (!arena.Initialize(GetDevice(), m_memoryAllocator, m_uploadQueue, &m_defragmenter, vertexStride, vertexCapacity, indexCapacity, writeDirectly))
+    {
+        arena.Shutdown();
+        return Error("Failed to create geometry arena.");
+    }
+
+    return true;
+}
+
+void VulkanApp::DestroyGeometryArena(GeometryArena& arena)
+{
+    arena.Shutdown();
+}
+
+bool VulkanApp::PushUniforms(const void* pData, vk::DeviceSize dataSize, uint32_t& outDynamicOffset)
+{
+    if (!m_uniformRing.Push(pData, dataSize, outDynamicOffset))
+        return Error("Uniform ring is out of space for this frame.");
+
+    return true;
+}
+
+bool VulkanApp::AllocateUniformSlot(vk::DeviceSize dataSize, UniformRing::Slot& slot)
+{
+    if (!m_uniformRing.AllocateSlot(dataSize, slot))
+        return Error("Uniform ring is out of persistent slots.");
+
+    return true;
+}
+
+void VulkanApp::FreeUniformSlot(UniformRing::Slot& slot)
+{
+    m_uniformRing.FreeSlot(slot);
+}
+
+uint32_t VulkanApp::WriteUniformSlot(const UniformRing::Slot& slot, const void* pData, vk::DeviceSize dataSize)
+{
+    m_uniformRing.WriteSlot(slot, pData, dataSize);
+    return m_uniformRing.GetSlotOffset(slot);
+}
+
 vk::Viewport VulkanApp::GetViewport()
 {
     vk::Viewport viewport;
@@ -879,25 +1686,16 @@ vk::Viewport VulkanApp::GetViewport()
 
 vk::ShaderModule VulkanApp::LoadShaderModule(const char* pFilename)
 {
-    std::ifstream file(pFilename, std::ios::binary);
-    if (!file.good())
-    {
-        Error("Failed to open file: %s", pFilename);
-        return nullptr;
-    }
+    vk::ShaderModule module = m_shaderLibrary.GetModule(pFilename);
 
-    std::vector<char> code;
-    file.seekg(0, std::ios_base::end);
-    code.resize(file.tellg());
-    file.seekg(0);
-    file.read(code.data(), code.size());
-    file.close();
+    // A source which doesn't compile leaves the SPIR-V file in its place, if there is one
+    std::string log = m_shaderLibrary.GetCompileLog(pFilename);
+    if (!log.empty())
+        OnError(log.c_str());
+    if (!module)
+        Error("Failed to load shader: %s", pFilename);
 
-    vk::ShaderModuleCreateInfo moduleInfo;
-    moduleInfo.pCode = reinterpret_cast<uint32_t*>(code.data());
-    moduleInfo.codeSize = code.size();
-
-    return GetDevice().createShaderModule(moduleInfo);
+    return module;
 }
 
-}
\ No newline at end of file
+}
@@ -1,10 +1,31 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <mutex>
 
 #include <vulkan/vulkan.hpp>
 #include <VkBootstrap.h>
 
+#include "PerFrame.h"
+#include "MemoryAllocator.h"
+#include "UploadQueue.h"
+#include "UniformRing.h"
+#include "BufferDefragmenter.h"
+#include "DeletionQueue.h"
+#include "PipelineCache.h"
+#include "PipelineManifest.h"
+#include "DescriptorAllocator.h"
+#include "BindlessTable.h"
+#include "ShaderLibrary.h"
+#include "ShaderCompiler.h"
+#include "ShaderWatcher.h"
+#include "ThreadPool.h"
+#include "GeometryArena.h"
+#include "ResidencyManager.h"
+
 #if __has_include(<SDL_vulkan.h>)
 #   define GAP311_ENABLE_SDL
 #endif
@@ -62,6 +83,8 @@ namespace GAP311
 
     struct PipelineDescription;
     struct PipelineObjects;
+    struct AsyncPipeline;
+    class PipelineLibrary;
 
     /// This class is intended to be used as a base class for demo applications in Vulkan
     /// It will abstract setup and shutdown of Vulkan and provides helpers for managing
@@ -74,6 +97,26 @@ namespace GAP311
 
         void Run();
 
+        /// Always upload static buffers through the staging ring, even on unified memory
+        /// devices where they would otherwise be written in place. Set before Initialize.
+        void SetForceStagedUploads(bool force) { m_forceStagedUploads = force; }
+
+        /// Directory the asset cooker writes to, shaders found there take precedence over the paths
+        /// pipelines name. Empty to only load shaders from the paths given. Set before Initialize.
+        void SetCookedAssetDirectory(const std::string& directory) { m_cookedAssetDirectory = directory; }
+
+        /// Watch the GLSL sources of the shaders in use and rebuild the pipelines using them whenever they
+        /// are saved. Recompiling and rebuilding happens on the pipeline compiler threads, the new pipelines
+        /// replace the old ones at the start of a frame. Only has an effect when built with shaderc, sources
+        /// are then compiled at runtime either way. Set before Initialize.
+        void SetShaderHotReload(bool enabled) { m_shaderHotReload = enabled; }
+
+        /// File recording every shared pipeline the app requests, see PipelineManifest. On the next run the
+        /// pipelines listed are compiled on the pipeline compiler threads during startup, those using the
+        /// scene layout as soon as CreateSceneLayout returns, so none compiles on first use. They are kept
+        /// alive until the device is lost. Empty to neither record nor warm up. Set before Initialize.
+        void SetPipelineManifest(const std::string& filename) { m_pipelineManifestFilename = filename; }
+
     protected:
         /// Perform any general initialization logic
         virtual bool OnInitialize() { return true; }
@@ -84,11 +127,17 @@ namespace GAP311
         /// Called when the Vulkan device has been fully initialized
         /// and is ready to service requests like creating resources
         virtual bool OnDeviceReady() { return true; }
-        /// Called before the Vulkan device needs to be reconfigured
-        /// usually as a result of the window being resized.
+        /// Called before the Vulkan device is shut down, or when the window's
+        /// render pass has to be recreated because the surface format changed.
         /// Free any resources here, especially those which were created
         /// during OnDeviceReady
         virtual void OnDeviceLost() {}
+        /// Called after OnDeviceReady and whenever the swapchain was rebuilt, usually
+        /// as a result of the window being resized. Create anything sized to the window here.
+        virtual bool OnSwapchainReady() { return true; }
+        /// Called before the swapchain is rebuilt, free resources created during OnSwapchainReady.
+        /// Pipelines stay valid, viewport and scissor are dynamic state set by the window render pass.
+        virtual void OnSwapchainLost() {}
         /// Record commands to be executed before the window's render pass
         virtual void OnPreRender(vk::CommandBuffer& cb) {}
         /// Record commands for rendering a frame
@@ -105,6 +154,8 @@ namespace GAP311
 
         int32_t GetWindowWidth() const { return m_windowWidth; }
         int32_t GetWindowHeight() const { return m_windowHeight; }
+        /// Size of the images being rendered into, follows the window as it is resized
+        vk::Extent2D GetSwapchainExtent() const { return m_vkbSwapchain.extent; }
 
         IFramework* GetFramework() const { return m_pFramework.get(); }
 
@@ -115,17 +166,129 @@ namespace GAP311
         bool CreatePipeline(const PipelineDescription& desc, PipelineObjects& obj);
         void DestroyPipeline(PipelineObjects& obj);
 
+        /// Returns the pipeline shared by every caller with an equivalent description, creating it on
+        /// first use. It is destroyed through DeferDestroyPipeline once the last reference is dropped,
+        /// drop every reference in OnDeviceLost. Descriptions owning uniform buffers hold per-object
+        /// data and always get a pipeline of their own. Returns null on failure.
+        std::shared_ptr<PipelineObjects> AcquirePipeline(const PipelineDescription& desc);
+        /// Starts compiling every description on worker threads through the shared pipeline cache and
+        /// returns right away. Each future yields the pipeline once compiled, or null on failure.
+        /// Layouts and descriptors are still created on the calling thread. Pipelines acquired while
+        /// their compilation is in flight wait for it rather than compiling again.
+        std::vector<std::shared_future<std::shared_ptr<PipelineObjects>>> AcquirePipelines(const std::vector<PipelineDescription>& descs);
+        /// Returns right away with the pipeline compiling on a worker thread if it isn't ready yet, it never
+        /// waits on a lock held while another pipeline compiles. In the meantime the object draws with the
+        /// fallback description, which is compiled on the spot unless something already holds it, so keep
+        /// fallbacks warm with AcquirePipeline in OnDeviceReady.
+        bool AcquirePipelineAsync(const PipelineDescription& desc, AsyncPipeline& outPipeline);
+        /// The generic permutation drawing in place of desc while it compiles. It has no specialization
+        /// constants except PipelineDescription::s_kUbershaderConstant set to true, shaders opting in
+        /// declare that constant and read the switches from uniforms when it is set.
+        static PipelineDescription MakeFallbackDescription(const PipelineDescription& desc);
+        /// Number of distinct pipelines alive in the library
+        size_t GetSharedPipelineCount() const;
+        /// How many pipelines were created and how many of those the on-disk pipeline cache served
+        PipelineCache::Stats GetPipelineCacheStats() const { return m_pipelineCache.GetStats(); }
+        /// Pipelines listed in the manifest, how many were loaded from it and how many are new this run
+        PipelineManifest::Stats GetPipelineManifestStats() const { return m_pipelineManifest.GetStats(); }
+
+        /// Writes the copy of a uniform buffer owned by the pipeline that the frame being recorded reads.
+        /// The copies used by frames still in flight are left alone.
+        bool UpdateUniformBuffer(PipelineObjects& obj, uint32_t binding, const void* pData, vk::DeviceSize dataSize);
+
+        /// Descriptor sets split by how often they change, shared by every pipeline created with
+        /// PipelineDescription::useSceneLayout. Each set holds one dynamic uniform buffer at binding 0
+        /// which reads from the uniform ring, so rebinding a set only swaps its dynamic offset:
+        ///   set 0 - per frame data such as camera and lights, bound once per frame
+        ///   set 1 - per material data, bound when the material changes
+        ///   set 2 - the bindless table, only present when CreateBindlessTable was called first
+        /// Per object data is a push constant block at offset 0 visible to the vertex and fragment
+        /// stages, recorded with PipelineObjects::PushConstants for every draw.
+        /// Sizes are the ranges of the blocks the shaders declare.
+        enum class SceneSet : uint32_t { eFrame = 0, eMaterial = 1, eBindless = 2, eCount };
+        bool CreateSceneLayout(vk::DeviceSize frameUniformSize, vk::DeviceSize materialUniformSize, uint32_t objectConstantSize);
+        void DestroySceneLayout();
+        vk::PipelineLayout GetSceneLayout() const { return m_sceneLayout.pipelineLayout; }
+        /// dynamicOffset comes from PushUniforms or a uniform slot, eBindless binds the set of the
+        /// frame being recorded and ignores it
+        void BindSceneSet(vk::CommandBuffer& cb, SceneSet set, uint32_t dynamicOffset);
+
+        /// True when the device supports what BindlessTable needs from VK_EXT_descriptor_indexing
+        bool IsBindlessSupported() const { return m_bindlessSupported; }
+        /// Textures, materials and objects shaders index instead of having them bound per draw, see
+        /// BindlessTable. Call before CreateSceneLayout, which adds it as SceneSet::eBindless. The
+        /// texture count is clamped to what the device supports in update-after-bind sets.
+        bool CreateBindlessTable(const BindlessTable::Limits& limits);
+        void DestroyBindlessTable();
+        BindlessTable& GetBindlessTable() { return m_bindlessTable; }
+
+        /// Creates a buffer bound to memory sub-allocated from the app's DeviceMemoryAllocator.
+        /// Memory with the preferred flags is used when available, otherwise any memory with the required flags.
+        bool CreateBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags requiredFlags,
+            vk::MemoryPropertyFlags preferredFlags, MemoryCategory category, vk::Buffer& buffer, MemoryAllocation& allocation);
+        void DestroyBuffer(vk::Buffer& buffer, MemoryAllocation& allocation);
+
+        /// Destroys resources once every frame recorded so far has finished on the GPU, without waiting
+        /// for the device. The handles passed in are cleared right away and must no longer be used.
+        /// DeferDestroy may be called from any thread.
+        void DeferDestroy(DeletionQueue::Deleter deleter);
+        void DeferDestroyPipeline(PipelineObjects& obj);
+        void DeferDestroyBuffer(vk::Buffer& buffer, MemoryAllocation& allocation);
+
         template <typename V>
-        bool CreateVertexBuffer(const std::vector<V>& vertices, vk::Buffer& buffer, vk::DeviceMemory& memory)
+        bool CreateVertexBuffer(const std::vector<V>& vertices, vk::Buffer& buffer, MemoryAllocation& allocation)
         {
-            return CreateVertexBuffer(vertices.data(), sizeof(V) * vertices.size(), buffer, memory);
+            return CreateVertexBuffer(vertices.data(), sizeof(V) * vertices.size(), buffer, allocation);
         }
 
-        bool CreateVertexBuffer(const void* pData, vk::DeviceSize dataSize, vk::Buffer& buffer, vk::DeviceMemory& memory);
+        /// Vertex and index buffers live in device local memory. Their contents are copied in through
+        /// the upload queue at the start of the next frame, or written directly on unified memory devices.
+        bool CreateVertexBuffer(const void* pData, vk::DeviceSize dataSize, vk::Buffer& buffer, MemoryAllocation& allocation);
 
-        bool CreateIndexBuffer(const std::vector<uint32_t>& indices, vk::Buffer& buffer, vk::DeviceMemory& memory);
+        bool CreateIndexBuffer(const std::vector<uint32_t>& indices, vk::Buffer& buffer, MemoryAllocation& allocation);
+
+        bool CreateUniformBuffer(vk::DeviceSize dataSize, vk::Buffer& buffer, MemoryAllocation& allocation);
+
+        /// Creates vertex and index buffers shared by meshes of one vertex format, filled the same
+        /// way as CreateVertexBuffer/CreateIndexBuffer
+        bool CreateGeometryArena(uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, GeometryArena& arena);
+        void DestroyGeometryArena(GeometryArena& arena);
+
+        /// Writes uniform data for the frame being recorded into the uniform ring and returns the
+        /// offset to pass as the dynamic offset of a binding marked dynamic in the PipelineDescription
+        bool PushUniforms(const void* pData, vk::DeviceSize dataSize, uint32_t& outDynamicOffset);
+
+        template <typename T>
+        bool PushUniforms(const T& data, uint32_t& outDynamicOffset)
+        {
+            return PushUniforms(&data, sizeof(T), outDynamicOffset);
+        }
 
-        bool CreateUniformBuffer(vk::DeviceSize dataSize, vk::Buffer& buffer, vk::DeviceMemory& memory);
+        /// Persistent uniform storage in the uniform ring with one copy per frame in flight. A copy keeps
+        /// its contents between frames, so only rewrite it when the data changed since that frame index
+        /// last used it. Free slots through DeferDestroy while frames in flight may still read them.
+        bool AllocateUniformSlot(vk::DeviceSize dataSize, UniformRing::Slot& slot);
+        void FreeUniformSlot(UniformRing::Slot& slot);
+        /// Writes the copy of the frame being recorded and returns its dynamic offset
+        uint32_t WriteUniformSlot(const UniformRing::Slot& slot, const void* pData, vk::DeviceSize dataSize);
+        /// Dynamic offset of the copy of the frame being recorded
+        uint32_t GetUniformSlotOffset(const UniformRing::Slot& slot) const { return m_uniformRing.GetSlotOffset(slot); }
+
+        /// Usage of device memory handed out to buffers, per memory type, per category and in total
+        DeviceMemoryAllocator::Stats GetMemoryStats() const { return m_memoryAllocator.GetStats(); }
+
+        /// Progress of the background compaction of sparse memory blocks
+        BufferDefragmenter::Stats GetDefragmentationStats() const { return m_defragmenter.GetStats(); }
+        void SetDefragmentationEnabled(bool enabled) { m_defragmenter.SetEnabled(enabled); }
+
+        /// Tracks streamable resources and evicts the least recently drawn ones when over budget
+        ResidencyManager& GetResidencyManager() { return m_residencyManager; }
+
+        /// Number of frames rendered so far, increases by one every frame
+        uint64_t GetFrameNumber() const { return m_frameNumber; }
+        /// Which of the frames in flight is being recorded, below GetFramesInFlight()
+        uint32_t GetFrameIndex() const { return static_cast<uint32_t>(m_currentFrameIndex); }
+        uint32_t GetFramesInFlight() const { return s_kMaxFramesInFlight; }
 
         /// Returns the RenderPass which will be used to render into the window's backbuffer
         vk::RenderPass GetWindowRenderPass() const { return m_vkWindowRenderPass; }
@@ -133,17 +296,39 @@ namespace GAP311
         /// Returns a structure representing the viewport of the window
         vk::Viewport GetViewport();
 
-        /// Helper to load a SPIR-V shader file as a ShaderModule
+        /// Returns the ShaderModule of a SPIR-V shader file, only read from disk the first time it is used.
+        /// The module is owned by the shader library and must not be destroyed, it stays valid until the next
+        /// frame starts as a shader reload may replace it.
         vk::ShaderModule LoadShaderModule(const char* pFilename);
+        ShaderLibrary& GetShaderLibrary() { return m_shaderLibrary; }
+        /// Compiled, cached and reloaded from memory or disk, see ShaderCompiler
+        ShaderCompiler::Stats GetShaderCompilerStats() const { return m_shaderCompiler.GetStats(); }
+        DescriptorAllocator& GetDescriptorAllocator() { return m_descriptorAllocator; }
 
     private: // Vulkan specific functionality
         bool InitializeVulkan();
         void ShutdownVulkan();
         bool RebuildSwapchain();
+        bool CreateWindowRenderPass();
         void DestroyFramebuffers();
+        void LogPipelineCacheStats();
         void RenderFrame();
         void BeginWindowRenderPass(vk::CommandBuffer& cb);
         void EndWindowRenderPass(vk::CommandBuffer& cb);
+        bool CreatePipelineDescriptors(const PipelineDescription& desc, PipelineObjects& obj);
+        bool PreparePipeline(const PipelineDescription& desc, PipelineObjects& obj);
+        bool CompilePipeline(const PipelineDescription& desc, PipelineObjects& obj);
+        PipelineLibrary& GetPipelineLibrary();
+        void WaitForPipelineCompiler();
+        void RecordPipeline(const PipelineDescription& desc);
+        void WarmUpPipelines(bool sceneLayout);
+        void ReloadChangedShaders();
+        struct ShaderRebuild;
+        void RebuildShaderPipelines(const std::vector<std::string>& sources, std::vector<ShaderRebuild> pipelines, PipelineLibrary* pLibrary);
+        void ApplyPipelineSwaps();
+        void DiscardPipelineSwaps();
+        bool CreateStaticBuffer(const void* pData, vk::DeviceSize dataSize, vk::BufferUsageFlags usage,
+            vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess, vk::Buffer& buffer, MemoryAllocation& allocation);
 
         int32_t m_windowWidth = 0;
         int32_t m_windowHeight = 0;
@@ -151,12 +336,70 @@ namespace GAP311
         vkb::Device m_vkbDevice;
         vk::Queue m_vkGraphicsQueue;
         vk::Queue m_vkPresentQueue;
+        vk::Queue m_vkTransferQueue;
         vk::SurfaceKHR m_vkWindowSurface;
         vkb::Swapchain m_vkbSwapchain;
         vk::RenderPass m_vkWindowRenderPass;
+        vk::Format m_vkWindowFormat = vk::Format::eUndefined;   // format the render pass was created for
+        bool m_deviceReady = false;                             // between OnDeviceReady and OnDeviceLost
 
         vk::CommandPool m_vkGraphicsCommandPool;
-        vk::DescriptorPool m_vkDescriptorPool;
+        DescriptorAllocator m_descriptorAllocator;
+
+        struct SceneLayout
+        {
+            vk::DescriptorSetLayout setLayouts[size_t(SceneSet::eCount)];
+            vk::DescriptorSet sets[size_t(SceneSet::eCount)];
+            std::vector<vk::PushConstantRange> pushConstantRanges;
+            vk::PipelineLayout pipelineLayout;
+        };
+        SceneLayout m_sceneLayout;
+        BindlessTable m_bindlessTable;
+        bool m_bindlessSupported = false;
+        std::shared_ptr<PipelineLibrary> m_pPipelineLibrary;
+        std::unique_ptr<ThreadPool> m_pPipelineCompiler;
+        PipelineCache m_pipelineCache;
+        ShaderLibrary m_shaderLibrary;
+        ShaderCompiler m_shaderCompiler;
+        ShaderWatcher m_shaderWatcher;
+        bool m_shaderHotReload = true;
+        std::string m_cookedAssetDirectory = "Cooked";
+        static constexpr const char* s_kShaderCacheDirectory = "ShaderCache";
+        static constexpr std::chrono::milliseconds s_kShaderWatchInterval{ 250 };
+
+        struct PipelineSwap
+        {
+            std::shared_ptr<PipelineObjects> target;
+            vk::Pipeline pipeline;      // rebuilt from the reloaded shaders, replaces target's
+        };
+        std::vector<PipelineSwap> m_pipelineSwaps;          // swapped in at the start of the next frame
+        std::vector<std::string> m_shaderReloadErrors;      // reported on the main thread
+        struct ShaderRebuild
+        {
+            PipelineDescription desc;
+            std::shared_ptr<PipelineObjects> pipeline;
+            std::shared_future<bool> compiled;
+        };
+        // Were still compiling when their shaders were reloaded and may hold the old code, rebuilt once compiled
+        std::vector<ShaderRebuild> m_compilingShaderRebuilds;
+        ShaderLibrary::Lease m_frameShaderLease;            // keeps modules handed out on the main thread valid for the frame
+        std::mutex m_shaderReloadMutex;
+        static constexpr const char* s_kPipelineCacheFilename = "PipelineCache.bin";
+        static constexpr uint64_t s_kPipelineCacheSaveInterval = 3600; // frames between saves of new pipelines
+        PipelineManifest m_pipelineManifest;
+        std::string m_pipelineManifestFilename = "PipelineManifest.txt";
+        // Compiled from the manifest and held so they are ready when first requested
+        std::vector<std::shared_future<std::shared_ptr<PipelineObjects>>> m_warmPipelines;
+        std::vector<std::shared_future<std::shared_ptr<PipelineObjects>>> m_warmScenePipelines;
+
+        DeviceMemoryAllocator m_memoryAllocator;
+        UploadQueue m_uploadQueue;
+        BufferDefragmenter m_defragmenter;
+        UniformRing m_uniformRing;
+        ResidencyManager m_residencyManager;
+        DeletionQueue m_deletionQueue;
+        bool m_unifiedMemory = false;
+        bool m_forceStagedUploads = false;
 
         struct FramebufferData
         {
@@ -173,8 +416,9 @@ namespace GAP311
             vk::Semaphore semaphoreFinished;
             vk::Fence fenceInFlight;
         };
-        std::vector<FrameData> m_frames;
+        PerFrame<FrameData> m_frames;
         size_t m_currentFrameIndex = 0;
+        std::atomic<uint64_t> m_frameNumber = 0;     // also read by DeferDestroy, which pipelines dropped on compiler threads reach
 
     private: // Framework specific functionality
         std::unique_ptr<IFramework> m_pFramework;
@@ -232,6 +476,10 @@ namespace GAP311
             uint32_t binding;
             /// Size in bytes of the buffer
             size_t byteSize;
+            /// Read the data from the app's per-frame uniform ring instead of a buffer owned by the
+            /// pipeline. The descriptor becomes eUniformBufferDynamic and the offset returned by
+            /// VulkanApp::PushUniforms must be supplied when binding.
+            bool dynamic = false;
         };
         std::vector<UniformBuffer> uniformBuffers;
 
@@ -242,34 +490,131 @@ namespace GAP311
         };
         std::vector<UniformImage> uniformImages;
 
+        /// A block of data recorded straight into the command buffer with PipelineObjects::PushConstants,
+        /// it needs no buffer or descriptor set which suits small data that changes every draw
+        /// e.g.  layout(push_constant) uniform ObjectConstants { mat4 worldMatrix; };
+        struct PushConstantRange
+        {
+            /// Stages declaring the block
+            vk::ShaderStageFlags stages;
+            /// Byte offset and size of the block, both multiples of 4. Devices provide at least 128 bytes.
+            uint32_t offset;
+            uint32_t byteSize;
+        };
+        std::vector<PushConstantRange> pushConstants;
+
         /// Shader stages
         std::string vertexShaderFilename;
         std::string fragmentShaderFilename;
         std::string geometryShaderFilename;
 
+        /// Value for a specialization constant declared by one or more of the shader stages
+        /// e.g.  layout(constant_id = 0) const bool ENABLE_LIGHTING = true;
+        /// Constants are matched by name, stages which don't declare one keep their default.
+        /// Branches on a constant are resolved when the pipeline is compiled, every combination
+        /// of values is a pipeline of its own.
+        struct SpecializationConstant
+        {
+            std::string name;
+            /// bool, int and uint constants are all 32 bits, bools are 0 or 1
+            uint32_t value;
+        };
+        std::vector<SpecializationConstant> specializationConstants;
+
+        /// Specialization constant selecting the generic path of a shader, see VulkanApp::MakeFallbackDescription
+        static constexpr const char* s_kUbershaderConstant = "UBERSHADER";
+
         /// Draw lines instead of filled geometry
         bool wireframeMode = false;
+
+        /// Blend the output over the framebuffer with standard (non premultiplied) alpha
+        bool alphaBlend = false;
+
+        /// Use the app's shared layout from VulkanApp::CreateSceneLayout instead of a descriptor set
+        /// of its own. uniformBuffers, uniformImages and pushConstants are ignored, the sets are bound
+        /// by the app and the push constants are the ones of the scene layout.
+        bool useSceneLayout = false;
     };
 
     struct PipelineObjects
     {
         vk::Pipeline pipeline;
         vk::PipelineLayout pipelineLayout;
-        vk::DescriptorSet descriptorSet;
-        vk::DescriptorSetLayout descriptorSetLayout;
+        PerFrame<vk::DescriptorSet> descriptorSets;    // each frame in flight points at its own buffer copies
+        vk::DescriptorSetLayout descriptorSetLayout;   // owned by the app's DescriptorAllocator
+        bool sharedLayout = false;  // pipelineLayout belongs to the app's scene layout
+        std::vector<vk::PushConstantRange> pushConstantRanges;
 
         struct UniformBuffer
         {
             uint32_t binding;
-            vk::Buffer buffer;
-            vk::DeviceMemory bufferMemory;
+            vk::DeviceSize size = 0;
+
+            struct Copy
+            {
+                vk::Buffer buffer;
+                MemoryAllocation allocation;
+            };
+            PerFrame<Copy> copies;
         };
         std::vector<UniformBuffer> uniformBuffers;
 
-        void Bind(vk::CommandBuffer& cb)
+        /// Binds the descriptor set of frameIndex, see VulkanApp::GetFrameIndex.
+        /// Dynamic offsets are given in binding order of the dynamic uniform buffers.
+        void Bind(vk::CommandBuffer& cb, uint32_t frameIndex, uint32_t dynamicOffsetCount = 0, const uint32_t* pDynamicOffsets = nullptr)
         {
             cb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-            cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+            if (descriptorSets[frameIndex])
+                cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, 1, &descriptorSets[frameIndex], dynamicOffsetCount, pDynamicOffsets);
         }
+
+        /// Records dataSize bytes at offset into the push constant ranges of the layout. The data is
+        /// captured by the command buffer, nothing has to stay alive until the draw executes.
+        void PushConstants(vk::CommandBuffer& cb, const void* pData, uint32_t dataSize, uint32_t offset = 0) const
+        {
+            // Every stage of a range overlapping the update must be named
+            vk::ShaderStageFlags stages;
+            for (auto& range : pushConstantRanges)
+            {
+                if (range.offset < offset + dataSize && offset < range.offset + range.size)
+                    stages |= range.stageFlags;
+            }
+            cb.pushConstants(pipelineLayout, stages, offset, dataSize, pData);
+        }
+
+        template <typename T>
+        void PushConstants(vk::CommandBuffer& cb, const T& data, uint32_t offset = 0) const
+        {
+            PushConstants(cb, &data, sizeof(T), offset);
+        }
+    };
+
+    /// A pipeline which may still be compiling in the background, see VulkanApp::AcquirePipelineAsync.
+    /// Until the specialized pipeline is ready drawing goes through the generic fallback.
+    struct AsyncPipeline
+    {
+        std::shared_ptr<PipelineObjects> specialized;
+        std::shared_future<bool> compiled;          // invalid once the outcome is known
+        std::shared_ptr<PipelineObjects> fallback;  // released as soon as the specialized pipeline is ready
+
+        /// The pipeline to draw with this frame, never blocks. Null only if neither pipeline exists.
+        PipelineObjects* Get()
+        {
+            if (compiled.valid() && compiled.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                // A specialization which failed to compile keeps drawing through the fallback
+                if (compiled.get())
+                    fallback.reset();
+                else
+                    specialized.reset();
+                compiled = std::shared_future<bool>();
+            }
+
+            if (!compiled.valid() && specialized)
+                return specialized.get();
+            return fallback.get();
+        }
+
+        bool IsSpecialized() const { return !compiled.valid() && specialized; }
     };
-}
\ No newline at end of file
+}
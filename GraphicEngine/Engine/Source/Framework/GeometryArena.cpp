@@ -0,0 +1,229 @@
+#include "GeometryArena.h"
+
+#include <cstring>
+#include <iterator>
+
+#pragma warning(disable: 4834) // allow ignoring nodiscard
+
+namespace GAP311
+{
+
+bool GeometryArena::Initialize(vk::Device device, DeviceMemoryAllocator& allocator, UploadQueue& uploadQueue, BufferDefragmenter* pDefragmenter,
+    uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, bool writeDirectly)
+{
+    m_device = device;
+    m_pAllocator = &allocator;
+    m_pUploadQueue = &uploadQueue;
+    m_pDefragmenter = writeDirectly ? nullptr : pDefragmenter;
+    m_writeDirectly = writeDirectly;
+    m_vertexStride = vertexStride;
+    m_meshCount = 0;
+
+    if (!CreateRegion(m_vertices, vertexStride, vertexCapacity, vk::BufferUsageFlagBits::eVertexBuffer))
+        return false;
+
+    return CreateRegion(m_indices, sizeof(uint32_t), indexCapacity, vk::BufferUsageFlagBits::eIndexBuffer);
+}
+
+void GeometryArena::Shutdown()
+{
+    DestroyRegion(m_vertices);
+    DestroyRegion(m_indices);
+    m_meshCount = 0;
+    m_pAllocator = nullptr;
+    m_pUploadQueue = nullptr;
+    m_pDefragmenter = nullptr;
+    m_device = nullptr;
+}
+
+bool GeometryArena::Allocate(const void* pVertices, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, GeometryRange& range)
+{
+    if (vertexCount == 0)
+        return false;
+
+    GeometryRange result;
+    result.vertexCount = vertexCount;
+    result.indexCount = indexCount;
+
+    if (!AllocateRange(m_vertices, vertexCount, result.vertexOffset))
+        return false;
+
+    if (indexCount > 0 && !AllocateRange(m_indices, indexCount, result.firstIndex))
+    {
+        FreeRange(m_vertices, result.vertexOffset, vertexCount);
+        return false;
+    }
+
+    if (!Write(m_vertices, result.vertexOffset, pVertices, vertexCount, vk::AccessFlagBits::eVertexAttributeRead) ||
+        (indexCount > 0 && !Write(m_indices, result.firstIndex, pIndices, indexCount, vk::AccessFlagBits::eIndexRead)))
+    {
+        Free(result);
+        return false;
+    }
+
+    m_meshCount += 1;
+    range = result;
+    return true;
+}
+
+void GeometryArena::Free(GeometryRange& range)
+{
+    if (!range)
+        return;
+
+    FreeRange(m_vertices, range.vertexOffset, range.vertexCount);
+    if (range.indexCount > 0)
+        FreeRange(m_indices, range.firstIndex, range.indexCount);
+
+    m_meshCount -= m_meshCount > 0 ? 1 : 0;
+    range = GeometryRange();
+}
+
+void GeometryArena::Bind(vk::CommandBuffer& cb) const
+{
+    cb.bindVertexBuffers(0, m_vertices.buffer, vk::DeviceSize(0));
+    cb.bindIndexBuffer(m_indices.buffer, vk::DeviceSize(0), vk::IndexType::eUint32);
+}
+
+GeometryArena::Stats GeometryArena::GetStats() const
+{
+    Stats stats;
+    stats.meshCount = m_meshCount;
+    stats.vertexCapacity = m_vertices.capacity;
+    stats.vertexCount = m_vertices.used;
+    stats.largestFreeVertexRange = LargestFreeRange(m_vertices);
+    stats.indexCapacity = m_indices.capacity;
+    stats.indexCount = m_indices.used;
+    stats.largestFreeIndexRange = LargestFreeRange(m_indices);
+    return stats;
+}
+
+bool GeometryArena::CreateRegion(Region& region, uint32_t elementSize, uint32_t capacity, vk::BufferUsageFlags usage)
+{
+    region.elementSize = elementSize;
+    region.capacity = capacity;
+    region.used = 0;
+    region.freeRanges.clear();
+    region.freeRanges[0] = capacity;
+
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = vk::DeviceSize(elementSize) * capacity;
+    bufferInfo.usage = usage | (m_writeDirectly ? vk::BufferUsageFlags() : vk::BufferUsageFlagBits::eTransferDst);
+    if (m_pDefragmenter)
+        bufferInfo.usage |= vk::BufferUsageFlagBits::eTransferSrc;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+    if (!m_writeDirectly)
+        m_pUploadQueue->ShareWithTransferQueue(bufferInfo);
+
+    region.buffer = m_device.createBuffer(bufferInfo);
+    if (!region.buffer)
+        return false;
+
+    vk::MemoryPropertyFlags requiredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    if (m_writeDirectly)
+        requiredFlags |= vk::MemoryPropertyFlagBits::eHostVisible;
+
+    auto bufferMemoryReq = m_device.getBufferMemoryRequirements(region.buffer);
+    if (!m_pAllocator->Allocate(bufferMemoryReq, requiredFlags, {}, ResourceTiling::eLinear, MemoryCategory::eMeshes, region.allocation))
+        return false;
+
+    m_device.bindBufferMemory(region.buffer, region.allocation.memory, region.allocation.offset);
+
+    if (m_pDefragmenter)
+    {
+        m_pDefragmenter->Register(region.buffer, bufferInfo.size, bufferInfo.usage, region.allocation,
+            [&region](vk::Buffer newBuffer, const MemoryAllocation& newAllocation)
+            {
+                region.buffer = newBuffer;
+                region.allocation = newAllocation;
+            });
+    }
+    return true;
+}
+
+void GeometryArena::DestroyRegion(Region& region)
+{
+    if (region.buffer)
+    {
+        if (m_pDefragmenter)
+            m_pDefragmenter->Unregister(region.buffer);
+        m_pUploadQueue->Cancel(region.buffer);
+        m_device.destroyBuffer(region.buffer);
+        region.buffer = nullptr;
+    }
+    if (m_pAllocator)
+        m_pAllocator->Free(region.allocation);
+    region.freeRanges.clear();
+    region.capacity = region.used = 0;
+}
+
+bool GeometryArena::AllocateRange(Region& region, uint32_t count, uint32_t& first)
+{
+    // First fit keeps the low end of the buffer densely packed
+    for (auto it = region.freeRanges.begin(); it != region.freeRanges.end(); ++it)
+    {
+        if (it->second < count)
+            continue;
+
+        first = it->first;
+        uint32_t remaining = it->second - count;
+        region.freeRanges.erase(it);
+        if (remaining > 0)
+            region.freeRanges[first + count] = remaining;
+
+        region.used += count;
+        return true;
+    }
+
+    return false;
+}
+
+void GeometryArena::FreeRange(Region& region, uint32_t first, uint32_t count)
+{
+    region.used -= count;
+
+    // Merge with the free ranges directly before and after
+    auto next = region.freeRanges.lower_bound(first);
+    if (next != region.freeRanges.end() && first + count == next->first)
+    {
+        count += next->second;
+        next = region.freeRanges.erase(next);
+    }
+
+    if (next != region.freeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == first)
+        {
+            prev->second += count;
+            return;
+        }
+    }
+
+    region.freeRanges[first] = count;
+}
+
+bool GeometryArena::Write(Region& region, uint32_t first, const void* pData, uint32_t count, vk::AccessFlags dstAccess)
+{
+    vk::DeviceSize offset = vk::DeviceSize(region.elementSize) * first;
+    vk::DeviceSize size = vk::DeviceSize(region.elementSize) * count;
+
+    if (m_writeDirectly)
+    {
+        std::memcpy(static_cast<uint8_t*>(region.allocation.pMapped) + offset, pData, size);
+        m_pAllocator->Flush(region.allocation, offset, size);
+        return true;
+    }
+
+    return m_pUploadQueue->EnqueueBufferUpload(region.buffer, offset, pData, size, vk::PipelineStageFlagBits::eVertexInput, dstAccess);
+}
+
+uint32_t GeometryArena::LargestFreeRange(const Region& region)
+{
+    uint32_t largest = 0;
+    for (auto& freeRange : region.freeRanges)
+        largest = freeRange.second > largest ? freeRange.second : largest;
+    return largest;
+}
+
+}
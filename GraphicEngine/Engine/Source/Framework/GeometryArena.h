@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+#include "UploadQueue.h"
+#include "BufferDefragmenter.h"
+
+namespace GAP311
+{
+    /// The location of a mesh inside a GeometryArena, in vertices and indices
+    struct GeometryRange
+    {
+        uint32_t vertexOffset = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+
+        explicit operator bool() const { return vertexCount != 0; }
+    };
+
+    /// One large vertex buffer and one large index buffer shared by every mesh of a vertex format.
+    ///
+    /// Meshes are sub-allocated out of both buffers with first-fit free lists that coalesce
+    /// neighbouring ranges when freed. Binding the arena once lets every mesh in it be drawn
+    /// with drawIndexed(indexCount, 1, firstIndex, vertexOffset, 0), which is also the layout
+    /// indirect draws expect.
+    class GeometryArena
+    {
+    public:
+        struct Stats
+        {
+            uint32_t meshCount = 0;
+            uint32_t vertexCapacity = 0;
+            uint32_t vertexCount = 0;
+            uint32_t largestFreeVertexRange = 0;
+            uint32_t indexCapacity = 0;
+            uint32_t indexCount = 0;
+            uint32_t largestFreeIndexRange = 0;
+        };
+
+        /// When writeDirectly is set the buffers are placed in device local, host visible memory
+        /// and written in place, otherwise data goes through the upload queue and the buffers may be
+        /// moved by pDefragmenter. The CPU writing in place can't be ordered against GPU moves.
+        bool Initialize(vk::Device device, DeviceMemoryAllocator& allocator, UploadQueue& uploadQueue, BufferDefragmenter* pDefragmenter,
+            uint32_t vertexStride, uint32_t vertexCapacity, uint32_t indexCapacity, bool writeDirectly);
+        void Shutdown();
+
+        /// Reserves room for a mesh and uploads its data, indices are relative to the mesh's first vertex
+        bool Allocate(const void* pVertices, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount, GeometryRange& range);
+        void Free(GeometryRange& range);
+
+        /// Binds the vertex buffer to binding 0 along with the index buffer
+        void Bind(vk::CommandBuffer& cb) const;
+
+        uint32_t GetVertexStride() const { return m_vertexStride; }
+        Stats GetStats() const;
+
+    private:
+        struct Region
+        {
+            vk::Buffer buffer;
+            MemoryAllocation allocation;
+            uint32_t elementSize = 0;
+            uint32_t capacity = 0;
+            uint32_t used = 0;
+            std::map<uint32_t, uint32_t> freeRanges;    // first element -> element count, sorted by offset
+        };
+
+        bool CreateRegion(Region& region, uint32_t elementSize, uint32_t capacity, vk::BufferUsageFlags usage);
+        void DestroyRegion(Region& region);
+        bool AllocateRange(Region& region, uint32_t count, uint32_t& first);
+        void FreeRange(Region& region, uint32_t first, uint32_t count);
+        bool Write(Region& region, uint32_t first, const void* pData, uint32_t count, vk::AccessFlags dstAccess);
+        static uint32_t LargestFreeRange(const Region& region);
+
+        vk::Device m_device;
+        DeviceMemoryAllocator* m_pAllocator = nullptr;
+        UploadQueue* m_pUploadQueue = nullptr;
+        BufferDefragmenter* m_pDefragmenter = nullptr;
+        bool m_writeDirectly = false;
+
+        uint32_t m_vertexStride = 0;
+        uint32_t m_meshCount = 0;
+        Region m_vertices;
+        Region m_indices;
+    };
+}
@@ -0,0 +1,483 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+
+#pragma warning(disable: 4834) // allow ignoring nodiscard
+
+namespace GAP311
+{
+
+bool DeviceMemoryAllocator::Initialize(vk::PhysicalDevice physicalDevice, vk::Device device, bool memoryBudgetEnabled, vk::DeviceSize preferredBlockSize)
+{
+    m_physicalDevice = physicalDevice;
+    m_device = device;
+    m_memoryBudgetEnabled = memoryBudgetEnabled;
+    m_categoryBytes = {};
+    m_memoryProperties = physicalDevice.getMemoryProperties();
+    m_nonCoherentAtomSize = std::max<vk::DeviceSize>(physicalDevice.getProperties().limits.nonCoherentAtomSize, 1);
+
+    // Block sizes must be powers of two for the buddy allocator
+    vk::DeviceSize blockSize = s_kMinAllocationSize;
+    while ((blockSize << 1) <= preferredBlockSize)
+        blockSize <<= 1;
+
+    // Small heaps (e.g. the 256MB device local + host visible heap) get smaller blocks
+    // so that a single block never claims a large share of them
+    m_blockSizes.resize(m_memoryProperties.memoryTypeCount);
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        vk::DeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[i].heapIndex].size;
+        vk::DeviceSize typeBlockSize = blockSize;
+        while (typeBlockSize > s_kMinAllocationSize && typeBlockSize > heapSize / 8)
+            typeBlockSize >>= 1;
+        m_blockSizes[i] = typeBlockSize;
+    }
+
+    return true;
+}
+
+void DeviceMemoryAllocator::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (uint32_t i = 0; i < m_blocks.size(); ++i)
+    {
+        if (m_blocks[i])
+            DestroyBlock(i);
+    }
+    m_blocks.clear();
+    m_device = nullptr;
+}
+
+bool DeviceMemoryAllocator::Allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags requiredFlags,
+    vk::MemoryPropertyFlags preferredFlags, ResourceTiling tiling, MemoryCategory category, MemoryAllocation& allocation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Rounding up to a power of two no smaller than the alignment keeps buddy offsets aligned
+    vk::DeviceSize size = s_kMinAllocationSize;
+    while (size < requirements.size || size < requirements.alignment)
+        size <<= 1;
+
+    vk::MemoryPropertyFlags candidates[] = { requiredFlags | preferredFlags, requiredFlags };
+    for (vk::MemoryPropertyFlags flags : candidates)
+    {
+        int32_t memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, flags);
+        if (memoryTypeIndex < 0)
+            continue;
+
+        uint32_t blockIndex = 0;
+        vk::DeviceSize offset = 0;
+        Block* pBlock = nullptr;
+
+        if (size > m_blockSizes[memoryTypeIndex])
+        {
+            pBlock = CreateBlock(memoryTypeIndex, tiling, requirements.size, true, blockIndex);
+            if (pBlock)
+            {
+                pBlock->allocations[0] = { 0, requirements.size };
+                pBlock->usedBytes = pBlock->requestedBytes = requirements.size;
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < m_blocks.size(); ++i)
+            {
+                Block* pCandidate = m_blocks[i].get();
+                if (pCandidate && !pCandidate->dedicated && pCandidate->memoryTypeIndex == (uint32_t)memoryTypeIndex &&
+                    pCandidate->tiling == tiling && AllocateFromBlock(*pCandidate, size, requirements.size, offset))
+                {
+                    pBlock = pCandidate;
+                    blockIndex = i;
+                    break;
+                }
+            }
+
+            if (!pBlock)
+            {
+                pBlock = CreateBlock(memoryTypeIndex, tiling, m_blockSizes[memoryTypeIndex], false, blockIndex);
+                if (pBlock && !AllocateFromBlock(*pBlock, size, requirements.size, offset))
+                    pBlock = nullptr;
+            }
+        }
+
+        if (!pBlock)
+            continue;   // out of memory in this type, try the next candidate
+
+        allocation.memory = pBlock->memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.pMapped = pBlock->pMapped ? static_cast<uint8_t*>(pBlock->pMapped) + offset : nullptr;
+        allocation.memoryTypeIndex = pBlock->memoryTypeIndex;
+        allocation.blockIndex = blockIndex;
+        allocation.category = category;
+        m_categoryBytes[size_t(category)] += requirements.size;
+        return true;
+    }
+
+    return false;
+}
+
+void DeviceMemoryAllocator::Free(MemoryAllocation& allocation)
+{
+    if (!allocation)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_categoryBytes[size_t(allocation.category)] -= allocation.size;
+
+    Block& block = *m_blocks[allocation.blockIndex];
+    auto it = block.allocations.find(allocation.offset);
+    if (it != block.allocations.end())
+    {
+        uint32_t order = it->second.first;
+        vk::DeviceSize offset = allocation.offset;
+        block.requestedBytes -= it->second.second;
+        block.allocations.erase(it);
+
+        if (!block.dedicated)
+        {
+            block.usedBytes -= s_kMinAllocationSize << order;
+
+            // Merge with the buddy for as long as it is free as well
+            while (order + 1 < block.freeLists.size())
+            {
+                vk::DeviceSize buddy = offset ^ (s_kMinAllocationSize << order);
+                if (block.freeLists[order].erase(buddy) == 0)
+                    break;
+                offset = std::min(offset, buddy);
+                ++order;
+            }
+            block.freeLists[order].insert(offset);
+        }
+        else
+        {
+            block.usedBytes = 0;
+        }
+    }
+
+    if (block.allocations.empty())
+    {
+        // Keep a single empty block around per memory type so that alternating
+        // allocate/free at a block boundary doesn't hit vkAllocateMemory every time
+        bool keep = !block.dedicated;
+        for (uint32_t i = 0; keep && i < m_blocks.size(); ++i)
+        {
+            const Block* pOther = m_blocks[i].get();
+            if (i != allocation.blockIndex && pOther && !pOther->dedicated && pOther->allocations.empty() &&
+                pOther->memoryTypeIndex == block.memoryTypeIndex && pOther->tiling == block.tiling)
+                keep = false;
+        }
+
+        if (!keep)
+            DestroyBlock(allocation.blockIndex);
+    }
+
+    allocation = MemoryAllocation();
+}
+
+void DeviceMemoryAllocator::Flush(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size)
+{
+    if (!allocation || (GetMemoryTypeFlags(allocation.memoryTypeIndex) & vk::MemoryPropertyFlagBits::eHostCoherent))
+        return;
+
+    vk::DeviceSize blockSize = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        blockSize = m_blocks[allocation.blockIndex]->size;
+    }
+
+    // Flushed ranges must be multiples of nonCoherentAtomSize
+    vk::DeviceSize begin = allocation.offset + offset;
+    vk::DeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : begin + size;
+    begin = begin / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    end = std::min((end + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize, blockSize);
+
+    vk::MappedMemoryRange mappedRange;
+    mappedRange.memory = allocation.memory;
+    mappedRange.offset = begin;
+    mappedRange.size = end - begin;
+    m_device.flushMappedMemoryRanges(mappedRange);
+}
+
+vk::MemoryPropertyFlags DeviceMemoryAllocator::GetMemoryTypeFlags(uint32_t memoryTypeIndex) const
+{
+    return m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+}
+
+DeviceMemoryAllocator::Stats DeviceMemoryAllocator::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Stats stats;
+    stats.categoryBytes = m_categoryBytes;
+    stats.memoryTypes.resize(m_memoryProperties.memoryTypeCount);
+    for (auto& pBlock : m_blocks)
+    {
+        if (!pBlock)
+            continue;
+
+        Stats::MemoryTypeStats& typeStats = stats.memoryTypes[pBlock->memoryTypeIndex];
+        typeStats.blockCount += 1;
+        typeStats.allocationCount += static_cast<uint32_t>(pBlock->allocations.size());
+        typeStats.reservedBytes += pBlock->size;
+        typeStats.usedBytes += pBlock->usedBytes;
+        typeStats.requestedBytes += pBlock->requestedBytes;
+        if (!pBlock->dedicated)
+            typeStats.largestFreeRange = std::max(typeStats.largestFreeRange, pBlock->LargestFreeRange());
+    }
+
+    auto fragmentation = [](vk::DeviceSize freeBytes, vk::DeviceSize largestFreeRange)
+    {
+        return freeBytes > 0 ? 1.0f - float(double(largestFreeRange) / double(freeBytes)) : 0.0f;
+    };
+
+    for (auto& typeStats : stats.memoryTypes)
+    {
+        typeStats.fragmentation = fragmentation(typeStats.reservedBytes - typeStats.usedBytes, typeStats.largestFreeRange);
+
+        stats.blockCount += typeStats.blockCount;
+        stats.allocationCount += typeStats.allocationCount;
+        stats.reservedBytes += typeStats.reservedBytes;
+        stats.usedBytes += typeStats.usedBytes;
+        stats.requestedBytes += typeStats.requestedBytes;
+        stats.largestFreeRange = std::max(stats.largestFreeRange, typeStats.largestFreeRange);
+    }
+    stats.fragmentation = fragmentation(stats.reservedBytes - stats.usedBytes, stats.largestFreeRange);
+
+    return stats;
+}
+
+std::vector<DeviceMemoryAllocator::HeapBudget> DeviceMemoryAllocator::GetHeapBudgets() const
+{
+    std::vector<HeapBudget> budgets(m_memoryProperties.memoryHeapCount);
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        budgets[i].budget = m_memoryProperties.memoryHeaps[i].size;
+        budgets[i].deviceLocal = static_cast<bool>(m_memoryProperties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    }
+
+    if (m_memoryBudgetEnabled)
+    {
+        vk::PhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties;
+        vk::PhysicalDeviceMemoryProperties2 properties;
+        properties.pNext = &budgetProperties;
+        m_physicalDevice.getMemoryProperties2(&properties);
+
+        for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+        {
+            budgets[i].budget = budgetProperties.heapBudget[i];
+            budgets[i].usage = budgetProperties.heapUsage[i];
+        }
+        return budgets;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& pBlock : m_blocks)
+    {
+        if (pBlock)
+            budgets[m_memoryProperties.memoryTypes[pBlock->memoryTypeIndex].heapIndex].usage += pBlock->size;
+    }
+    return budgets;
+}
+
+std::vector<uint32_t> DeviceMemoryAllocator::GetDefragmentationCandidates(float maxUsage) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < m_blocks.size(); ++i)
+    {
+        const Block* pBlock = m_blocks[i].get();
+        if (!pBlock || pBlock->dedicated || pBlock->allocations.empty() || pBlock->usedBytes > vk::DeviceSize(maxUsage * pBlock->size))
+            continue;
+
+        // Only worth it if the other blocks can take everything, no new blocks are created for moves
+        vk::DeviceSize freeElsewhere = 0;
+        for (uint32_t j = 0; j < m_blocks.size(); ++j)
+        {
+            const Block* pOther = m_blocks[j].get();
+            if (j != i && pOther && !pOther->dedicated && pOther->memoryTypeIndex == pBlock->memoryTypeIndex && pOther->tiling == pBlock->tiling)
+                freeElsewhere += pOther->size - pOther->usedBytes;
+        }
+
+        if (freeElsewhere >= pBlock->usedBytes)
+            candidates.push_back(i);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b)
+    {
+        return double(m_blocks[a]->usedBytes) / m_blocks[a]->size < double(m_blocks[b]->usedBytes) / m_blocks[b]->size;
+    });
+    return candidates;
+}
+
+uint32_t DeviceMemoryAllocator::GetBlockAllocationCount(uint32_t blockIndex) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (blockIndex >= m_blocks.size() || !m_blocks[blockIndex])
+        return 0;
+    return static_cast<uint32_t>(m_blocks[blockIndex]->allocations.size());
+}
+
+bool DeviceMemoryAllocator::AllocateForMove(const MemoryAllocation& source, MemoryAllocation& destination)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Block& sourceBlock = *m_blocks[source.blockIndex];
+    auto it = sourceBlock.allocations.find(source.offset);
+    if (sourceBlock.dedicated || it == sourceBlock.allocations.end())
+        return false;
+
+    // Filling the fullest blocks first leaves the sparse ones to be emptied next
+    std::vector<uint32_t> targets;
+    for (uint32_t i = 0; i < m_blocks.size(); ++i)
+    {
+        const Block* pBlock = m_blocks[i].get();
+        if (i != source.blockIndex && pBlock && !pBlock->dedicated &&
+            pBlock->memoryTypeIndex == sourceBlock.memoryTypeIndex && pBlock->tiling == sourceBlock.tiling)
+            targets.push_back(i);
+    }
+    std::sort(targets.begin(), targets.end(), [&](uint32_t a, uint32_t b) { return m_blocks[a]->usedBytes > m_blocks[b]->usedBytes; });
+
+    vk::DeviceSize size = s_kMinAllocationSize << it->second.first;
+    for (uint32_t target : targets)
+    {
+        Block& block = *m_blocks[target];
+        vk::DeviceSize offset = 0;
+        if (!AllocateFromBlock(block, size, it->second.second, offset))
+            continue;
+
+        destination.memory = block.memory;
+        destination.offset = offset;
+        destination.size = source.size;
+        destination.pMapped = block.pMapped ? static_cast<uint8_t*>(block.pMapped) + offset : nullptr;
+        destination.memoryTypeIndex = block.memoryTypeIndex;
+        destination.blockIndex = target;
+        destination.category = source.category;
+        m_categoryBytes[size_t(source.category)] += source.size;
+        return true;
+    }
+
+    return false;
+}
+
+void DeviceMemoryAllocator::ReleaseBlockIfEmpty(uint32_t blockIndex)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (blockIndex < m_blocks.size() && m_blocks[blockIndex] && m_blocks[blockIndex]->allocations.empty())
+        DestroyBlock(blockIndex);
+}
+
+int32_t DeviceMemoryAllocator::FindMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags flags) const
+{
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((memoryTypeBits & (0x1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+            return static_cast<int32_t>(i);
+    }
+
+    return -1;
+}
+
+DeviceMemoryAllocator::Block* DeviceMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, ResourceTiling tiling, vk::DeviceSize size, bool dedicated, uint32_t& blockIndex)
+{
+    vk::MemoryAllocateInfo allocInfo;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    vk::DeviceMemory memory;
+    if (m_device.allocateMemory(&allocInfo, nullptr, &memory) != vk::Result::eSuccess)
+        return nullptr;
+
+    auto pBlock = std::make_unique<Block>();
+    pBlock->memory = memory;
+    pBlock->size = size;
+    pBlock->memoryTypeIndex = memoryTypeIndex;
+    pBlock->tiling = tiling;
+    pBlock->dedicated = dedicated;
+
+    // Host visible blocks stay mapped, allocations just point into the mapping
+    if (GetMemoryTypeFlags(memoryTypeIndex) & vk::MemoryPropertyFlagBits::eHostVisible)
+    {
+        if (m_device.mapMemory(memory, 0, VK_WHOLE_SIZE, {}, &pBlock->pMapped) != vk::Result::eSuccess)
+        {
+            m_device.freeMemory(memory);
+            return nullptr;
+        }
+    }
+
+    if (!dedicated)
+    {
+        uint32_t maxOrder = OrderForSize(size);
+        pBlock->freeLists.resize(maxOrder + 1);
+        pBlock->freeLists[maxOrder].insert(0);
+    }
+
+    // Reuse the slot of a destroyed block so block indices stay small
+    auto freeSlot = std::find(m_blocks.begin(), m_blocks.end(), nullptr);
+    blockIndex = static_cast<uint32_t>(freeSlot - m_blocks.begin());
+    if (freeSlot == m_blocks.end())
+        m_blocks.emplace_back();
+
+    m_blocks[blockIndex] = std::move(pBlock);
+    return m_blocks[blockIndex].get();
+}
+
+void DeviceMemoryAllocator::DestroyBlock(uint32_t blockIndex)
+{
+    Block& block = *m_blocks[blockIndex];
+    if (block.pMapped)
+        m_device.unmapMemory(block.memory);
+    m_device.freeMemory(block.memory);
+    m_blocks[blockIndex] = nullptr;
+}
+
+bool DeviceMemoryAllocator::AllocateFromBlock(Block& block, vk::DeviceSize size, vk::DeviceSize requestedSize, vk::DeviceSize& offset)
+{
+    uint32_t order = OrderForSize(size);
+
+    uint32_t freeOrder = order;
+    while (freeOrder < block.freeLists.size() && block.freeLists[freeOrder].empty())
+        ++freeOrder;
+    if (freeOrder >= block.freeLists.size())
+        return false;
+
+    offset = *block.freeLists[freeOrder].begin();
+    block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+    // Split the larger range, returning the upper halves to the free lists
+    while (freeOrder > order)
+    {
+        --freeOrder;
+        block.freeLists[freeOrder].insert(offset + (s_kMinAllocationSize << freeOrder));
+    }
+
+    block.allocations[offset] = { order, requestedSize };
+    block.usedBytes += size;
+    block.requestedBytes += requestedSize;
+    return true;
+}
+
+vk::DeviceSize DeviceMemoryAllocator::Block::LargestFreeRange() const
+{
+    for (size_t order = freeLists.size(); order > 0; --order)
+    {
+        if (!freeLists[order - 1].empty())
+            return s_kMinAllocationSize << (order - 1);
+    }
+    return 0;
+}
+
+uint32_t DeviceMemoryAllocator::OrderForSize(vk::DeviceSize size)
+{
+    uint32_t order = 0;
+    while ((s_kMinAllocationSize << order) < size)
+        ++order;
+    return order;
+}
+
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <array>
+
+#include <vulkan/vulkan.hpp>
+
+namespace GAP311
+{
+    /// What an allocation is used for, usage is tracked per category
+    enum class MemoryCategory
+    {
+        eMeshes,
+        eTextures,
+        eUniforms,
+        eAttachments,
+        eStaging,
+        eCount
+    };
+
+    /// A range of a larger vk::DeviceMemory block handed out by DeviceMemoryAllocator.
+    /// Bind resources with (memory, offset); pMapped is valid for host visible memory
+    /// which stays mapped for the lifetime of the block.
+    struct MemoryAllocation
+    {
+        vk::DeviceMemory memory;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        void* pMapped = nullptr;
+        uint32_t memoryTypeIndex = 0;
+        uint32_t blockIndex = 0;
+        MemoryCategory category = MemoryCategory::eMeshes;
+
+        explicit operator bool() const { return static_cast<bool>(memory); }
+    };
+
+    /// How the resource bound to an allocation lays out its data.
+    /// Linear and optimal resources never share a block, which keeps them
+    /// bufferImageGranularity apart without any extra padding.
+    enum class ResourceTiling
+    {
+        eLinear,    // buffers and linear images
+        eOptimal,   // optimally tiled images
+    };
+
+    /// Sub-allocates device memory out of large per memory type blocks.
+    ///
+    /// Vulkan implementations only guarantee maxMemoryAllocationCount (often 4096) live
+    /// vk::DeviceMemory objects, and each vkAllocateMemory call is slow. Every block is
+    /// managed by a binary buddy allocator: requests are rounded up to a power of two at
+    /// least as large as their alignment, so every offset handed out is naturally aligned.
+    /// Requests larger than a block get a dedicated block of their own.
+    class DeviceMemoryAllocator
+    {
+    public:
+        struct Stats
+        {
+            struct MemoryTypeStats
+            {
+                uint32_t blockCount = 0;
+                uint32_t allocationCount = 0;
+                vk::DeviceSize reservedBytes = 0;   // size of every vk::DeviceMemory block
+                vk::DeviceSize usedBytes = 0;       // bytes handed out, including power of two rounding
+                vk::DeviceSize requestedBytes = 0;  // bytes asked for by callers
+                vk::DeviceSize largestFreeRange = 0;
+                float fragmentation = 0.0f;         // 1 - largestFreeRange / free bytes, 0 when all free space is contiguous
+            };
+
+            uint32_t blockCount = 0;
+            uint32_t allocationCount = 0;
+            vk::DeviceSize reservedBytes = 0;
+            vk::DeviceSize usedBytes = 0;
+            vk::DeviceSize requestedBytes = 0;
+            vk::DeviceSize largestFreeRange = 0;
+            float fragmentation = 0.0f;
+            std::vector<MemoryTypeStats> memoryTypes;
+            std::array<vk::DeviceSize, size_t(MemoryCategory::eCount)> categoryBytes = {};    // requested bytes per category
+        };
+
+        struct HeapBudget
+        {
+            vk::DeviceSize budget = 0;  // how much the process can use before running into trouble
+            vk::DeviceSize usage = 0;   // how much the process uses, including memory from other allocators
+            bool deviceLocal = false;
+        };
+
+        /// memoryBudgetEnabled tells whether VK_EXT_memory_budget was enabled on the device
+        bool Initialize(vk::PhysicalDevice physicalDevice, vk::Device device, bool memoryBudgetEnabled,
+            vk::DeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+        void Shutdown();
+
+        /// Finds a memory type with all of the required flags, favouring one that also has the preferred flags
+        bool Allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags requiredFlags,
+            vk::MemoryPropertyFlags preferredFlags, ResourceTiling tiling, MemoryCategory category, MemoryAllocation& allocation);
+        void Free(MemoryAllocation& allocation);
+
+        /// Makes CPU writes through pMapped visible to the device, a no-op on coherent memory
+        void Flush(const MemoryAllocation& allocation, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+
+        vk::MemoryPropertyFlags GetMemoryTypeFlags(uint32_t memoryTypeIndex) const;
+        Stats GetStats() const;
+
+        /// Per heap budget and usage as reported by VK_EXT_memory_budget. Without the extension
+        /// the budget is the heap size and the usage is what this allocator has reserved.
+        std::vector<HeapBudget> GetHeapBudgets() const;
+
+        /// Defragmentation support, see BufferDefragmenter.
+        /// Candidates are blocks no more than maxUsage full whose allocations would fit into the
+        /// free space of the other blocks of their memory type, sparsest first.
+        std::vector<uint32_t> GetDefragmentationCandidates(float maxUsage) const;
+        uint32_t GetBlockAllocationCount(uint32_t blockIndex) const;
+        /// Reserves room for the contents of source in another existing block of the same memory type,
+        /// preferring the fullest blocks. Never creates a block.
+        bool AllocateForMove(const MemoryAllocation& source, MemoryAllocation& destination);
+        /// Frees a block which has been emptied, even if it is the last empty block of its type
+        void ReleaseBlockIfEmpty(uint32_t blockIndex);
+
+    private:
+        static constexpr vk::DeviceSize s_kMinAllocationSize = 256;
+
+        struct Block
+        {
+            vk::DeviceMemory memory;
+            vk::DeviceSize size = 0;
+            void* pMapped = nullptr;
+            uint32_t memoryTypeIndex = 0;
+            ResourceTiling tiling = ResourceTiling::eLinear;
+            bool dedicated = false;
+
+            // freeLists[order] holds offsets of free ranges of size s_kMinAllocationSize << order
+            std::vector<std::set<vk::DeviceSize>> freeLists;
+            // offset -> (order, requested size) of every live allocation
+            std::unordered_map<vk::DeviceSize, std::pair<uint32_t, vk::DeviceSize>> allocations;
+            vk::DeviceSize usedBytes = 0;
+            vk::DeviceSize requestedBytes = 0;
+
+            vk::DeviceSize LargestFreeRange() const;
+        };
+
+        int32_t FindMemoryType(uint32_t memoryTypeBits, vk::MemoryPropertyFlags flags) const;
+        Block* CreateBlock(uint32_t memoryTypeIndex, ResourceTiling tiling, vk::DeviceSize size, bool dedicated, uint32_t& blockIndex);
+        void DestroyBlock(uint32_t blockIndex);
+        bool AllocateFromBlock(Block& block, vk::DeviceSize size, vk::DeviceSize requestedSize, vk::DeviceSize& offset);
+        static uint32_t OrderForSize(vk::DeviceSize size);
+
+        vk::PhysicalDevice m_physicalDevice;
+        vk::Device m_device;
+        bool m_memoryBudgetEnabled = false;
+        vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+        vk::DeviceSize m_nonCoherentAtomSize = 1;
+        std::vector<vk::DeviceSize> m_blockSizes;   // per memory type
+        std::vector<std::unique_ptr<Block>> m_blocks;
+        std::array<vk::DeviceSize, size_t(MemoryCategory::eCount)> m_categoryBytes = {};
+        mutable std::mutex m_mutex;
+    };
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace GAP311
+{
+    /// How many frames the CPU may record ahead of the GPU
+    static constexpr uint32_t s_kMaxFramesInFlight = 2;
+
+    /// One copy of a resource per frame in flight, indexed by the frame index being recorded.
+    ///
+    /// Anything the CPU writes while a frame is recorded must not be read by the frames still
+    /// executing on the GPU. Giving each frame in flight its own copy makes the write safe as
+    /// soon as the fence of that frame index has been waited on, no other synchronization needed.
+    template <typename T>
+    class PerFrame
+    {
+    public:
+        T& operator[](uint32_t frameIndex) { return m_items[frameIndex]; }
+        const T& operator[](uint32_t frameIndex) const { return m_items[frameIndex]; }
+
+        static constexpr uint32_t size() { return s_kMaxFramesInFlight; }
+
+        T* data() { return m_items.data(); }
+        const T* data() const { return m_items.data(); }
+
+        typename std::array<T, s_kMaxFramesInFlight>::iterator begin() { return m_items.begin(); }
+        typename std::array<T, s_kMaxFramesInFlight>::iterator end() { return m_items.end(); }
+        typename std::array<T, s_kMaxFramesInFlight>::const_iterator begin() const { return m_items.begin(); }
+        typename std::array<T, s_kMaxFramesInFlight>::const_iterator end() const { return m_items.end(); }
+
+    private:
+        std::array<T, s_kMaxFramesInFlight> m_items = {};
+    };
+}
@@ -0,0 +1,198 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+#pragma warning(disable: 4834)
+
+namespace GAP311
+{
+
+static constexpr uint32_t s_kFileMagic = 0x43504147; // 'GAPC'
+static constexpr uint32_t s_kFileVersion = 1;
+
+bool PipelineCache::Initialize(vk::Device device, const vk::PhysicalDeviceProperties& properties, const char* pFilename, bool feedbackEnabled)
+{
+    m_device = device;
+    m_properties = properties;
+    m_filename = pFilename;
+    m_feedbackEnabled = feedbackEnabled;
+    m_changed = false;
+    m_stats = Stats();
+    m_stats.feedbackAvailable = feedbackEnabled;
+
+    // A stale or foreign file only costs us the warm start, the cache is created empty instead
+    std::vector<char> data;
+    if (Load(data))
+    {
+        m_stats.loadedFromDisk = true;
+        m_stats.loadedBytes = data.size();
+    }
+    else
+    {
+        data.clear();
+    }
+
+    vk::PipelineCacheCreateInfo cacheInfo;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+    m_cache = m_device.createPipelineCache(cacheInfo);
+    if (!m_cache && !data.empty())
+    {
+        // The driver may still reject data that passed our checks, try again without it
+        m_stats.loadedFromDisk = false;
+        m_stats.loadedBytes = 0;
+        m_cache = m_device.createPipelineCache(vk::PipelineCacheCreateInfo());
+    }
+
+    return static_cast<bool>(m_cache);
+}
+
+void PipelineCache::Shutdown()
+{
+    if (!m_cache)
+        return;
+
+    SaveIfChanged();
+    m_device.destroyPipelineCache(m_cache);
+    m_cache = nullptr;
+    m_device = nullptr;
+}
+
+void PipelineCache::RecordCreation(const vk::PipelineCreationFeedbackEXT& feedback, double milliseconds)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.pipelinesCreated += 1;
+    m_stats.creationMilliseconds += milliseconds;
+    if (m_feedbackEnabled &&
+        (feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid) &&
+        (feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit))
+    {
+        m_stats.cacheHits += 1;
+    }
+
+    // Hits don't add anything to the cache, only misses are worth writing out again
+    if (!m_feedbackEnabled || !(feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit))
+        m_changed = true;
+}
+
+bool PipelineCache::SaveIfChanged()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_changed)
+            return true;
+    }
+    return Save();
+}
+
+bool PipelineCache::Save()
+{
+    if (!m_cache)
+        return false;
+
+    std::vector<uint8_t> data = m_device.getPipelineCacheData(m_cache);
+    if (data.empty())
+        return false;
+
+    FileHeader header;
+    header.magic = s_kFileMagic;
+    header.version = s_kFileVersion;
+    header.driverVersion = m_properties.driverVersion;
+    header.dataSize = static_cast<uint32_t>(data.size());
+    header.checksum = Checksum(reinterpret_cast<const char*>(data.data()), data.size());
+
+    // Write everything to a temporary file, then swap it in so readers never see a partial file
+
+    std::string tempFilename = m_filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        file.flush();
+        if (!file)
+        {
+            file.close();
+            std::filesystem::remove(tempFilename);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFilename, m_filename, error);
+    if (error)
+    {
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed = false;
+    m_stats.savedBytes = data.size();
+    return true;
+}
+
+PipelineCache::Stats PipelineCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+bool PipelineCache::Load(std::vector<char>& data) const
+{
+    std::ifstream file(m_filename, std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+
+    if (header.magic != s_kFileMagic || header.version != s_kFileVersion || header.dataSize < sizeof(DriverHeader))
+        return false;
+
+    data.resize(header.dataSize);
+    if (!file.read(data.data(), data.size()))
+        return false;
+
+    return IsCompatible(header, data);
+}
+
+bool PipelineCache::IsCompatible(const FileHeader& header, const std::vector<char>& data) const
+{
+    // A truncated or corrupted file fails the checksum
+    if (header.checksum != Checksum(data.data(), data.size()))
+        return false;
+
+    // Caches from another driver version are rejected by most drivers anyway, but not all of them safely
+    if (header.driverVersion != m_properties.driverVersion)
+        return false;
+
+    DriverHeader driverHeader;
+    std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+
+    return driverHeader.headerSize >= sizeof(DriverHeader) &&
+        driverHeader.headerVersion == static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) &&
+        driverHeader.vendorID == m_properties.vendorID &&
+        driverHeader.deviceID == m_properties.deviceID &&
+        std::memcmp(driverHeader.pipelineCacheUUID, m_properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
+
+uint64_t PipelineCache::Checksum(const char* pData, size_t size)
+{
+    // FNV-1a, only meant to catch damaged files
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<uint8_t>(pData[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+}
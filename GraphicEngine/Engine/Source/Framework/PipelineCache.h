@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include <vulkan/vulkan.hpp>
+
+namespace GAP311
+{
+    /// Owns the vk::PipelineCache every pipeline is created through, persisted to a file between runs.
+    ///
+    /// The file is only used to seed the cache when it was written by the same vendor, device, driver
+    /// version and pipeline cache UUID, anything else is dropped and the cache starts out empty. Data is
+    /// written to a temporary file first and renamed over the old one, so a crash mid-save leaves the
+    /// previous cache intact. With VK_EXT_pipeline_creation_feedback enabled the driver reports whether
+    /// each pipeline was served from the cache, which is used to track the hit rate.
+    class PipelineCache
+    {
+    public:
+        struct Stats
+        {
+            bool loadedFromDisk = false;
+            size_t loadedBytes = 0;
+            size_t savedBytes = 0;
+            uint32_t pipelinesCreated = 0;
+            uint32_t cacheHits = 0;             // only counted when creation feedback is available
+            bool feedbackAvailable = false;
+            double creationMilliseconds = 0.0;  // total time spent in createGraphicsPipeline
+        };
+
+        bool Initialize(vk::Device device, const vk::PhysicalDeviceProperties& properties, const char* pFilename, bool feedbackEnabled);
+        /// Writes the cache back to disk and destroys it
+        void Shutdown();
+
+        vk::PipelineCache Get() const { return m_cache; }
+        bool IsFeedbackEnabled() const { return m_feedbackEnabled; }
+
+        /// Call after each pipeline creation, feedback is ignored unless feedback is enabled
+        void RecordCreation(const vk::PipelineCreationFeedbackEXT& feedback, double milliseconds);
+
+        /// Writes the cache to disk if pipelines were created since the last save
+        bool SaveIfChanged();
+        bool Save();
+
+        Stats GetStats() const;
+
+    private:
+        /// Prefixed to the driver's data, the driver's own header doesn't carry its version
+        struct FileHeader
+        {
+            uint32_t magic = 0;
+            uint32_t version = 0;
+            uint32_t driverVersion = 0;
+            uint32_t dataSize = 0;
+            uint64_t checksum = 0;
+        };
+
+        /// Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE at the start of the driver's data
+        struct DriverHeader
+        {
+            uint32_t headerSize;
+            uint32_t headerVersion;
+            uint32_t vendorID;
+            uint32_t deviceID;
+            uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        };
+
+        bool Load(std::vector<char>& data) const;
+        bool IsCompatible(const FileHeader& header, const std::vector<char>& data) const;
+        static uint64_t Checksum(const char* pData, size_t size);
+
+        vk::Device m_device;
+        vk::PhysicalDeviceProperties m_properties;
+        std::string m_filename;
+        vk::PipelineCache m_cache;
+        bool m_feedbackEnabled = false;
+        bool m_changed = false;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
@@ -0,0 +1,311 @@
+#include "PipelineLibrary.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace GAP311
+{
+
+static void HashCombine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+PipelineLibrary::PipelineLibrary(PrepareFunction prepare, CompileFunction compile, DestroyFunction destroy)
+    : m_prepare(std::move(prepare))
+    , m_compile(std::move(compile))
+    , m_destroy(std::move(destroy))
+{
+}
+
+std::shared_ptr<PipelineObjects> PipelineLibrary::Acquire(const PipelineDescription& desc)
+{
+    bool shared = !OwnsResources(desc);
+    PipelineDescription key = shared ? Normalize(desc) : desc;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stats.requests += 1;
+
+        std::shared_future<bool> compiled;
+        if (auto pPipeline = shared ? Find(key, compiled) : nullptr)
+        {
+            m_stats.hits += 1;
+            lock.unlock();
+            return !compiled.valid() || compiled.get() ? pPipeline : nullptr;
+        }
+    }
+
+    // Neither preparing nor compiling holds the lock, other threads keep acquiring pipelines meanwhile
+    auto pPipeline = Prepare(key);
+    if (!pPipeline)
+        return nullptr;
+    if (!shared)
+        return m_compile(key, *pPipeline) ? pPipeline : nullptr;
+
+    std::promise<bool> compiling;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // Another thread may have started the same pipeline while this one prepared it
+        std::shared_future<bool> compiled;
+        if (auto pExisting = Find(key, compiled))
+        {
+            m_stats.hits += 1;
+            lock.unlock();
+            return !compiled.valid() || compiled.get() ? pExisting : nullptr;
+        }
+
+        // Published before compiling, requests in the meantime wait on this compilation
+        PruneExpired();
+        m_pipelines[key] = { pPipeline, compiling.get_future().share() };
+    }
+
+    bool compiled = m_compile(key, *pPipeline);
+    compiling.set_value(compiled);
+    return compiled ? pPipeline : nullptr;
+}
+
+PipelineLibrary::PipelineFuture PipelineLibrary::AcquireAsync(const PipelineDescription& desc, ThreadPool& pool)
+{
+    Pending pending = AcquirePending(desc, pool);
+    return MakeFuture(std::move(pending.pipeline), std::move(pending.compiled));
+}
+
+PipelineLibrary::Pending PipelineLibrary::AcquirePending(const PipelineDescription& desc, ThreadPool& pool)
+{
+    bool shared = !OwnsResources(desc);
+    PipelineDescription key = shared ? Normalize(desc) : desc;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.requests += 1;
+
+        std::shared_future<bool> compiled;
+        if (auto pPipeline = shared ? Find(key, compiled) : nullptr)
+        {
+            m_stats.hits += 1;
+            return { std::move(pPipeline), std::move(compiled) };
+        }
+    }
+
+    auto pPipeline = Prepare(key);
+    if (!pPipeline)
+        return {};
+
+    // Submitting only queues the task, the lock is never held while a pipeline compiles
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (shared)
+    {
+        std::shared_future<bool> compiled;
+        if (auto pExisting = Find(key, compiled))
+        {
+            m_stats.hits += 1;
+            return { std::move(pExisting), std::move(compiled) };
+        }
+    }
+
+    // The task holds a reference, so the pipeline can't be destroyed while it is being compiled
+    std::shared_future<bool> compiled = pool.Submit([compile = m_compile, key, pPipeline]() { return compile(key, *pPipeline); }).share();
+
+    if (shared)
+    {
+        PruneExpired();
+        m_pipelines[key] = { pPipeline, compiled };
+    }
+    return { std::move(pPipeline), std::move(compiled) };
+}
+
+PipelineLibrary::Stats PipelineLibrary::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    stats.pipelineCount = std::count_if(m_pipelines.begin(), m_pipelines.end(), [](const auto& entry) { return !entry.second.pipeline.expired(); });
+    return stats;
+}
+
+std::vector<PipelineLibrary::Compiled> PipelineLibrary::FindUsingShader(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Compiled> pipelines;
+    for (auto& [desc, entry] : m_pipelines)
+    {
+        if (desc.vertexShaderFilename != path && desc.fragmentShaderFilename != path && desc.geometryShaderFilename != path)
+            continue;
+
+        const auto& compiled = entry.compiled;
+        if (compiled.valid() && compiled.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !compiled.get())
+            continue;
+
+        if (auto pPipeline = entry.pipeline.lock())
+            pipelines.push_back({ desc, std::move(pPipeline), compiled });
+    }
+    return pipelines;
+}
+
+PipelineDescription PipelineLibrary::Normalize(const PipelineDescription& desc)
+{
+    PipelineDescription key = desc;
+
+    std::sort(key.vertexAttributes.begin(), key.vertexAttributes.end(),
+        [](const auto& a, const auto& b) { return a.location < b.location; });
+    std::sort(key.specializationConstants.begin(), key.specializationConstants.end(),
+        [](const auto& a, const auto& b) { return a.name < b.name; });
+
+    if (key.useSceneLayout)
+    {
+        key.uniformBuffers.clear();
+        key.uniformImages.clear();
+        key.pushConstants.clear();
+    }
+    else
+    {
+        std::sort(key.uniformBuffers.begin(), key.uniformBuffers.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+        std::sort(key.uniformImages.begin(), key.uniformImages.end(), [](const auto& a, const auto& b) { return a.binding < b.binding; });
+        std::sort(key.pushConstants.begin(), key.pushConstants.end(), [](const auto& a, const auto& b) { return a.offset < b.offset; });
+    }
+
+    if (key.vertexAttributes.empty())
+        key.vertexStride = 0;
+
+    return key;
+}
+
+bool PipelineLibrary::OwnsResources(const PipelineDescription& desc)
+{
+    return !desc.useSceneLayout &&
+        std::any_of(desc.uniformBuffers.begin(), desc.uniformBuffers.end(), [](const auto& buffer) { return !buffer.dynamic; });
+}
+
+std::shared_ptr<PipelineObjects> PipelineLibrary::Prepare(const PipelineDescription& desc)
+{
+    std::lock_guard<std::mutex> lock(m_prepareMutex);
+
+    PipelineObjects* pPipeline = new PipelineObjects();
+    if (!m_prepare(desc, *pPipeline))
+    {
+        m_destroy(*pPipeline);
+        delete pPipeline;
+        return nullptr;
+    }
+
+    // The library may be gone by the time the last reference is dropped, the destroy function is kept alive.
+    // A pipeline whose compilation failed is destroyed the same way, the handle is simply null.
+    DestroyFunction destroy = m_destroy;
+    return std::shared_ptr<PipelineObjects>(pPipeline, [destroy](PipelineObjects* pPipeline)
+    {
+        destroy(*pPipeline);
+        delete pPipeline;
+    });
+}
+
+std::shared_ptr<PipelineObjects> PipelineLibrary::Find(const PipelineDescription& key, std::shared_future<bool>& outCompiled)
+{
+    auto it = m_pipelines.find(key);
+    if (it == m_pipelines.end())
+        return nullptr;
+
+    auto pPipeline = it->second.pipeline.lock();
+    if (!pPipeline)
+        return nullptr;
+
+    // A failed compilation isn't handed out again, the next request gets another attempt
+    const auto& compiled = it->second.compiled;
+    if (compiled.valid() && compiled.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !compiled.get())
+        return nullptr;
+
+    outCompiled = compiled;
+    return pPipeline;
+}
+
+void PipelineLibrary::PruneExpired()
+{
+    for (auto it = m_pipelines.begin(); it != m_pipelines.end();)
+    {
+        if (it->second.pipeline.expired())
+            it = m_pipelines.erase(it);
+        else
+            ++it;
+    }
+}
+
+PipelineLibrary::PipelineFuture PipelineLibrary::MakeFuture(std::shared_ptr<PipelineObjects> pPipeline, std::shared_future<bool> compiled)
+{
+    if (!compiled.valid())
+    {
+        std::promise<std::shared_ptr<PipelineObjects>> ready;
+        ready.set_value(std::move(pPipeline));
+        return ready.get_future().share();
+    }
+
+    // Deferred, the waiting happens on whichever thread asks for the result
+    return std::async(std::launch::deferred, [pPipeline, compiled]() { return compiled.get() ? pPipeline : nullptr; }).share();
+}
+
+size_t PipelineLibrary::KeyHash::operator()(const PipelineDescription& desc) const
+{
+    size_t seed = 0;
+    for (const auto& attribute : desc.vertexAttributes)
+    {
+        HashCombine(seed, attribute.location);
+        HashCombine(seed, static_cast<size_t>(attribute.format));
+        HashCombine(seed, attribute.offset);
+    }
+    HashCombine(seed, desc.vertexStride);
+
+    for (const auto& buffer : desc.uniformBuffers)
+    {
+        HashCombine(seed, buffer.binding);
+        HashCombine(seed, buffer.byteSize);
+        HashCombine(seed, buffer.dynamic);
+    }
+    for (const auto& image : desc.uniformImages)
+    {
+        HashCombine(seed, image.binding);
+        HashCombine(seed, image.byteSize);
+    }
+    for (const auto& pushConstant : desc.pushConstants)
+    {
+        HashCombine(seed, static_cast<VkShaderStageFlags>(pushConstant.stages));
+        HashCombine(seed, pushConstant.offset);
+        HashCombine(seed, pushConstant.byteSize);
+    }
+
+    std::hash<std::string> hashString;
+    HashCombine(seed, hashString(desc.vertexShaderFilename));
+    HashCombine(seed, hashString(desc.fragmentShaderFilename));
+    HashCombine(seed, hashString(desc.geometryShaderFilename));
+    for (const auto& constant : desc.specializationConstants)
+    {
+        HashCombine(seed, hashString(constant.name));
+        HashCombine(seed, constant.value);
+    }
+    HashCombine(seed, desc.wireframeMode);
+    HashCombine(seed, desc.alphaBlend);
+    HashCombine(seed, desc.useSceneLayout);
+    return seed;
+}
+
+bool PipelineLibrary::KeyEqual::operator()(const PipelineDescription& a, const PipelineDescription& b) const
+{
+    auto sameAttribute = [](const auto& x, const auto& y) { return x.location == y.location && x.format == y.format && x.offset == y.offset; };
+    auto sameBuffer = [](const auto& x, const auto& y) { return x.binding == y.binding && x.byteSize == y.byteSize && x.dynamic == y.dynamic; };
+    auto sameImage = [](const auto& x, const auto& y) { return x.binding == y.binding && x.byteSize == y.byteSize; };
+    auto samePushConstant = [](const auto& x, const auto& y) { return x.stages == y.stages && x.offset == y.offset && x.byteSize == y.byteSize; };
+    auto sameConstant = [](const auto& x, const auto& y) { return x.name == y.name && x.value == y.value; };
+
+    return a.vertexStride == b.vertexStride &&
+        a.wireframeMode == b.wireframeMode &&
+        a.alphaBlend == b.alphaBlend &&
+        a.useSceneLayout == b.useSceneLayout &&
+        a.vertexShaderFilename == b.vertexShaderFilename &&
+        a.fragmentShaderFilename == b.fragmentShaderFilename &&
+        a.geometryShaderFilename == b.geometryShaderFilename &&
+        std::equal(a.vertexAttributes.begin(), a.vertexAttributes.end(), b.vertexAttributes.begin(), b.vertexAttributes.end(), sameAttribute) &&
+        std::equal(a.uniformBuffers.begin(), a.uniformBuffers.end(), b.uniformBuffers.begin(), b.uniformBuffers.end(), sameBuffer) &&
+        std::equal(a.uniformImages.begin(), a.uniformImages.end(), b.uniformImages.begin(), b.uniformImages.end(), sameImage) &&
+        std::equal(a.pushConstants.begin(), a.pushConstants.end(), b.pushConstants.begin(), b.pushConstants.end(), samePushConstant) &&
+        std::equal(a.specializationConstants.begin(), a.specializationConstants.end(),
+            b.specializationConstants.begin(), b.specializationConstants.end(), sameConstant);
+}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <unordered_map>
+
+#include "Framework.h"
+#include "ThreadPool.h"
+
+namespace GAP311
+{
+    /// Shares one set of PipelineObjects between every user of an equivalent PipelineDescription.
+    ///
+    /// Descriptions are normalized (attributes, bindings and constants sorted, state the pipeline ignores
+    /// cleared) before they are hashed and compared, so descriptions which only differ in the
+    /// order things were added still share a pipeline. The library only keeps weak references,
+    /// a pipeline is destroyed as soon as the last object using it lets go.
+    ///
+    /// Creation is split in two: preparing the layout and descriptors happens on the calling thread,
+    /// compiling the pipeline may happen on a worker thread. Requests for a pipeline which is still
+    /// compiling share the compilation already in flight. Neither step holds the library's lock, so
+    /// looking up a pipeline never waits on another one being created.
+    class PipelineLibrary
+    {
+    public:
+        /// Creates the layout and descriptors, only called on the thread acquiring the pipeline and
+        /// never by two threads at once
+        using PrepareFunction = std::function<bool(const PipelineDescription&, PipelineObjects&)>;
+        /// Creates the pipeline itself, must be safe to call from several threads at once
+        using CompileFunction = std::function<bool(const PipelineDescription&, PipelineObjects&)>;
+        using DestroyFunction = std::function<void(PipelineObjects&)>;
+        using PipelineFuture = std::shared_future<std::shared_ptr<PipelineObjects>>;
+
+        struct Stats
+        {
+            size_t pipelineCount = 0;   // distinct pipelines alive
+            uint64_t requests = 0;
+            uint64_t hits = 0;          // requests served by an existing pipeline
+        };
+
+        PipelineLibrary(PrepareFunction prepare, CompileFunction compile, DestroyFunction destroy);
+
+        /// Returns the pipeline once it is compiled, waiting on a compilation in flight if need be
+        std::shared_ptr<PipelineObjects> Acquire(const PipelineDescription& desc);
+        /// Compiles the pipeline on pool, the future yields null if compilation failed
+        PipelineFuture AcquireAsync(const PipelineDescription& desc, ThreadPool& pool);
+
+        struct Pending
+        {
+            std::shared_ptr<PipelineObjects> pipeline;  // null if the layout couldn't be created
+            std::shared_future<bool> compiled;          // invalid when already compiled
+        };
+        /// Same as AcquireAsync, but compilation can be polled without ever blocking
+        Pending AcquirePending(const PipelineDescription& desc, ThreadPool& pool);
+        Stats GetStats() const;
+
+        struct Compiled
+        {
+            PipelineDescription desc;
+            std::shared_ptr<PipelineObjects> pipeline;
+            std::shared_future<bool> compiled;  // invalid or ready once the pipeline is compiled
+        };
+        /// Shared pipelines alive whose description names the shader at path, including those still
+        /// compiling. Failed ones are left out, as are those owning resources which the library doesn't track.
+        std::vector<Compiled> FindUsingShader(const std::string& path) const;
+
+        static PipelineDescription Normalize(const PipelineDescription& desc);
+        /// Whether pipelines of the description carry per-object state and can't be shared
+        static bool OwnsResources(const PipelineDescription& desc);
+
+    private:
+        struct KeyHash
+        {
+            size_t operator()(const PipelineDescription& desc) const;
+        };
+        struct KeyEqual
+        {
+            bool operator()(const PipelineDescription& a, const PipelineDescription& b) const;
+        };
+
+        struct Entry
+        {
+            std::weak_ptr<PipelineObjects> pipeline;
+            std::shared_future<bool> compiled;  // set once compiled, on a worker or the acquiring thread
+        };
+
+        std::shared_ptr<PipelineObjects> Prepare(const PipelineDescription& desc);
+        /// Existing pipeline for key, null if there is none or its compilation failed
+        std::shared_ptr<PipelineObjects> Find(const PipelineDescription& key, std::shared_future<bool>& outCompiled);
+        /// Drops entries whose pipeline was destroyed
+        void PruneExpired();
+        static PipelineFuture MakeFuture(std::shared_ptr<PipelineObjects> pPipeline, std::shared_future<bool> compiled);
+
+        PrepareFunction m_prepare;
+        CompileFunction m_compile;
+        DestroyFunction m_destroy;
+        std::unordered_map<PipelineDescription, Entry, KeyHash, KeyEqual> m_pipelines;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+        std::mutex m_prepareMutex;  // only held while preparing, never while compiling
+    };
+}
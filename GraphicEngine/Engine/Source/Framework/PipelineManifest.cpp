@@ -0,0 +1,263 @@
+#include "PipelineManifest.h"
+#include "PipelineLibrary.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+#pragma warning(disable: 4834)
+
+namespace GAP311
+{
+
+// Bump when the format changes, an older file is then ignored and recorded again
+static constexpr const char* s_kFileHeader = "GAP311 pipeline manifest 1";
+static constexpr const char* s_kEntryBegin = "pipeline";
+static constexpr const char* s_kEntryEnd = "end";
+
+bool PipelineManifest::Initialize(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_filename = filename;
+    m_entries.clear();
+    m_entrySet.clear();
+    m_changed = false;
+    m_stats = Stats();
+
+    std::ifstream file(m_filename);
+    std::string line;
+    if (!file || !std::getline(file, line) || line != s_kFileHeader)
+        return true;
+
+    // One entry per block of lines, from "pipeline" to "end"
+    std::string entry;
+    bool inEntry = false;
+    while (std::getline(file, line))
+    {
+        if (line == s_kEntryBegin)
+        {
+            entry.clear();
+            inEntry = true;
+        }
+        else if (line == s_kEntryEnd && inEntry)
+        {
+            // Entries are kept in the form Serialize writes, which is what Record compares against
+            PipelineDescription desc;
+            if (Parse(entry, desc))
+            {
+                std::string serialized = Serialize(desc);
+                if (m_entrySet.insert(serialized).second)
+                    m_entries.push_back(std::move(serialized));
+            }
+            inEntry = false;
+        }
+        else if (inEntry)
+        {
+            entry += line;
+            entry += '\n';
+        }
+    }
+
+    m_stats.loadedCount = m_entries.size();
+    return true;
+}
+
+void PipelineManifest::Shutdown()
+{
+    SaveIfChanged();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_entrySet.clear();
+}
+
+bool PipelineManifest::Record(const PipelineDescription& desc)
+{
+    std::string serialized = Serialize(PipelineLibrary::Normalize(desc));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_entrySet.insert(serialized).second)
+        return false;
+
+    m_entries.push_back(std::move(serialized));
+    m_stats.recordedCount += 1;
+    m_changed = true;
+    return true;
+}
+
+std::vector<PipelineDescription> PipelineManifest::GetEntries() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<PipelineDescription> descs(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i)
+        Parse(m_entries[i], descs[i]);
+    return descs;
+}
+
+bool PipelineManifest::SaveIfChanged()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_changed)
+            return true;
+    }
+    return Save();
+}
+
+bool PipelineManifest::Save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_filename.empty())
+        return false;
+
+    // Write everything to a temporary file, then swap it in so readers never see a partial file
+
+    std::string tempFilename = m_filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::out | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file << s_kFileHeader << '\n';
+        for (const std::string& entry : m_entries)
+            file << s_kEntryBegin << '\n' << entry << s_kEntryEnd << '\n';
+        if (!file)
+            return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFilename, m_filename, error);
+    if (error)
+        return false;
+
+    m_changed = false;
+    return true;
+}
+
+PipelineManifest::Stats PipelineManifest::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Stats stats = m_stats;
+    stats.pipelineCount = m_entries.size();
+    return stats;
+}
+
+std::string PipelineManifest::Serialize(const PipelineDescription& desc)
+{
+    // One property per line, file names take the rest of their line so they may contain spaces
+    std::ostringstream text;
+    text << "vertex " << desc.vertexShaderFilename << '\n';
+    text << "fragment " << desc.fragmentShaderFilename << '\n';
+    if (!desc.geometryShaderFilename.empty())
+        text << "geometry " << desc.geometryShaderFilename << '\n';
+    text << "stride " << desc.vertexStride << '\n';
+    for (const auto& attribute : desc.vertexAttributes)
+        text << "attribute " << attribute.location << ' ' << static_cast<uint32_t>(attribute.format) << ' ' << attribute.offset << '\n';
+    for (const auto& buffer : desc.uniformBuffers)
+        text << "uniform " << buffer.binding << ' ' << buffer.byteSize << ' ' << buffer.dynamic << '\n';
+    for (const auto& image : desc.uniformImages)
+        text << "image " << image.binding << ' ' << image.byteSize << '\n';
+    for (const auto& pushConstant : desc.pushConstants)
+        text << "push " << static_cast<VkShaderStageFlags>(pushConstant.stages) << ' ' << pushConstant.offset << ' ' << pushConstant.byteSize << '\n';
+    for (const auto& constant : desc.specializationConstants)
+        text << "constant " << constant.name << ' ' << constant.value << '\n';
+    text << "wireframe " << desc.wireframeMode << '\n';
+    text << "blend " << desc.alphaBlend << '\n';
+    text << "scene " << desc.useSceneLayout << '\n';
+    return text.str();
+}
+
+bool PipelineManifest::Parse(const std::string& entry, PipelineDescription& outDesc)
+{
+    outDesc = PipelineDescription();
+
+    std::istringstream lines(entry);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space != std::string::npos ? line.substr(space + 1) : std::string();
+        std::istringstream values(value);
+
+        if (key == "vertex")
+        {
+            outDesc.vertexShaderFilename = value;
+        }
+        else if (key == "fragment")
+        {
+            outDesc.fragmentShaderFilename = value;
+        }
+        else if (key == "geometry")
+        {
+            outDesc.geometryShaderFilename = value;
+        }
+        else if (key == "stride")
+        {
+            values >> outDesc.vertexStride;
+        }
+        else if (key == "attribute")
+        {
+            PipelineDescription::VertexAttribute attribute;
+            uint32_t format = 0;
+            values >> attribute.location >> format >> attribute.offset;
+            attribute.format = static_cast<vk::Format>(format);
+            outDesc.vertexAttributes.push_back(attribute);
+        }
+        else if (key == "uniform")
+        {
+            PipelineDescription::UniformBuffer buffer;
+            values >> buffer.binding >> buffer.byteSize >> buffer.dynamic;
+            outDesc.uniformBuffers.push_back(buffer);
+        }
+        else if (key == "image")
+        {
+            PipelineDescription::UniformImage image;
+            values >> image.binding >> image.byteSize;
+            outDesc.uniformImages.push_back(image);
+        }
+        else if (key == "push")
+        {
+            PipelineDescription::PushConstantRange pushConstant;
+            VkShaderStageFlags stages = 0;
+            values >> stages >> pushConstant.offset >> pushConstant.byteSize;
+            pushConstant.stages = vk::ShaderStageFlags(stages);
+            outDesc.pushConstants.push_back(pushConstant);
+        }
+        else if (key == "constant")
+        {
+            PipelineDescription::SpecializationConstant constant;
+            values >> constant.name >> constant.value;
+            outDesc.specializationConstants.push_back(constant);
+        }
+        else if (key == "wireframe")
+        {
+            values >> outDesc.wireframeMode;
+        }
+        else if (key == "blend")
+        {
+            values >> outDesc.alphaBlend;
+        }
+        else if (key == "scene")
+        {
+            values >> outDesc.useSceneLayout;
+        }
+        else
+        {
+            // Written by a newer build, better not to guess what the pipeline looked like
+            return false;
+        }
+
+        // File names aren't read through values, a failed read is always a malformed number
+        if (values.fail())
+            return false;
+    }
+
+    return !outDesc.vertexShaderFilename.empty() && !outDesc.fragmentShaderFilename.empty();
+}
+
+}
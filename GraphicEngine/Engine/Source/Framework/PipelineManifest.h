@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_set>
+
+namespace GAP311
+{
+    struct PipelineDescription;
+
+    /// Every distinct pipeline an app asked for, kept in a text file between runs so the next run can
+    /// compile them all up front instead of on first use.
+    ///
+    /// Descriptions are normalized like the PipelineLibrary does before they are recorded, so a pipeline
+    /// is only listed once however its description was put together. Entries are never dropped, the
+    /// manifest grows to cover every permutation any session has used; delete the file to start over.
+    /// Like the pipeline cache, the file is written to a temporary file first and renamed over the old one.
+    class PipelineManifest
+    {
+    public:
+        struct Stats
+        {
+            size_t pipelineCount = 0;
+            size_t loadedCount = 0;     // read from the file at startup
+            size_t recordedCount = 0;   // first seen this run
+        };
+
+        /// A missing or outdated file leaves the manifest empty
+        bool Initialize(const std::string& filename);
+        /// Writes the manifest if anything was recorded
+        void Shutdown();
+
+        /// Adds the description unless an equivalent one is already listed, returns whether it was new
+        bool Record(const PipelineDescription& desc);
+        std::vector<PipelineDescription> GetEntries() const;
+
+        bool SaveIfChanged();
+        bool Save();
+
+        Stats GetStats() const;
+
+    private:
+        static std::string Serialize(const PipelineDescription& desc);
+        static bool Parse(const std::string& entry, PipelineDescription& outDesc);
+
+        std::string m_filename;
+        std::vector<std::string> m_entries;             // serialized descriptions, in the order first requested
+        std::unordered_set<std::string> m_entrySet;
+        bool m_changed = false;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
@@ -0,0 +1,210 @@
+#include "ResidencyManager.h"
+
+#include <algorithm>
+
+namespace GAP311
+{
+
+void ResidencyManager::Initialize(DeviceMemoryAllocator& allocator, uint32_t framesInFlight)
+{
+    m_pAllocator = &allocator;
+    m_framesInFlight = framesInFlight;
+    m_currentFrame = 0;
+    m_heapUsageAtEviction = 0;
+}
+
+void ResidencyManager::Shutdown()
+{
+    m_streamables.clear();
+    m_freeIds.clear();
+    m_residentBytes = 0;
+    m_pAllocator = nullptr;
+}
+
+ResidencyManager::StreamableId ResidencyManager::Register(MemoryCategory category, vk::DeviceSize size, EvictCallback evict, RestoreCallback restore)
+{
+    StreamableId id;
+    if (!m_freeIds.empty())
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else
+    {
+        id = static_cast<StreamableId>(m_streamables.size());
+        m_streamables.emplace_back();
+    }
+
+    Streamable& streamable = m_streamables[id];
+    streamable.category = category;
+    streamable.size = size;
+    streamable.lastUsedFrame = m_currentFrame;
+    streamable.registered = true;
+    streamable.resident = true;
+    streamable.evict = std::move(evict);
+    streamable.restore = std::move(restore);
+
+    m_residentBytes += size;
+    return id;
+}
+
+void ResidencyManager::Unregister(StreamableId id)
+{
+    if (id >= m_streamables.size() || !m_streamables[id].registered)
+        return;
+
+    if (m_streamables[id].resident)
+        m_residentBytes -= m_streamables[id].size;
+
+    m_streamables[id] = Streamable();
+    m_freeIds.push_back(id);
+}
+
+bool ResidencyManager::Touch(StreamableId id)
+{
+    if (id >= m_streamables.size() || !m_streamables[id].registered)
+        return false;
+
+    Streamable& streamable = m_streamables[id];
+    // Touched ahead of the Update that starts the frame drawing it
+    streamable.lastUsedFrame = m_currentFrame + 1;
+
+    if (!streamable.resident)
+    {
+        if (!streamable.restore())
+            return false;
+
+        streamable.resident = true;
+        m_residentBytes += streamable.size;
+        m_totalRestores += 1;
+    }
+
+    return true;
+}
+
+bool ResidencyManager::MakeRoom(MemoryCategory category, vk::DeviceSize byteCount)
+{
+    vk::DeviceSize released = 0;
+    while (released < byteCount)
+    {
+        vk::DeviceSize evicted = EvictLeastRecentlyUsed(&category);
+        if (evicted == 0)
+            return false;
+        released += evicted;
+    }
+
+    return true;
+}
+
+void ResidencyManager::Update(uint64_t frameNumber)
+{
+    m_currentFrame = frameNumber;
+    m_evictionsThisFrame = 0;
+
+    // Over the streamable budget, evictions count against it directly
+    vk::DeviceSize excess = 0;
+    if (m_budget > 0 && m_residentBytes > m_budget)
+        excess = m_residentBytes - m_budget;
+
+    // Over a heap budget, evictions only help if they give memory back to the driver. Sub-allocated
+    // resources return to their block instead, so another pass is only made once the last one lowered
+    // the heap usage; otherwise every frame would evict everything that isn't in use.
+    vk::DeviceSize heapUsage = 0;
+    vk::DeviceSize heapExcess = GetHeapExcess(heapUsage);
+    if (heapExcess == 0)
+    {
+        m_heapUsageAtEviction = 0;
+    }
+    else if (m_heapUsageAtEviction == 0 || heapUsage < m_heapUsageAtEviction)
+    {
+        m_heapUsageAtEviction = heapUsage;
+        excess = std::max(excess, heapExcess);
+    }
+
+    vk::DeviceSize released = 0;
+    while (released < excess)
+    {
+        vk::DeviceSize evicted = EvictLeastRecentlyUsed(nullptr);
+        if (evicted == 0)
+            break;
+        released += evicted;
+    }
+}
+
+ResidencyManager::Stats ResidencyManager::GetStats() const
+{
+    Stats stats;
+    stats.budget = m_budget;
+    stats.residentBytes = m_residentBytes;
+    stats.evictionsThisFrame = m_evictionsThisFrame;
+    stats.totalEvictions = m_totalEvictions;
+    stats.totalRestores = m_totalRestores;
+
+    for (auto& streamable : m_streamables)
+    {
+        if (!streamable.registered)
+            continue;
+
+        if (streamable.resident)
+        {
+            stats.residentCount += 1;
+            stats.residentCategoryBytes[size_t(streamable.category)] += streamable.size;
+        }
+        else
+        {
+            stats.evictedCount += 1;
+            stats.evictedBytes += streamable.size;
+        }
+    }
+
+    if (m_pAllocator)
+        stats.heaps = m_pAllocator->GetHeapBudgets();
+
+    return stats;
+}
+
+vk::DeviceSize ResidencyManager::GetHeapExcess(vk::DeviceSize& outUsage) const
+{
+    outUsage = 0;
+    if (!m_pAllocator)
+        return 0;
+
+    vk::DeviceSize excess = 0;
+    for (auto& heap : m_pAllocator->GetHeapBudgets())
+    {
+        if (!heap.deviceLocal)
+            continue;
+        outUsage += heap.usage;
+        if (heap.usage > heap.budget && heap.usage - heap.budget > excess)
+            excess = heap.usage - heap.budget;
+    }
+
+    return excess;
+}
+
+vk::DeviceSize ResidencyManager::EvictLeastRecentlyUsed(const MemoryCategory* pCategory)
+{
+    // Only resources no frame in flight can still be reading are candidates
+    Streamable* pOldest = nullptr;
+    for (auto& streamable : m_streamables)
+    {
+        if (!streamable.registered || !streamable.resident || (pCategory && streamable.category != *pCategory))
+            continue;
+        if (streamable.lastUsedFrame + m_framesInFlight > m_currentFrame)
+            continue;
+        if (!pOldest || streamable.lastUsedFrame < pOldest->lastUsedFrame)
+            pOldest = &streamable;
+    }
+
+    if (!pOldest)
+        return 0;
+
+    pOldest->evict();
+    pOldest->resident = false;
+    m_residentBytes -= pOldest->size;
+    m_evictionsThisFrame += 1;
+    m_totalEvictions += 1;
+    return pOldest->size;
+}
+
+}
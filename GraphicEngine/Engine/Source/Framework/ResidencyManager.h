@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <functional>
+
+#include "MemoryAllocator.h"
+
+namespace GAP311
+{
+    /// Keeps streamable GPU resources within a memory budget.
+    ///
+    /// Streamable resources are registered with callbacks that release and recreate their GPU
+    /// copy. Every frame the budget is compared against the resident streamable bytes and against
+    /// the device local heap budgets reported by the allocator. While either is exceeded, the
+    /// resources drawn least recently are evicted; heap pressure stops evicting once a pass didn't
+    /// lower the heap usage. A resource is never evicted while a frame in
+    /// flight may still use it, and touching an evicted resource streams it back in.
+    class ResidencyManager
+    {
+    public:
+        using StreamableId = uint32_t;
+        static constexpr StreamableId s_kInvalidId = ~0u;
+
+        /// Releases the GPU copy of the resource
+        using EvictCallback = std::function<void()>;
+        /// Recreates the GPU copy, returning false if there was no room for it
+        using RestoreCallback = std::function<bool()>;
+
+        struct Stats
+        {
+            vk::DeviceSize budget = 0;          // effective budget for streamable resources
+            vk::DeviceSize residentBytes = 0;
+            vk::DeviceSize evictedBytes = 0;
+            uint32_t residentCount = 0;
+            uint32_t evictedCount = 0;
+            uint32_t evictionsThisFrame = 0;
+            uint64_t totalEvictions = 0;
+            uint64_t totalRestores = 0;
+            std::array<vk::DeviceSize, size_t(MemoryCategory::eCount)> residentCategoryBytes = {};
+            std::vector<DeviceMemoryAllocator::HeapBudget> heaps;
+        };
+
+        void Initialize(DeviceMemoryAllocator& allocator, uint32_t framesInFlight);
+        void Shutdown();
+
+        /// Limit for resident streamable bytes, 0 to only respect the device's heap budgets
+        void SetBudget(vk::DeviceSize budget) { m_budget = budget; }
+        vk::DeviceSize GetBudget() const { return m_budget; }
+
+        StreamableId Register(MemoryCategory category, vk::DeviceSize size, EvictCallback evict, RestoreCallback restore);
+        /// Forgets the resource without evicting it, the owner releases it itself
+        void Unregister(StreamableId id);
+
+        /// Marks the resource as used by the next frame, restoring it first if it was evicted.
+        /// Returns whether the resource is resident and may be drawn. Call before the frame's Update,
+        /// a restore then uploads with the frame instead of after its uploads were recorded.
+        bool Touch(StreamableId id);
+
+        /// Evicts least recently used resources until at least byteCount bytes of the given category
+        /// were released. Used to retry an allocation which ran out of room.
+        bool MakeRoom(MemoryCategory category, vk::DeviceSize byteCount);
+
+        /// Call at the start of every frame once its fence has signalled, evicts resources while over budget
+        void Update(uint64_t frameNumber);
+
+        Stats GetStats() const;
+
+    private:
+        struct Streamable
+        {
+            MemoryCategory category = MemoryCategory::eMeshes;
+            vk::DeviceSize size = 0;
+            uint64_t lastUsedFrame = 0;
+            bool registered = false;
+            bool resident = false;
+            EvictCallback evict;
+            RestoreCallback restore;
+        };
+
+        /// Largest excess over a device local heap's budget, outUsage is the usage of those heaps
+        vk::DeviceSize GetHeapExcess(vk::DeviceSize& outUsage) const;
+        vk::DeviceSize EvictLeastRecentlyUsed(const MemoryCategory* pCategory);
+
+        DeviceMemoryAllocator* m_pAllocator = nullptr;
+        uint32_t m_framesInFlight = 0;
+        vk::DeviceSize m_budget = 0;
+        uint64_t m_currentFrame = 0;
+        vk::DeviceSize m_heapUsageAtEviction = 0;   // device local usage when heap pressure last evicted, 0 if not over
+
+        std::vector<Streamable> m_streamables;
+        std::vector<StreamableId> m_freeIds;
+        vk::DeviceSize m_residentBytes = 0;
+        uint32_t m_evictionsThisFrame = 0;
+        uint64_t m_totalEvictions = 0;
+        uint64_t m_totalRestores = 0;
+    };
+}
@@ -0,0 +1,348 @@
+#include "ShaderCompiler.h"
+
+#include <cstdio>
+#include <atomic>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#if defined(GAP311_ENABLE_SHADERC)
+#include <shaderc/shaderc.hpp>
+#endif
+
+#pragma warning(disable: 4834)
+
+namespace GAP311
+{
+
+// Bump when the compile options change, code cached on disk by an older build is then ignored
+static constexpr uint64_t s_kCacheVersion = 1;
+static constexpr uint32_t s_kSpirvMagic = 0x07230203;
+
+static std::string SiblingPath(const std::string& filename, const std::string& sibling)
+{
+    return (std::filesystem::path(filename).parent_path() / sibling).lexically_normal().generic_string();
+}
+
+static uint64_t HashBytes(const void* pData, size_t byteSize, uint64_t hash)
+{
+    // FNV-1a
+    const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+    for (size_t i = 0; i < byteSize; ++i)
+    {
+        hash ^= pBytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t HashString(const std::string& text, uint64_t hash)
+{
+    // The length goes in too, so moving text from one file to the next changes the hash
+    uint64_t length = text.size();
+    hash = HashBytes(&length, sizeof(length), hash);
+    return HashBytes(text.data(), text.size(), hash);
+}
+
+#if defined(GAP311_ENABLE_SHADERC)
+
+// Serves includes from the sources read up front, so the code compiled is exactly the code hashed
+class SourceIncluder : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+    using SourceMap = std::unordered_map<std::string, std::pair<const std::string*, const std::string*>>;  // path -> name, text
+
+    explicit SourceIncluder(SourceMap sources) : m_sources(std::move(sources)) {}
+
+    shaderc_include_result* GetInclude(const char* pRequestedSource, shaderc_include_type type, const char* pRequestingSource, size_t includeDepth) override
+    {
+        shaderc_include_result* pResult = new shaderc_include_result();
+
+        auto it = m_sources.find(SiblingPath(pRequestingSource, pRequestedSource));
+        if (it == m_sources.end())
+        {
+            // An empty source name tells shaderc the include failed, the content is the message
+            std::string* pMessage = new std::string(std::string("Cannot find include file ") + pRequestedSource);
+            pResult->content = pMessage->c_str();
+            pResult->content_length = pMessage->size();
+            pResult->user_data = pMessage;
+            return pResult;
+        }
+
+        pResult->source_name = it->second.first->c_str();
+        pResult->source_name_length = it->second.first->size();
+        pResult->content = it->second.second->c_str();
+        pResult->content_length = it->second.second->size();
+        return pResult;
+    }
+
+    void ReleaseInclude(shaderc_include_result* pResult) override
+    {
+        delete static_cast<std::string*>(pResult->user_data);
+        delete pResult;
+    }
+
+private:
+    SourceMap m_sources;
+};
+
+static shaderc_shader_kind GetShaderKind(const std::string& path)
+{
+    // name.vert.glsl, the stage is the extension in front of .glsl
+    std::filesystem::path file(path);
+    if (file.extension() == ".glsl")
+        file = file.stem();
+
+    std::string stage = file.extension().string();
+    if (stage == ".vert") return shaderc_glsl_vertex_shader;
+    if (stage == ".frag") return shaderc_glsl_fragment_shader;
+    if (stage == ".geom") return shaderc_glsl_geometry_shader;
+    if (stage == ".comp") return shaderc_glsl_compute_shader;
+    if (stage == ".tesc") return shaderc_glsl_tess_control_shader;
+    if (stage == ".tese") return shaderc_glsl_tess_evaluation_shader;
+
+    // Falls back to #pragma shader_stage(...) in the source
+    return shaderc_glsl_infer_from_source;
+}
+
+#endif
+
+bool ShaderCompiler::Initialize(const std::string& cacheDirectory)
+{
+    if (!IsAvailable())
+        return false;
+
+    m_cacheDirectory.clear();
+    if (!cacheDirectory.empty())
+    {
+        // The cache is only an optimization, compiling still works without it
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+        if (!error)
+            m_cacheDirectory = cacheDirectory;
+    }
+
+    m_stats = Stats();
+    return true;
+}
+
+void ShaderCompiler::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_code.clear();
+    m_sources.clear();
+}
+
+bool ShaderCompiler::Compile(const std::string& path, std::vector<uint32_t>& outCode, std::string& outLog)
+{
+    outLog.clear();
+
+    SourceMap sources;
+    bool read = ReadSources(path, sources, outLog);
+
+    // Whatever the outcome, the files read are what the shader depends on now, so fixing them is noticed
+    std::vector<Source> dependencies;
+    for (auto& [sourcePath, source] : sources)
+        dependencies.push_back({ sourcePath, source.writeTime });
+
+    uint64_t hash = Hash(path, sources);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!dependencies.empty())
+            m_sources[path] = std::move(dependencies);
+
+        if (!read)
+        {
+            m_stats.failures += 1;
+            return false;
+        }
+
+        auto it = m_code.find(hash);
+        if (it != m_code.end())
+        {
+            m_stats.memoryHits += 1;
+            outCode = it->second;
+            return true;
+        }
+    }
+
+    bool fromDisk = ReadCache(hash, outCode);
+    if (!fromDisk && !CompileSources(path, sources, outCode, outLog))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.failures += 1;
+        return false;
+    }
+
+    if (!fromDisk)
+        WriteCache(hash, outCode);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (fromDisk)
+        m_stats.diskHits += 1;
+    else
+        m_stats.compiles += 1;
+    m_code[hash] = outCode;
+    return true;
+}
+
+std::unordered_map<std::string, std::vector<ShaderCompiler::Source>> ShaderCompiler::GetSources() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sources;
+}
+
+ShaderCompiler::Stats ShaderCompiler::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+bool ShaderCompiler::ReadSources(const std::string& path, SourceMap& outSources, std::string& outLog)
+{
+    if (outSources.count(path))
+        return true;
+
+    // The write time is taken first, an edit landing while the file is read then still shows up as a change
+    std::error_code error;
+    SourceText source;
+    source.writeTime = std::filesystem::last_write_time(path, error);
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (error || !file.good())
+    {
+        outLog += "Cannot open " + path + "\n";
+        return false;
+    }
+
+    std::stringstream text;
+    text << file.rdbuf();
+    source.text = text.str();
+
+    std::vector<std::string> includes;
+    std::istringstream lines(source.text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        size_t directive = line.find("#include");
+        size_t open = line.find('"', directive);
+        size_t close = line.find('"', open + 1);
+        if (directive == std::string::npos || open == std::string::npos || close == std::string::npos)
+            continue;
+
+        includes.emplace_back(SiblingPath(path, line.substr(open + 1, close - open - 1)));
+    }
+
+    outSources.emplace(path, std::move(source));
+
+    for (const std::string& include : includes)
+    {
+        if (!ReadSources(include, outSources, outLog))
+            return false;
+    }
+    return true;
+}
+
+uint64_t ShaderCompiler::Hash(const std::string& path, const SourceMap& sources)
+{
+    uint64_t hash = HashBytes(&s_kCacheVersion, sizeof(s_kCacheVersion), 0xcbf29ce484222325ull);
+    hash = HashString(path, hash);
+
+    // Sorted, so the same sources give the same hash on every run
+    std::vector<const std::string*> paths;
+    for (auto& [sourcePath, source] : sources)
+        paths.push_back(&sourcePath);
+    std::sort(paths.begin(), paths.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+    for (const std::string* pPath : paths)
+    {
+        hash = HashString(*pPath, hash);
+        hash = HashString(sources.at(*pPath).text, hash);
+    }
+    return hash;
+}
+
+bool ShaderCompiler::ReadCache(uint64_t hash, std::vector<uint32_t>& outCode) const
+{
+    if (m_cacheDirectory.empty())
+        return false;
+
+    char filename[32];
+    std::snprintf(filename, sizeof(filename), "%016llx.spv", static_cast<unsigned long long>(hash));
+
+    std::ifstream file(m_cacheDirectory / filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.good())
+        return false;
+
+    size_t byteSize = static_cast<size_t>(file.tellg());
+    if (byteSize < sizeof(uint32_t) || byteSize % sizeof(uint32_t) != 0)
+        return false;
+
+    file.seekg(0);
+    outCode.resize(byteSize / sizeof(uint32_t));
+    if (!file.read(reinterpret_cast<char*>(outCode.data()), byteSize))
+        return false;
+
+    return outCode[0] == s_kSpirvMagic;
+}
+
+void ShaderCompiler::WriteCache(uint64_t hash, const std::vector<uint32_t>& code) const
+{
+    if (m_cacheDirectory.empty())
+        return;
+
+    char filename[32];
+    std::snprintf(filename, sizeof(filename), "%016llx.spv", static_cast<unsigned long long>(hash));
+
+    // Written under another name first, a later run never reads a partially written file. Workers compiling
+    // the same code at once each write their own temporary file.
+    static std::atomic<uint64_t> s_temporaryCount = 0;
+    std::filesystem::path target = m_cacheDirectory / filename;
+    std::filesystem::path temporary = target;
+    temporary += "." + std::to_string(s_temporaryCount++) + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(code.data()), code.size() * sizeof(uint32_t)))
+            return;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, target, error);
+    if (error)
+        std::filesystem::remove(temporary, error);
+}
+
+bool ShaderCompiler::CompileSources(const std::string& path, const SourceMap& sources, std::vector<uint32_t>& outCode, std::string& outLog)
+{
+#if defined(GAP311_ENABLE_SHADERC)
+    SourceIncluder::SourceMap includes;
+    for (auto& [sourcePath, source] : sources)
+        includes.emplace(sourcePath, std::make_pair(&sourcePath, &source.text));
+
+    // No optimization, the same code glslangValidator -V generates. Debug names are kept, the shader
+    // library looks specialization constants up by name.
+    shaderc::CompileOptions options;
+    options.SetSourceLanguage(shaderc_source_language_glsl);
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+    options.SetIncluder(std::make_unique<SourceIncluder>(std::move(includes)));
+
+    // A compiler per call, shaderc compilers can't be used by several threads at once
+    shaderc::Compiler compiler;
+    const std::string& text = sources.at(path).text;
+    shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(text.data(), text.size(), GetShaderKind(path), path.c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+        outLog = result.GetErrorMessage();
+        return false;
+    }
+
+    outCode.assign(result.cbegin(), result.cend());
+    return !outCode.empty();
+#else
+    outLog = "Built without shaderc, GLSL can't be compiled at runtime";
+    return false;
+#endif
+}
+
+}
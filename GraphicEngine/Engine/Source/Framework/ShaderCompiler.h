@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <filesystem>
+#include <unordered_map>
+
+#if __has_include(<shaderc/shaderc.hpp>)
+#   define GAP311_ENABLE_SHADERC
+#endif
+
+namespace GAP311
+{
+    /// Compiles GLSL to SPIR-V at runtime through shaderc, the library glslangValidator is built on.
+    ///
+    /// The stage comes from the file name, "name.vert.glsl" is a vertex shader just like the project's
+    /// build step expects. #include "file" is resolved relative to the including file. Results are cached
+    /// by a hash of the source and every file it includes, in memory and as "<hash>.spv" in the cache
+    /// directory, so unchanged shaders are only read and hashed on later runs. Safe to call from several
+    /// threads, compilations run in parallel and only the caches are shared.
+    ///
+    /// Without shaderc available at build time IsAvailable() is false and nothing is compiled.
+    class ShaderCompiler
+    {
+    public:
+        struct Stats
+        {
+            uint64_t compiles = 0;      // sources actually compiled
+            uint64_t memoryHits = 0;
+            uint64_t diskHits = 0;
+            uint64_t failures = 0;
+        };
+
+        /// A file a shader was built from and its write time when it was read
+        struct Source
+        {
+            std::string path;
+            std::filesystem::file_time_type writeTime;
+        };
+
+        static constexpr bool IsAvailable()
+        {
+#if defined(GAP311_ENABLE_SHADERC)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /// Empty cacheDirectory keeps compiled code in memory only
+        bool Initialize(const std::string& cacheDirectory);
+        void Shutdown();
+
+        /// Compiles the GLSL file at path, or returns the cached code if neither it nor its includes changed.
+        /// On failure outLog holds the compiler's messages.
+        bool Compile(const std::string& path, std::vector<uint32_t>& outCode, std::string& outLog);
+
+        /// Every file each shader compiled so far was built from, keyed by the path given to Compile
+        std::unordered_map<std::string, std::vector<Source>> GetSources() const;
+
+        Stats GetStats() const;
+
+    private:
+        struct SourceText
+        {
+            std::string text;
+            std::filesystem::file_time_type writeTime;
+        };
+        using SourceMap = std::unordered_map<std::string, SourceText>;
+
+        static bool ReadSources(const std::string& path, SourceMap& outSources, std::string& outLog);
+        static uint64_t Hash(const std::string& path, const SourceMap& sources);
+        bool ReadCache(uint64_t hash, std::vector<uint32_t>& outCode) const;
+        void WriteCache(uint64_t hash, const std::vector<uint32_t>& code) const;
+        static bool CompileSources(const std::string& path, const SourceMap& sources, std::vector<uint32_t>& outCode, std::string& outLog);
+
+        std::filesystem::path m_cacheDirectory;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> m_code;         // source hash -> compiled code
+        std::unordered_map<std::string, std::vector<Source>> m_sources;     // shader path -> files it was built from
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
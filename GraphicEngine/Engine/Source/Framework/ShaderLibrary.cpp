@@ -0,0 +1,371 @@
+#include "ShaderLibrary.h"
+#include "ShaderCompiler.h"
+
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+
+#pragma warning(disable: 4834)
+
+namespace GAP311
+{
+
+static constexpr uint32_t s_kSpirvMagic = 0x07230203;
+static constexpr uint32_t s_kSpirvHeaderWords = 5;
+static constexpr uint32_t s_kSpirvOpName = 5;
+static constexpr uint32_t s_kSpirvOpDecorate = 71;
+static constexpr uint32_t s_kSpirvDecorationSpecId = 1;
+
+bool ShaderLibrary::Initialize(vk::Device device)
+{
+    m_device = device;
+    m_stats = Stats();
+    return static_cast<bool>(m_device);
+}
+
+void ShaderLibrary::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& [hash, shader] : m_shaders)
+    {
+        if (shader.module)
+            m_device.destroyShaderModule(shader.module);
+    }
+    for (auto& retired : m_retiredModules)
+        m_device.destroyShaderModule(retired.module);
+    m_retiredModules.clear();
+    m_leases.clear();
+    m_shaders.clear();
+    m_paths.clear();
+    m_sourcePaths.clear();
+    m_compileLogs.clear();
+    m_searchPaths.clear();
+    m_pCompiler = nullptr;
+    m_device = nullptr;
+}
+
+void ShaderLibrary::AddSearchPath(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_searchPaths.emplace_back(directory);
+}
+
+void ShaderLibrary::SetCompiler(ShaderCompiler* pCompiler)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pCompiler = pCompiler;
+}
+
+vk::ShaderModule ShaderLibrary::GetModule(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    Shader* pShader = Find(path, lock);
+    return pShader ? pShader->module : nullptr;
+}
+
+bool ShaderLibrary::FindSpecializationConstant(const std::string& path, const std::string& name, uint32_t& outConstantId)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    Shader* pShader = Find(path, lock);
+    if (!pShader)
+        return false;
+
+    auto it = pShader->specializationIds.find(name);
+    if (it == pShader->specializationIds.end())
+        return false;
+
+    outConstantId = it->second;
+    return true;
+}
+
+void ShaderLibrary::Evict(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto pathIt = m_paths.find(path);
+    if (pathIt == m_paths.end())
+        return;
+
+    Release(pathIt->second);
+    m_paths.erase(pathIt);
+    m_sourcePaths.erase(path);
+    m_compileLogs.erase(path);
+}
+
+bool ShaderLibrary::Reload(const std::string& sourcePath, std::vector<std::string>& outChangedPaths, std::string& outLog)
+{
+    std::vector<std::string> paths;
+    ShaderCompiler* pCompiler = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& [path, source] : m_sourcePaths)
+        {
+            if (source == sourcePath)
+                paths.push_back(path);
+        }
+        pCompiler = m_pCompiler;
+    }
+    if (paths.empty() || !pCompiler)
+        return true;
+
+    std::vector<uint32_t> code;
+    bool compiled = pCompiler->Compile(sourcePath, code, outLog);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.reloads += 1;
+    for (const std::string& path : paths)
+    {
+        if (!compiled)
+        {
+            m_compileLogs[path] = outLog;
+            continue;
+        }
+        m_compileLogs.erase(path);
+
+        // Evicted while compiling, it is compiled again on next use anyway
+        auto pathIt = m_paths.find(path);
+        if (pathIt == m_paths.end() || pathIt->second == Hash(code))
+            continue;
+
+        Release(pathIt->second);
+        m_paths.erase(pathIt);
+        if (!Insert(path, code))
+            return false;
+        outChangedPaths.push_back(path);
+    }
+    return compiled;
+}
+
+ShaderLibrary::Lease ShaderLibrary::BeginLease()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t id = m_nextLeaseId++;
+    m_leases.insert(id);
+    return Lease(this, id);
+}
+
+void ShaderLibrary::EndLease(uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_leases.erase(id);
+    DestroyUnleasedModules();
+}
+
+std::string ShaderLibrary::GetCompileLog(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_compileLogs.find(path);
+    return it != m_compileLogs.end() ? it->second : std::string();
+}
+
+ShaderLibrary::Stats ShaderLibrary::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Stats stats = m_stats;
+    stats.moduleCount = m_shaders.size();
+    for (auto& [hash, shader] : m_shaders)
+        stats.codeBytes += shader.code.size() * sizeof(uint32_t);
+    return stats;
+}
+
+ShaderLibrary::Shader* ShaderLibrary::Find(const std::string& path, std::unique_lock<std::mutex>& lock)
+{
+    m_stats.lookups += 1;
+
+    auto pathIt = m_paths.find(path);
+    if (pathIt != m_paths.end())
+        return &m_shaders[pathIt->second];
+
+    // The source wins over SPIR-V which may be stale, a source that doesn't compile falls back to it
+    std::vector<uint32_t> code;
+    std::string sourcePath = FindSource(path);
+    if (!sourcePath.empty())
+    {
+        // Other threads keep using the library while this one compiles
+        ShaderCompiler* pCompiler = m_pCompiler;
+        std::string log;
+        lock.unlock();
+        bool compiled = pCompiler->Compile(sourcePath, code, log);
+        lock.lock();
+
+        // Loaded by another thread in the meantime, its code is used so the path has a single entry
+        pathIt = m_paths.find(path);
+        if (pathIt != m_paths.end())
+            return &m_shaders[pathIt->second];
+
+        m_sourcePaths[path] = sourcePath;
+        if (compiled)
+            m_compileLogs.erase(path);
+        else
+        {
+            m_compileLogs[path] = log;
+            code.clear();
+        }
+    }
+    if (code.empty() && !ReadFile(path, code))
+        return nullptr;
+
+    return Insert(path, std::move(code));
+}
+
+ShaderLibrary::Shader* ShaderLibrary::Insert(const std::string& path, std::vector<uint32_t> code)
+{
+    // Identical code under another path reuses the module that's already there
+    uint64_t hash = Hash(code);
+    auto shaderIt = m_shaders.find(hash);
+    if (shaderIt == m_shaders.end())
+    {
+        vk::ShaderModuleCreateInfo moduleInfo;
+        moduleInfo.pCode = code.data();
+        moduleInfo.codeSize = code.size() * sizeof(uint32_t);
+
+        Shader shader;
+        shader.hash = hash;
+        shader.module = m_device.createShaderModule(moduleInfo);
+        if (!shader.module)
+            return nullptr;
+        shader.code = std::move(code);
+        ReflectSpecializationConstants(shader);
+
+        shaderIt = m_shaders.emplace(hash, std::move(shader)).first;
+    }
+
+    shaderIt->second.pathCount += 1;
+    m_paths.emplace(path, hash);
+    return &shaderIt->second;
+}
+
+void ShaderLibrary::Release(uint64_t hash)
+{
+    auto shaderIt = m_shaders.find(hash);
+    if (shaderIt == m_shaders.end() || --shaderIt->second.pathCount > 0)
+        return;
+
+    // Leases taken from now on can't find the module anymore, only the ones held may be using it
+    m_retiredModules.push_back({ shaderIt->second.module, m_nextLeaseId });
+    m_shaders.erase(shaderIt);
+    DestroyUnleasedModules();
+}
+
+void ShaderLibrary::DestroyUnleasedModules()
+{
+    uint64_t oldestLease = m_leases.empty() ? m_nextLeaseId : *m_leases.begin();
+
+    auto it = std::remove_if(m_retiredModules.begin(), m_retiredModules.end(), [&](const Retired& retired)
+    {
+        if (oldestLease < retired.leaseId)
+            return false;
+        m_device.destroyShaderModule(retired.module);
+        return true;
+    });
+    m_retiredModules.erase(it, m_retiredModules.end());
+}
+
+std::string ShaderLibrary::FindSource(const std::string& path) const
+{
+    if (!m_pCompiler)
+        return std::string();
+
+    std::filesystem::path source(path);
+    if (source.extension() == ".spv")
+        source.replace_extension(".glsl");
+    else if (source.extension() != ".glsl")
+        return std::string();
+
+    std::error_code error;
+    return std::filesystem::is_regular_file(source, error) ? source.generic_string() : std::string();
+}
+
+bool ShaderLibrary::ReadFile(const std::string& path, std::vector<uint32_t>& outCode)
+{
+    std::ifstream file;
+    for (const std::string& directory : m_searchPaths)
+    {
+        file.open(std::filesystem::path(directory) / path, std::ios::in | std::ios::binary);
+        if (file.good())
+            break;
+        file.close();
+        file.clear();
+    }
+    if (!file.is_open())
+        file.open(path, std::ios::in | std::ios::binary);
+    if (!file.good())
+        return false;
+
+    m_stats.fileReads += 1;
+
+    file.seekg(0, std::ios_base::end);
+    size_t byteSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    // SPIR-V is a stream of words starting with its magic number
+    if (byteSize < sizeof(uint32_t) || byteSize % sizeof(uint32_t) != 0)
+        return false;
+
+    outCode.resize(byteSize / sizeof(uint32_t));
+    if (!file.read(reinterpret_cast<char*>(outCode.data()), byteSize))
+        return false;
+
+    return outCode[0] == s_kSpirvMagic;
+}
+
+void ShaderLibrary::ReflectSpecializationConstants(Shader& shader)
+{
+    // Specialization constants are decorated with their constant_id and named by OpName, both
+    // live in the annotation and debug sections at the start of the module
+    std::unordered_map<uint32_t, std::string> names;
+    std::unordered_map<uint32_t, uint32_t> specIds;
+
+    const std::vector<uint32_t>& code = shader.code;
+    size_t word = s_kSpirvHeaderWords;
+    while (word < code.size())
+    {
+        uint32_t wordCount = code[word] >> 16;
+        uint32_t opcode = code[word] & 0xffff;
+        if (wordCount == 0 || word + wordCount > code.size())
+            break;
+
+        if (opcode == s_kSpirvOpName && wordCount >= 3)
+        {
+            // The name is a nul terminated string packed into the remaining words
+            const char* pName = reinterpret_cast<const char*>(&code[word + 2]);
+            size_t maxLength = (wordCount - 2) * sizeof(uint32_t);
+            names[code[word + 1]] = std::string(pName, strnlen(pName, maxLength));
+        }
+        else if (opcode == s_kSpirvOpDecorate && wordCount >= 4 && code[word + 2] == s_kSpirvDecorationSpecId)
+        {
+            specIds[code[word + 1]] = code[word + 3];
+        }
+
+        word += wordCount;
+    }
+
+    for (auto& [id, constantId] : specIds)
+    {
+        auto nameIt = names.find(id);
+        if (nameIt != names.end())
+            shader.specializationIds[nameIt->second] = constantId;
+    }
+}
+
+uint64_t ShaderLibrary::Hash(const std::vector<uint32_t>& code)
+{
+    // FNV-1a over the words of the code
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t word : code)
+    {
+        hash ^= word;
+        hash *= 0x100000001b3ull;
+    }
+    return hash ^ code.size();
+}
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <utility>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+namespace GAP311
+{
+    class ShaderCompiler;
+
+    /// Keeps SPIR-V code and its vk::ShaderModule resident for every shader a pipeline has used.
+    ///
+    /// Shaders are looked up by path, only the first lookup of a path touches the disk. Modules are
+    /// also keyed by a hash of their code, so two paths holding identical SPIR-V share one module.
+    /// Search paths are tried in the order they were added before the path itself, which lets the
+    /// output directory of the asset cooker take precedence over the shaders built with the project.
+    /// With a ShaderCompiler set, the GLSL source next to a SPIR-V path is compiled instead, so shaders
+    /// no longer have to be rebuilt by hand, and shaders can be reloaded after their sources changed.
+    class ShaderLibrary
+    {
+    public:
+        struct Stats
+        {
+            size_t moduleCount = 0;
+            size_t codeBytes = 0;
+            uint64_t lookups = 0;
+            uint64_t fileReads = 0;
+            uint64_t reloads = 0;       // sources recompiled by Reload
+        };
+
+        /// Keeps every module handed out while it is held alive, even once a reload or eviction replaced it.
+        /// Hold one from looking modules up until the pipeline created from them exists.
+        class Lease
+        {
+        public:
+            Lease() = default;
+            ~Lease() { if (m_pLibrary) m_pLibrary->EndLease(m_id); }
+            Lease(Lease&& other) noexcept : m_pLibrary(std::exchange(other.m_pLibrary, nullptr)), m_id(other.m_id) {}
+            Lease(const Lease&) = delete;
+            Lease& operator=(const Lease&) = delete;
+            Lease& operator=(Lease&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    if (m_pLibrary)
+                        m_pLibrary->EndLease(m_id);
+                    m_pLibrary = std::exchange(other.m_pLibrary, nullptr);
+                    m_id = other.m_id;
+                }
+                return *this;
+            }
+
+        private:
+            friend class ShaderLibrary;
+            Lease(ShaderLibrary* pLibrary, uint64_t id) : m_pLibrary(pLibrary), m_id(id) {}
+
+            ShaderLibrary* m_pLibrary = nullptr;
+            uint64_t m_id = 0;
+        };
+
+        bool Initialize(vk::Device device);
+        /// Destroys every module, pipelines created from them remain valid
+        void Shutdown();
+
+        /// Directory tried before the path as given, searched in the order added
+        void AddSearchPath(const std::string& directory);
+        /// "name.vert.spv" is then compiled from "name.vert.glsl" when that file exists, falling back to
+        /// the SPIR-V file should it fail to compile. Paths naming a .glsl file are always compiled.
+        /// Null to only load SPIR-V. The compiler must outlive the library.
+        void SetCompiler(ShaderCompiler* pCompiler);
+
+        /// Returns the module for the SPIR-V file at path, loading it on first use. Returns null if the
+        /// file can't be found or isn't valid SPIR-V. The module stays owned by the library.
+        vk::ShaderModule GetModule(const std::string& path);
+        /// Looks up the constant_id of the specialization constant called name in the shader at path.
+        /// Relies on the debug names glslangValidator keeps by default.
+        bool FindSpecializationConstant(const std::string& path, const std::string& name, uint32_t& outConstantId);
+
+        /// Drops path so it is read again on next use. The module is only destroyed once no other
+        /// path shares it and every lease that may have looked it up was dropped.
+        void Evict(const std::string& path);
+
+        /// Recompiles the GLSL file sourcePath and points every path compiled from it at the new code.
+        /// Paths whose code actually changed are added to outChangedPaths, pipelines created from them
+        /// need to be created again. Replaced modules live on until the leases taken before the reload are
+        /// dropped, pipelines being created from them stay valid. The compilation doesn't hold up other threads.
+        bool Reload(const std::string& sourcePath, std::vector<std::string>& outChangedPaths, std::string& outLog);
+
+        /// Modules looked up while the lease is held stay valid until it is dropped
+        Lease BeginLease();
+        /// Compiler messages of the last failed compilation of path, empty when it compiled
+        std::string GetCompileLog(const std::string& path) const;
+
+        Stats GetStats() const;
+
+    private:
+        struct Shader
+        {
+            uint64_t hash = 0;
+            std::vector<uint32_t> code;
+            vk::ShaderModule module;
+            std::unordered_map<std::string, uint32_t> specializationIds;   // constant name -> constant_id
+            uint32_t pathCount = 0;     // paths resolving to this code
+        };
+
+        /// Compiles without holding lock, which is held again when it returns
+        Shader* Find(const std::string& path, std::unique_lock<std::mutex>& lock);
+        Shader* Insert(const std::string& path, std::vector<uint32_t> code);
+        /// Drops one path's reference to the code, retiring the module with the last one
+        void Release(uint64_t hash);
+        void EndLease(uint64_t id);
+        /// Destroys the retired modules no lease can still be using
+        void DestroyUnleasedModules();
+        std::string FindSource(const std::string& path) const;
+        bool ReadFile(const std::string& path, std::vector<uint32_t>& outCode);
+        static uint64_t Hash(const std::vector<uint32_t>& code);
+        static void ReflectSpecializationConstants(Shader& shader);
+
+        vk::Device m_device;
+        std::vector<std::string> m_searchPaths;
+        std::unordered_map<std::string, uint64_t> m_paths;      // path -> hash of its code
+        std::unordered_map<uint64_t, Shader> m_shaders;         // hash -> resident code and module
+        ShaderCompiler* m_pCompiler = nullptr;
+        std::unordered_map<std::string, std::string> m_sourcePaths;     // path -> GLSL file it is compiled from
+        std::unordered_map<std::string, std::string> m_compileLogs;     // path -> messages of its failed compilation
+
+        struct Retired
+        {
+            vk::ShaderModule module;
+            uint64_t leaseId = 0;       // leases before this one may have looked the module up
+        };
+        std::vector<Retired> m_retiredModules;
+        std::set<uint64_t> m_leases;    // ids of the leases held
+        uint64_t m_nextLeaseId = 0;
+        Stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
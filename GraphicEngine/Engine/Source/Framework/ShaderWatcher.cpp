@@ -0,0 +1,114 @@
+#include "ShaderWatcher.h"
+
+#pragma warning(disable: 4834)
+
+namespace GAP311
+{
+
+bool ShaderWatcher::Start(const ShaderCompiler& compiler, std::chrono::milliseconds interval)
+{
+    Stop();
+
+    m_pCompiler = &compiler;
+    m_interval = interval;
+    m_stopping = false;
+    m_lastSeen.clear();
+    m_reported.clear();
+    m_changed.clear();
+
+    m_thread = std::thread([this]() { Run(); });
+    return true;
+}
+
+void ShaderWatcher::Stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+    m_pCompiler = nullptr;
+}
+
+std::vector<std::string> ShaderWatcher::TakeChanged()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<std::string> changed(m_changed.begin(), m_changed.end());
+    m_changed.clear();
+    return changed;
+}
+
+void ShaderWatcher::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, m_interval, [this]() { return m_stopping; }))
+    {
+        // The disk is polled without the lock, TakeChanged never waits on it
+        lock.unlock();
+        Poll();
+        lock.lock();
+    }
+}
+
+void ShaderWatcher::Poll()
+{
+    auto shaders = m_pCompiler->GetSources();
+
+    std::unordered_map<std::string, std::filesystem::file_time_type> writeTimes;
+    std::vector<std::string> changed;
+    for (auto& [shader, sources] : shaders)
+    {
+        bool shaderChanged = false;
+        for (auto& source : sources)
+        {
+            auto it = writeTimes.find(source.path);
+            if (it == writeTimes.end())
+            {
+                // Files being saved may be missing for a moment, they are looked at again next time
+                std::error_code error;
+                auto writeTime = std::filesystem::last_write_time(source.path, error);
+                if (error)
+                    continue;
+                it = writeTimes.emplace(source.path, writeTime).first;
+            }
+
+            if (it->second == source.writeTime)
+                continue;
+
+            // Still being written, or already reported and waiting to be recompiled
+            auto lastSeen = m_lastSeen.find(source.path);
+            if (lastSeen == m_lastSeen.end() || lastSeen->second != it->second)
+                continue;
+            auto reported = m_reported.find(source.path);
+            if (reported != m_reported.end() && reported->second == it->second)
+                continue;
+
+            shaderChanged = true;
+        }
+
+        if (shaderChanged)
+            changed.push_back(shader);
+    }
+
+    // Files shared by several shaders are only marked reported once every shader was looked at
+    for (auto& [path, writeTime] : writeTimes)
+    {
+        auto lastSeen = m_lastSeen.find(path);
+        if (lastSeen != m_lastSeen.end() && lastSeen->second == writeTime)
+            m_reported[path] = writeTime;
+    }
+    m_lastSeen = std::move(writeTimes);
+
+    if (changed.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed.insert(changed.begin(), changed.end());
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_set>
+#include <unordered_map>
+
+#include "ShaderCompiler.h"
+
+namespace GAP311
+{
+    /// Watches the files every shader of a ShaderCompiler was built from, includes too, and collects the
+    /// shaders whose files were written since they were compiled.
+    ///
+    /// Files are polled on a thread of the watcher's own, so the render loop never touches the disk. A
+    /// change is only reported once the write time stayed the same for a whole interval, editors saving
+    /// in several steps then trigger one recompile of the finished file.
+    class ShaderWatcher
+    {
+    public:
+        ShaderWatcher() = default;
+        ~ShaderWatcher() { Stop(); }
+        ShaderWatcher(const ShaderWatcher&) = delete;
+        ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+        /// compiler must outlive the watcher or the next Stop
+        bool Start(const ShaderCompiler& compiler, std::chrono::milliseconds interval);
+        void Stop();
+        bool IsRunning() const { return m_thread.joinable(); }
+
+        /// Paths, as given to ShaderCompiler::Compile, of the shaders which changed since the last call
+        std::vector<std::string> TakeChanged();
+
+    private:
+        void Run();
+        void Poll();
+
+        const ShaderCompiler* m_pCompiler = nullptr;
+        std::chrono::milliseconds m_interval{};
+        std::thread m_thread;
+
+        std::unordered_map<std::string, std::filesystem::file_time_type> m_lastSeen;  // file -> write time at the last poll
+        std::unordered_map<std::string, std::filesystem::file_time_type> m_reported;  // file -> write time already reported
+        std::unordered_set<std::string> m_changed;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        bool m_stopping = false;
+    };
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+namespace GAP311
+{
+    /// A fixed set of worker threads pulling tasks from a shared queue.
+    /// Submit() hands back a future for the task's result.
+    class ThreadPool
+    {
+    public:
+        /// A thread count of 0 uses one worker per hardware thread
+        explicit ThreadPool(size_t threadCount = 0);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        template <typename F>
+        auto Submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+        {
+            using Result = std::invoke_result_t<std::decay_t<F>>;
+
+            auto pTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+            std::future<Result> result = pTask->get_future();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_tasks.emplace_back([pTask]() { (*pTask)(); });
+            }
+            m_taskAvailable.notify_one();
+            return result;
+        }
+
+        /// Blocks until every submitted task has finished
+        void WaitIdle();
+
+        size_t GetThreadCount() const { return m_threads.size(); }
+
+    private:
+        void WorkerLoop();
+
+        std::vector<std::thread> m_threads;
+        std::deque<std::function<void()>> m_tasks;
+        std::mutex m_mutex;
+        std::condition_variable m_taskAvailable;
+        std::condition_variable m_idle;
+        size_t m_activeTaskCount = 0;
+        bool m_stopping = false;
+    };
+}
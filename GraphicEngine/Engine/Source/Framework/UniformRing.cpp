@@ -0,0 +1,110 @@
+#include "UniformRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+#pragma warning(disable: 4834) // allow ignoring nodiscard
+
+namespace GAP311
+{
+
+bool UniformRing::Initialize(vk::Device device, DeviceMemoryAllocator& allocator, uint32_t frameCount, vk::DeviceSize bytesPerFrame,
+    vk::DeviceSize persistentBytesPerFrame, vk::DeviceSize offsetAlignment)
+{
+    m_device = device;
+    m_pAllocator = &allocator;
+    m_alignment = std::max<vk::DeviceSize>(offsetAlignment, 1);
+
+    // Keep every frame's region aligned so offsets within it stay aligned too
+    m_bytesPerFrame = (bytesPerFrame + m_alignment - 1) / m_alignment * m_alignment;
+    m_persistentBytes = std::min(m_bytesPerFrame, (persistentBytesPerFrame + m_alignment - 1) / m_alignment * m_alignment);
+    m_persistentUsed = 0;
+    m_freeSlots.clear();
+
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = m_bytesPerFrame * frameCount;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+    m_buffer = device.createBuffer(bufferInfo);
+    if (!m_buffer)
+        return false;
+
+    // Device local + host visible memory (UMA or resizable BAR) saves the GPU from reading over the bus
+    auto bufferMemoryReq = device.getBufferMemoryRequirements(m_buffer);
+    if (!allocator.Allocate(bufferMemoryReq, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, ResourceTiling::eLinear, MemoryCategory::eUniforms, m_allocation))
+        return false;
+
+    device.bindBufferMemory(m_buffer, m_allocation.memory, m_allocation.offset);
+
+    m_frameStart = 0;
+    m_cursor = m_persistentBytes;
+    return true;
+}
+
+void UniformRing::Shutdown()
+{
+    if (m_buffer)
+    {
+        m_device.destroyBuffer(m_buffer);
+        m_buffer = nullptr;
+    }
+    if (m_pAllocator)
+        m_pAllocator->Free(m_allocation);
+    m_pAllocator = nullptr;
+    m_device = nullptr;
+}
+
+void UniformRing::BeginFrame(uint32_t frameIndex)
+{
+    m_frameStart = m_bytesPerFrame * frameIndex;
+    m_cursor = m_frameStart + m_persistentBytes;
+}
+
+bool UniformRing::AllocateSlot(vk::DeviceSize size, Slot& slot)
+{
+    size = (size + m_alignment - 1) / m_alignment * m_alignment;
+
+    auto it = std::find_if(m_freeSlots.begin(), m_freeSlots.end(), [&](const Slot& freeSlot) { return freeSlot.size == size; });
+    if (it != m_freeSlots.end())
+    {
+        slot = *it;
+        m_freeSlots.erase(it);
+        return true;
+    }
+
+    if (m_persistentUsed + size > m_persistentBytes)
+        return false;
+
+    slot.offset = m_persistentUsed;
+    slot.size = size;
+    m_persistentUsed += size;
+    return true;
+}
+
+void UniformRing::FreeSlot(Slot& slot)
+{
+    if (slot)
+        m_freeSlots.push_back(slot);
+    slot = Slot();
+}
+
+void UniformRing::WriteSlot(const Slot& slot, const void* pData, vk::DeviceSize size)
+{
+    std::memcpy(static_cast<uint8_t*>(m_allocation.pMapped) + m_frameStart + slot.offset, pData, std::min(size, slot.size));
+}
+
+bool UniformRing::Push(const void* pData, vk::DeviceSize size, uint32_t& outOffset)
+{
+    vk::DeviceSize offset = (m_cursor + m_alignment - 1) / m_alignment * m_alignment;
+    if (offset + size > m_frameStart + m_bytesPerFrame)
+        return false;
+
+    std::memcpy(static_cast<uint8_t*>(m_allocation.pMapped) + offset, pData, size);
+    m_cursor = offset + size;
+    outOffset = static_cast<uint32_t>(offset);
+    return true;
+}
+
+}
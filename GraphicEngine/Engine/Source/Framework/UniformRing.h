@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+namespace GAP311
+{
+    /// A persistently mapped, host coherent uniform buffer split into one region per frame in flight.
+    ///
+    /// Uniform data is written linearly into the current frame's region and referenced through
+    /// eUniformBufferDynamic descriptors which all point at the start of the buffer, the value
+    /// returned by Push is the dynamic offset to bind. A region is only reused once the frame
+    /// that wrote it has finished on the GPU, so no copies or transfer commands are needed.
+    ///
+    /// The start of every region is set aside for persistent slots. A slot has the same offset
+    /// within each region, so it holds one copy per frame in flight which keeps its contents
+    /// between frames. Data that rarely changes only needs writing when it does, once per copy.
+    class UniformRing
+    {
+    public:
+        struct Slot
+        {
+            vk::DeviceSize offset = 0;  // within a frame's region
+            vk::DeviceSize size = 0;
+
+            explicit operator bool() const { return size != 0; }
+        };
+
+        bool Initialize(vk::Device device, DeviceMemoryAllocator& allocator, uint32_t frameCount, vk::DeviceSize bytesPerFrame,
+            vk::DeviceSize persistentBytesPerFrame, vk::DeviceSize offsetAlignment);
+        void Shutdown();
+
+        bool AllocateSlot(vk::DeviceSize size, Slot& slot);
+        void FreeSlot(Slot& slot);
+
+        /// Copies pData into the current frame's copy of the slot
+        void WriteSlot(const Slot& slot, const void* pData, vk::DeviceSize size);
+        /// Dynamic offset of the current frame's copy of the slot
+        uint32_t GetSlotOffset(const Slot& slot) const { return static_cast<uint32_t>(m_frameStart + slot.offset); }
+
+        /// Call once the fence of frameIndex has signalled, rewinds that frame's region
+        void BeginFrame(uint32_t frameIndex);
+
+        /// Copies pData into the current frame's region and returns its dynamic offset in outOffset
+        bool Push(const void* pData, vk::DeviceSize size, uint32_t& outOffset);
+
+        vk::Buffer GetBuffer() const { return m_buffer; }
+        vk::DeviceSize GetBytesPerFrame() const { return m_bytesPerFrame; }
+        /// Bytes pushed into the current frame so far, including alignment padding
+        vk::DeviceSize GetFrameUsage() const { return m_cursor - m_frameStart - m_persistentBytes; }
+        vk::DeviceSize GetPersistentUsage() const { return m_persistentUsed; }
+
+    private:
+        vk::Device m_device;
+        DeviceMemoryAllocator* m_pAllocator = nullptr;
+
+        vk::Buffer m_buffer;
+        MemoryAllocation m_allocation;
+        vk::DeviceSize m_bytesPerFrame = 0;
+        vk::DeviceSize m_alignment = 1;
+
+        vk::DeviceSize m_persistentBytes = 0;
+        vk::DeviceSize m_persistentUsed = 0;
+        std::vector<Slot> m_freeSlots;
+
+        vk::DeviceSize m_frameStart = 0;
+        vk::DeviceSize m_cursor = 0;
+    };
+}
@@ -0,0 +1,435 @@
+#include "UploadQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+#pragma warning(disable: 4834) // allow ignoring nodiscard
+
+namespace GAP311
+{
+
+bool UploadQueue::Initialize(vk::Device device, DeviceMemoryAllocator& allocator, uint32_t frameCount, const QueueInfo& queues, vk::DeviceSize ringSize)
+{
+    m_device = device;
+    m_pAllocator = &allocator;
+    m_queues = queues;
+    m_sharedFamilies = { queues.graphicsFamily, queues.transferFamily };
+    m_frames.resize(frameCount);
+    m_recordCount = 0;
+    m_graphicsWrites.clear();
+
+    if (m_queues.transferQueue)
+    {
+        vk::CommandPoolCreateInfo commandPoolCreateInfo;
+        commandPoolCreateInfo.queueFamilyIndex = m_queues.transferFamily;
+        commandPoolCreateInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+        m_transferCommandPool = device.createCommandPool(commandPoolCreateInfo);
+        if (!m_transferCommandPool)
+            return false;
+
+        vk::CommandBufferAllocateInfo cbAllocateInfo;
+        cbAllocateInfo.commandPool = m_transferCommandPool;
+        cbAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
+        cbAllocateInfo.commandBufferCount = frameCount;
+        std::vector<vk::CommandBuffer> cbs = device.allocateCommandBuffers(cbAllocateInfo);
+        if (cbs.size() != frameCount)
+            return false;
+
+        for (uint32_t i = 0; i < frameCount; ++i)
+        {
+            m_frames[i].transferCommandBuffer = cbs[i];
+            m_frames[i].semaphoreTransferred = device.createSemaphore(vk::SemaphoreCreateInfo());
+            if (!m_frames[i].semaphoreTransferred)
+                return false;
+        }
+    }
+
+    m_ringSize = ringSize;
+    m_ringHead = m_ringTail = 0;
+    return CreateStagingBuffer(m_ringSize, m_ring);
+}
+
+void UploadQueue::Shutdown()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& frame : m_frames)
+    {
+        for (auto& staging : frame.stagingBuffers)
+            DestroyStagingBuffer(staging);
+        if (frame.semaphoreTransferred)
+            m_device.destroySemaphore(frame.semaphoreTransferred);
+    }
+    m_frames.clear();
+
+    if (m_transferCommandPool)
+    {
+        m_device.destroyCommandPool(m_transferCommandPool);
+        m_transferCommandPool = nullptr;
+    }
+
+    for (auto& staging : m_pendingStagingBuffers)
+        DestroyStagingBuffer(staging);
+    m_pendingStagingBuffers.clear();
+    m_pendingCopies.clear();
+    m_pendingBytes = 0;
+    m_graphicsWrites.clear();
+
+    DestroyStagingBuffer(m_ring);
+    m_pAllocator = nullptr;
+    m_device = nullptr;
+}
+
+bool UploadQueue::EnqueueBufferUpload(vk::Buffer dstBuffer, vk::DeviceSize dstOffset, const void* pData, vk::DeviceSize size,
+    vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    PendingCopy copy;
+    if (!Stage(pData, size, copy.srcBuffer, copy.bufferRegion.srcOffset))
+        return false;
+
+    copy.stagedSize = size;
+    copy.dstBuffer = dstBuffer;
+    copy.bufferRegion.dstOffset = dstOffset;
+    copy.bufferRegion.size = size;
+    copy.dstStages = dstStages;
+    copy.dstAccess = dstAccess;
+
+    m_pendingCopies.push_back(copy);
+    m_pendingBytes += size;
+    return true;
+}
+
+bool UploadQueue::EnqueueImageUpload(vk::Image dstImage, const vk::ImageSubresourceLayers& subresource, vk::Extent3D extent,
+    const void* pData, vk::DeviceSize size, vk::ImageLayout finalLayout, vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    PendingCopy copy;
+    if (!Stage(pData, size, copy.srcBuffer, copy.imageRegion.bufferOffset))
+        return false;
+
+    copy.stagedSize = size;
+    copy.dstImage = dstImage;
+    copy.imageRegion.imageSubresource = subresource;
+    copy.imageRegion.imageExtent = extent;
+    copy.finalLayout = finalLayout;
+    copy.dstStages = dstStages;
+    copy.dstAccess = dstAccess;
+
+    m_pendingCopies.push_back(copy);
+    m_pendingBytes += size;
+    return true;
+}
+
+void UploadQueue::ShareWithTransferQueue(vk::BufferCreateInfo& bufferInfo) const
+{
+    if (!m_queues.transferQueue || m_queues.transferFamily == m_queues.graphicsFamily)
+        return;
+
+    bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_sharedFamilies.size());
+    bufferInfo.pQueueFamilyIndices = m_sharedFamilies.data();
+}
+
+void UploadQueue::SyncWithGraphicsQueue(vk::Buffer dstBuffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_graphicsWrites[static_cast<VkBuffer>(dstBuffer)] = m_recordCount;
+}
+
+void UploadQueue::Cancel(vk::Buffer dstBuffer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_graphicsWrites.erase(static_cast<VkBuffer>(dstBuffer));
+    CancelIf([&](const PendingCopy& copy) { return copy.dstBuffer && copy.dstBuffer == dstBuffer; });
+}
+
+void UploadQueue::Cancel(vk::Image dstImage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CancelIf([&](const PendingCopy& copy) { return copy.dstImage && copy.dstImage == dstImage; });
+}
+
+bool UploadQueue::HasPendingUploads(vk::Buffer dstBuffer) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::any_of(m_pendingCopies.begin(), m_pendingCopies.end(), [&](const PendingCopy& copy) { return copy.dstBuffer == dstBuffer; });
+}
+
+void UploadQueue::BeginFrame(uint32_t frameIndex)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The frame's graphics work waited on its transfer submission, so both are complete
+    FrameData& frame = m_frames[frameIndex];
+    m_ringTail = std::max(m_ringTail, frame.ringEnd);
+
+    for (auto& staging : frame.stagingBuffers)
+        DestroyStagingBuffer(staging);
+    frame.stagingBuffers.clear();
+}
+
+vk::Semaphore UploadQueue::Record(vk::CommandBuffer& cb, uint32_t frameIndex, vk::PipelineStageFlags& outWaitStages)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Frames are recorded in turn, the frame which reuses a frame's resources has waited for it to finish
+    uint64_t recordIndex = m_recordCount++;
+    for (auto it = m_graphicsWrites.begin(); it != m_graphicsWrites.end();)
+    {
+        if (it->second + m_frames.size() <= recordIndex)
+            it = m_graphicsWrites.erase(it);
+        else
+            ++it;
+    }
+
+    FrameData& frame = m_frames[frameIndex];
+    frame.ringEnd = m_ringHead;
+    frame.stagingBuffers.insert(frame.stagingBuffers.end(), m_pendingStagingBuffers.begin(), m_pendingStagingBuffers.end());
+    m_pendingStagingBuffers.clear();
+
+    outWaitStages = {};
+    if (m_pendingCopies.empty())
+        return nullptr;
+
+    // The transfer queue doesn't wait for earlier graphics work, copies into buffers a frame which
+    // may still be running wrote stay on the graphics queue
+    std::vector<PendingCopy> graphicsCopies;
+    std::vector<PendingCopy> transferCopies;
+    for (auto& copy : m_pendingCopies)
+    {
+        bool graphics = !m_queues.transferQueue || (copy.dstBuffer && m_graphicsWrites.count(static_cast<VkBuffer>(copy.dstBuffer)));
+        (graphics ? graphicsCopies : transferCopies).push_back(copy);
+    }
+
+    std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+    vk::Semaphore semaphore;
+
+    if (!transferCopies.empty())
+    {
+        vk::PipelineStageFlags dstStages;
+        for (auto& copy : transferCopies)
+            dstStages |= copy.dstStages;
+
+        vk::CommandBuffer& transferCb = frame.transferCommandBuffer;
+        transferCb.reset();
+
+        vk::CommandBufferBeginInfo beginInfo;
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        transferCb.begin(&beginInfo);
+
+        RecordCopies(transferCb, transferCopies);
+
+        // Release ownership on the transfer queue...
+        BuildBarriers(transferCopies, m_queues.transferFamily, m_queues.graphicsFamily, true, bufferBarriers, imageBarriers);
+        transferCb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, bufferBarriers, imageBarriers);
+        transferCb.end();
+
+        vk::SubmitInfo submitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &transferCb;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &frame.semaphoreTransferred;
+        m_queues.transferQueue.submit(1, &submitInfo, nullptr);
+
+        // ...and acquire it on the graphics queue once the semaphore has been waited on
+        BuildBarriers(transferCopies, m_queues.transferFamily, m_queues.graphicsFamily, false, bufferBarriers, imageBarriers);
+        cb.pipelineBarrier(dstStages, dstStages, {}, {}, bufferBarriers, imageBarriers);
+
+        semaphore = frame.semaphoreTransferred;
+        outWaitStages = dstStages;
+    }
+
+    if (!graphicsCopies.empty())
+    {
+        vk::PipelineStageFlags dstStages;
+        for (auto& copy : graphicsCopies)
+            dstStages |= copy.dstStages;
+
+        RecordCopies(cb, graphicsCopies);
+
+        BuildBarriers(graphicsCopies, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, false, bufferBarriers, imageBarriers);
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStages, {}, {}, bufferBarriers, imageBarriers);
+    }
+
+    m_pendingCopies.clear();
+    m_pendingBytes = 0;
+    return semaphore;
+}
+
+vk::DeviceSize UploadQueue::GetPendingBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pendingBytes;
+}
+
+bool UploadQueue::Stage(const void* pData, vk::DeviceSize size, vk::Buffer& srcBuffer, vk::DeviceSize& srcOffset)
+{
+    // Find room in the ring, skipping the tail end of the buffer if the data would straddle it
+    uint64_t position = (m_ringHead + s_kCopyAlignment - 1) & ~(s_kCopyAlignment - 1);
+    if (position % m_ringSize + size > m_ringSize)
+        position += m_ringSize - position % m_ringSize;
+
+    if (position + size - m_ringTail <= m_ringSize)
+    {
+        srcOffset = position % m_ringSize;
+        std::memcpy(static_cast<uint8_t*>(m_ring.allocation.pMapped) + srcOffset, pData, size);
+        m_pAllocator->Flush(m_ring.allocation, srcOffset, size);
+
+        srcBuffer = m_ring.buffer;
+        m_ringHead = position + size;
+        return true;
+    }
+
+    StagingBuffer staging;
+    if (!CreateStagingBuffer(size, staging))
+        return false;
+
+    std::memcpy(staging.allocation.pMapped, pData, size);
+    m_pAllocator->Flush(staging.allocation);
+
+    srcBuffer = staging.buffer;
+    srcOffset = 0;
+    m_pendingStagingBuffers.push_back(staging);
+    return true;
+}
+
+void UploadQueue::CancelIf(const std::function<bool(const PendingCopy&)>& predicate)
+{
+    // The staging memory stays reserved until the next recorded frame retires it
+    auto it = std::remove_if(m_pendingCopies.begin(), m_pendingCopies.end(), predicate);
+    for (auto cancelled = it; cancelled != m_pendingCopies.end(); ++cancelled)
+        m_pendingBytes -= cancelled->stagedSize;
+    m_pendingCopies.erase(it, m_pendingCopies.end());
+}
+
+void UploadQueue::RecordCopies(vk::CommandBuffer& cb, const std::vector<PendingCopy>& copies)
+{
+    // Images are written whole, so their previous contents can be discarded
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+    for (auto& copy : copies)
+    {
+        if (!copy.dstImage)
+            continue;
+
+        vk::ImageMemoryBarrier barrier;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.oldLayout = vk::ImageLayout::eUndefined;
+        barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = copy.dstImage;
+        barrier.subresourceRange = vk::ImageSubresourceRange(copy.imageRegion.imageSubresource.aspectMask,
+            copy.imageRegion.imageSubresource.mipLevel, 1, copy.imageRegion.imageSubresource.baseArrayLayer,
+            copy.imageRegion.imageSubresource.layerCount);
+        imageBarriers.push_back(barrier);
+    }
+    if (!imageBarriers.empty())
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, imageBarriers);
+
+    // Consecutive copies between the same pair of buffers go out as a single command
+    std::vector<vk::BufferCopy> regions;
+    for (size_t i = 0; i < copies.size(); ++i)
+    {
+        const PendingCopy& copy = copies[i];
+        if (copy.dstImage)
+        {
+            cb.copyBufferToImage(copy.srcBuffer, copy.dstImage, vk::ImageLayout::eTransferDstOptimal, copy.imageRegion);
+            continue;
+        }
+
+        regions.push_back(copy.bufferRegion);
+
+        bool last = i + 1 == copies.size();
+        if (last || copies[i + 1].srcBuffer != copy.srcBuffer || copies[i + 1].dstBuffer != copy.dstBuffer)
+        {
+            cb.copyBuffer(copy.srcBuffer, copy.dstBuffer, regions);
+            regions.clear();
+        }
+    }
+}
+
+void UploadQueue::BuildBarriers(const std::vector<PendingCopy>& copies, uint32_t srcFamily, uint32_t dstFamily, bool release,
+    std::vector<vk::BufferMemoryBarrier>& bufferBarriers, std::vector<vk::ImageMemoryBarrier>& imageBarriers)
+{
+    // A release only makes the transfer writes available, an acquire makes them visible to the consumers.
+    // Without a queue family transfer a single barrier does both.
+    bool acquire = srcFamily != VK_QUEUE_FAMILY_IGNORED && !release;
+    vk::AccessFlags srcAccess = acquire ? vk::AccessFlags() : vk::AccessFlagBits::eTransferWrite;
+
+    bufferBarriers.clear();
+    imageBarriers.clear();
+    for (auto& copy : copies)
+    {
+        vk::AccessFlags dstAccess = release ? vk::AccessFlags() : copy.dstAccess;
+
+        if (copy.dstImage)
+        {
+            vk::ImageMemoryBarrier barrier;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+            barrier.newLayout = copy.finalLayout;
+            barrier.srcQueueFamilyIndex = srcFamily;
+            barrier.dstQueueFamilyIndex = dstFamily;
+            barrier.image = copy.dstImage;
+            barrier.subresourceRange = vk::ImageSubresourceRange(copy.imageRegion.imageSubresource.aspectMask,
+                copy.imageRegion.imageSubresource.mipLevel, 1, copy.imageRegion.imageSubresource.baseArrayLayer,
+                copy.imageRegion.imageSubresource.layerCount);
+            imageBarriers.push_back(barrier);
+        }
+        else
+        {
+            // Buffers are shared by both families, see ShareWithTransferQueue, ownership never moves
+            vk::BufferMemoryBarrier barrier;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = copy.dstBuffer;
+            barrier.offset = copy.bufferRegion.dstOffset;
+            barrier.size = copy.bufferRegion.size;
+            bufferBarriers.push_back(barrier);
+        }
+    }
+}
+
+bool UploadQueue::CreateStagingBuffer(vk::DeviceSize size, StagingBuffer& staging)
+{
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = size;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+
+    staging.buffer = m_device.createBuffer(bufferInfo);
+    if (!staging.buffer)
+        return false;
+
+    // The CPU only ever writes staging memory sequentially, so coherent write-combined memory is ideal
+    auto bufferMemoryReq = m_device.getBufferMemoryRequirements(staging.buffer);
+    if (!m_pAllocator->Allocate(bufferMemoryReq, vk::MemoryPropertyFlagBits::eHostVisible,
+        vk::MemoryPropertyFlagBits::eHostCoherent, ResourceTiling::eLinear, MemoryCategory::eStaging, staging.allocation))
+    {
+        m_device.destroyBuffer(staging.buffer);
+        staging.buffer = nullptr;
+        return false;
+    }
+
+    m_device.bindBufferMemory(staging.buffer, staging.allocation.memory, staging.allocation.offset);
+    return true;
+}
+
+void UploadQueue::DestroyStagingBuffer(StagingBuffer& staging)
+{
+    if (staging.buffer)
+    {
+        m_device.destroyBuffer(staging.buffer);
+        staging.buffer = nullptr;
+    }
+    m_pAllocator->Free(staging.allocation);
+}
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+#include <vulkan/vulkan.hpp>
+
+#include "MemoryAllocator.h"
+
+namespace GAP311
+{
+    /// Moves data into device local buffers and images through a host visible staging ring.
+    ///
+    /// Uploads are copied into the ring when they are enqueued and the GPU side copies
+    /// are recorded in one batch per frame, followed by the barriers making them visible
+    /// to the stages that consume them. Ring space is reclaimed once the frame that
+    /// recorded the copies has finished on the GPU. Uploads that don't fit in the ring
+    /// get a temporary staging buffer of their own.
+    ///
+    /// When the device has a separate transfer queue the copies are submitted there instead
+    /// of the frame's command buffer, and the graphics queue waits on a semaphore signalled by
+    /// the transfer submission only at the stages which read the uploaded data. Images are
+    /// written whole, their ownership is released by the transfer queue and acquired by the
+    /// graphics queue. Buffers are written a range at a time, ownership would have to go back
+    /// and forth with every upload, so they are shared by both queue families instead.
+    class UploadQueue
+    {
+    public:
+        struct QueueInfo
+        {
+            uint32_t graphicsFamily = 0;
+            vk::Queue transferQueue;    // null to record copies on the graphics queue
+            uint32_t transferFamily = 0;
+        };
+
+        bool Initialize(vk::Device device, DeviceMemoryAllocator& allocator, uint32_t frameCount, const QueueInfo& queues,
+            vk::DeviceSize ringSize = 32ull * 1024 * 1024);
+        void Shutdown();
+
+        /// Stages pData and queues a copy of it into dstBuffer at dstOffset.
+        /// dstStages/dstAccess describe how the buffer is consumed once the copy completes.
+        bool EnqueueBufferUpload(vk::Buffer dstBuffer, vk::DeviceSize dstOffset, const void* pData, vk::DeviceSize size,
+            vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess);
+
+        /// Stages pData and queues a copy of it into a whole subresource of dstImage.
+        /// The previous contents are discarded and the image ends up in finalLayout.
+        bool EnqueueImageUpload(vk::Image dstImage, const vk::ImageSubresourceLayers& subresource, vk::Extent3D extent,
+            const void* pData, vk::DeviceSize size, vk::ImageLayout finalLayout, vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess);
+
+        /// Buffers uploaded into must be created through this, it makes them concurrent between
+        /// the graphics and transfer queue families. bufferInfo must not outlive the upload queue.
+        void ShareWithTransferQueue(vk::BufferCreateInfo& bufferInfo) const;
+
+        /// dstBuffer was written by the frame being recorded on the graphics queue. Copies into it
+        /// are recorded into the frame's command buffer, behind that write, until the frame finished.
+        void SyncWithGraphicsQueue(vk::Buffer dstBuffer);
+
+        /// Drops queued copies into a resource which is about to be destroyed
+        void Cancel(vk::Buffer dstBuffer);
+        void Cancel(vk::Image dstImage);
+
+        /// Whether copies into dstBuffer are waiting to be recorded
+        bool HasPendingUploads(vk::Buffer dstBuffer) const;
+
+        /// Call once the fence of frameIndex has signalled, reclaims the staging memory that frame used
+        void BeginFrame(uint32_t frameIndex);
+
+        /// Hands every queued copy over to frame frameIndex, recording the work which must happen on
+        /// the graphics queue into cb. Returns a semaphore the frame's submission must wait on at
+        /// outWaitStages, or a null handle when nothing was submitted to the transfer queue.
+        vk::Semaphore Record(vk::CommandBuffer& cb, uint32_t frameIndex, vk::PipelineStageFlags& outWaitStages);
+
+        bool HasTransferQueue() const { return static_cast<bool>(m_queues.transferQueue); }
+        vk::DeviceSize GetPendingBytes() const;
+
+    private:
+        static constexpr vk::DeviceSize s_kCopyAlignment = 16;
+
+        struct PendingCopy
+        {
+            vk::Buffer srcBuffer;
+            vk::DeviceSize stagedSize = 0;
+            vk::Buffer dstBuffer;
+            vk::BufferCopy bufferRegion;
+            vk::Image dstImage;
+            vk::BufferImageCopy imageRegion;
+            vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+            vk::PipelineStageFlags dstStages;
+            vk::AccessFlags dstAccess;
+        };
+
+        struct StagingBuffer
+        {
+            vk::Buffer buffer;
+            MemoryAllocation allocation;
+        };
+
+        struct FrameData
+        {
+            uint64_t ringEnd = 0;                       // ring position after this frame's uploads
+            std::vector<StagingBuffer> stagingBuffers;  // oversized uploads to release with the frame
+            vk::CommandBuffer transferCommandBuffer;
+            vk::Semaphore semaphoreTransferred;
+        };
+
+        bool Stage(const void* pData, vk::DeviceSize size, vk::Buffer& srcBuffer, vk::DeviceSize& srcOffset);
+        void CancelIf(const std::function<bool(const PendingCopy&)>& predicate);
+        static void RecordCopies(vk::CommandBuffer& cb, const std::vector<PendingCopy>& copies);
+        static void BuildBarriers(const std::vector<PendingCopy>& copies, uint32_t srcFamily, uint32_t dstFamily, bool release,
+            std::vector<vk::BufferMemoryBarrier>& bufferBarriers, std::vector<vk::ImageMemoryBarrier>& imageBarriers);
+        bool CreateStagingBuffer(vk::DeviceSize size, StagingBuffer& staging);
+        void DestroyStagingBuffer(StagingBuffer& staging);
+
+        vk::Device m_device;
+        DeviceMemoryAllocator* m_pAllocator = nullptr;
+        QueueInfo m_queues;
+        std::array<uint32_t, 2> m_sharedFamilies = {};
+        vk::CommandPool m_transferCommandPool;
+
+        // The ring positions only ever grow, the offset into the buffer is position % ring size
+        StagingBuffer m_ring;
+        vk::DeviceSize m_ringSize = 0;
+        uint64_t m_ringHead = 0;
+        uint64_t m_ringTail = 0;
+
+        std::vector<PendingCopy> m_pendingCopies;
+        std::vector<StagingBuffer> m_pendingStagingBuffers;
+        vk::DeviceSize m_pendingBytes = 0;
+
+        std::vector<FrameData> m_frames;
+        uint64_t m_recordCount = 0;
+        std::unordered_map<VkBuffer, uint64_t> m_graphicsWrites;   // buffer -> m_recordCount of the frame writing it
+        mutable std::mutex m_mutex;
+    };
+}
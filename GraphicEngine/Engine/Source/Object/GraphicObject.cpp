@@ -5,10 +5,12 @@
 #include <glm/gtx/euler_angles.hpp>
 
 GraphicObject::GraphicObject()
-	: m_objectUniform()
+	: m_objectConstants()
 	, m_position()
 	, m_vertices()
 	, m_indices()
+	, m_materialUniform()
+	, m_materialDirtyFrames(~0u)
 {
 	m_components.reserve(100);
 	m_delayComponentRemoveList.reserve(100);
@@ -19,7 +21,9 @@ GraphicObject::GraphicObject()
 
 GraphicObject::GraphicObject(const glm::vec3& pos)
 	: m_position(pos)
-	, m_objectUniform()
+	, m_objectConstants()
+	, m_materialUniform()
+	, m_materialDirtyFrames(~0u)
 {
 	m_components.reserve(100);
 	m_delayComponentRemoveList.reserve(100);
@@ -27,13 +31,15 @@ GraphicObject::GraphicObject(const glm::vec3& pos)
 	m_children.reserve(100);
 	m_delayChildrenRemoveList.reserve(100);
 
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 }
 
 GraphicObject::GraphicObject(const glm::vec3& pos, const std::vector<Vertex>& vertices)
 	: m_vertices(vertices)
 	, m_position(pos)
-	, m_objectUniform()
+	, m_objectConstants()
+	, m_materialUniform()
+	, m_materialDirtyFrames(~0u)
 {
 	m_indices.reserve(1000);
 	m_components.reserve(100);
@@ -42,13 +48,15 @@ GraphicObject::GraphicObject(const glm::vec3& pos, const std::vector<Vertex>& ve
 	m_children.reserve(100);
 	m_delayChildrenRemoveList.reserve(100);
 
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 }
 
 GraphicObject::GraphicObject(const glm::vec3& pos, std::vector<Vertex>&& vertices)
 	: m_vertices(vertices)
 	, m_position(pos)
-	, m_objectUniform()
+	, m_objectConstants()
+	, m_materialUniform()
+	, m_materialDirtyFrames(~0u)
 {
 	m_indices.reserve(1000);
 	m_components.reserve(100);
@@ -57,14 +65,16 @@ GraphicObject::GraphicObject(const glm::vec3& pos, std::vector<Vertex>&& vertice
 	m_children.reserve(100);
 	m_delayChildrenRemoveList.reserve(100);
 
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 }
 
 GraphicObject::GraphicObject(const glm::vec3& pos, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
 	: m_vertices(vertices)
 	, m_indices(indices)
 	, m_position(pos)
-	, m_objectUniform()
+	, m_objectConstants()
+	, m_materialUniform()
+	, m_materialDirtyFrames(~0u)
 {
 	m_components.reserve(100);
 	m_delayComponentRemoveList.reserve(100);
@@ -72,14 +82,16 @@ GraphicObject::GraphicObject(const glm::vec3& pos, const std::vector<Vertex>& ve
 	m_children.reserve(100);
 	m_delayChildrenRemoveList.reserve(100);
 
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 }
 
 GraphicObject::GraphicObject(const glm::vec3& pos, std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices)
 	: m_vertices(vertices)
 	, m_indices(indices)
 	, m_position(pos)
-	, m_objectUniform()
+	, m_objectConstants()
+	, m_materialUniform()
+	, m_materialDirtyFrames(~0u)
 {
 	m_components.reserve(100);
 	m_delayComponentRemoveList.reserve(100);
@@ -87,7 +99,7 @@ GraphicObject::GraphicObject(const glm::vec3& pos, std::vector<Vertex>&& vertice
 	m_children.reserve(100);
 	m_delayChildrenRemoveList.reserve(100);
 
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 }
 
 GraphicObject::~GraphicObject()
@@ -110,7 +122,7 @@ void GraphicObject::Update(float frameTime)
 void GraphicObject::ChangePosition(const glm::vec3& delta)
 {
 	m_position += delta;
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 
 	for (int i = (int)m_children.size() - 1; i >= 0; --i)
 	{
@@ -129,7 +141,7 @@ void GraphicObject::SetPosition(const glm::vec3& pos)
 	glm::vec3 delta = pos - m_position;
 
 	m_position = pos;
-	m_objectUniform.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
+	m_objectConstants.worldMatrix = glm::translate(glm::identity<glm::mat4>(), m_position);
 
 	for (int i = (int)m_children.size() - 1; i >= 0; --i)
 	{
@@ -145,21 +157,18 @@ void GraphicObject::SetPosition(const glm::vec3& pos)
 
 void GraphicObject::Rotate(float angle, glm::vec3 axis)
 {
-	m_objectUniform.worldMatrix = glm::rotate(m_objectUniform.worldMatrix, angle, axis);
+	m_objectConstants.worldMatrix = glm::rotate(m_objectConstants.worldMatrix, angle, axis);
 }
 
 void GraphicObject::Draw(vk::CommandBuffer& cb)
 {
-	cb.bindVertexBuffers(0, m_vertexBuffer, vk::DeviceSize(0));
-	
-	if (m_indices.size() > 0)
+	if (m_geometry.indexCount > 0)
 	{
-		cb.bindIndexBuffer(m_indexBuffer, vk::DeviceSize(0), vk::IndexType::eUint32);
-		cb.drawIndexed(static_cast<uint32_t>(m_indices.size()), 1, 0, 0, 0);
+		cb.drawIndexed(m_geometry.indexCount, 1, m_geometry.firstIndex, static_cast<int32_t>(m_geometry.vertexOffset), 0);
 	}
 	else
 	{
-		cb.draw(static_cast<uint32_t>(m_vertices.size()), 1, 0, 0);
+		cb.draw(m_geometry.vertexCount, 1, m_geometry.vertexOffset, 0);
 	}
 }
 
@@ -201,25 +210,36 @@ void GraphicObject::AddChild(std::weak_ptr<GraphicObject> child)
 
 void GraphicObject::SetMaterialDiffuse(const glm::vec4& diffuse)
 {
-	m_objectUniform.materialDiffuse = diffuse;
+	m_materialUniform.materialDiffuse = diffuse;
+	MarkMaterialDirty();
 }
 
 void GraphicObject::SetMaterialEmissive(const glm::vec4& emissive)
 {
-	m_objectUniform.materialEmissive = emissive;
+	m_materialUniform.materialEmissive = emissive;
+	MarkMaterialDirty();
 }
 
 void GraphicObject::SetMaterialSpecular(const glm::vec4& specular)
 {
-	m_objectUniform.materialSpecular = specular;
+	m_materialUniform.materialSpecular = specular;
+	MarkMaterialDirty();
 }
 
 void GraphicObject::SetMaterialAmbient(const glm::vec4& ambient)
 {
-	m_objectUniform.materialAmbient = ambient;
+	m_materialUniform.materialAmbient = ambient;
+	MarkMaterialDirty();
 }
 
 void GraphicObject::SetMaterialShininess(float shine)
 {
-	m_objectUniform.materialShininess = shine;
+	m_materialUniform.materialShininess = shine;
+	MarkMaterialDirty();
+}
+
+void GraphicObject::SetMaterialFeatures(uint32_t features)
+{
+	m_materialUniform.materialFeatures = features;
+	MarkMaterialDirty();
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "ResourceLoader/GraphicsData.h"
+#include "ResourceLoader/TexturePacker.h"
 #include "Framework/Framework.h"
 
 #include <vector>
@@ -19,15 +20,17 @@ protected:
 	std::vector<std::weak_ptr<GraphicObject>> m_children;
 	std::vector<size_t> m_delayChildrenRemoveList;
 
-	vk::Buffer m_vertexBuffer;
-	vk::DeviceMemory m_vertexBufferMemory;
-	vk::Buffer m_indexBuffer;
-	vk::DeviceMemory m_indexBufferMemory;
+	GAP311::GeometryRange m_geometry;	// where the mesh lives in the scene's geometry arena
 
 	glm::vec3 m_position;
+	TextureSlot m_materialTexture;
 
-public:
-	ObjectUniforms m_objectUniform;
+	// The transform is pushed with every draw. The material changes rarely and has a persistent
+	// copy per frame in flight, with a bit per frame whose copy is out of date
+	ObjectConstants m_objectConstants;
+	MaterialUniforms m_materialUniform;
+	GAP311::UniformRing::Slot m_materialSlot;
+	uint32_t m_materialDirtyFrames;
 
 public:
 	GraphicObject();
@@ -47,28 +50,33 @@ public:
 	void ChangePosition(const glm::vec3& delta);
 	void SetPosition(const glm::vec3& pos);
 	void Rotate(float angle, glm::vec3 axis);
-	void Draw(vk::CommandBuffer& cb);
+	void Draw(vk::CommandBuffer& cb);	// expects the geometry arena to be bound
 
 	void AddComponent(std::unique_ptr<IComponent> comp);
 	void RemoveExpiredComponentsAndChildren();
 	void AddChild(std::weak_ptr<GraphicObject> child);
 
-	void EnableLighting() { m_objectUniform.enableLighting = true; }
-	void DisableLighting() { m_objectUniform.enableLighting = false; }
 	void SetMaterialDiffuse(const glm::vec4& diffuse);
 	void SetMaterialEmissive(const glm::vec4& emissive);
 	void SetMaterialSpecular(const glm::vec4& specular);
 	void SetMaterialAmbient(const glm::vec4& ambient);
 	void SetMaterialShininess(float shine);
+	void SetMaterialFeatures(uint32_t features);
+	void SetMaterialTexture(const TextureSlot& slot) { m_materialTexture = slot; }
+	const TextureSlot& MaterialTexture() const { return m_materialTexture; }
 
 	std::vector<Vertex>& Vertices() { return m_vertices; }
 	std::vector<uint32_t>& Indices() { return m_indices; }
-	vk::Buffer& VertexBuffer() { return m_vertexBuffer; }
-	vk::DeviceMemory& VertexBufferMemory() { return m_vertexBufferMemory; }
-	vk::Buffer& IndexBuffer() { return m_indexBuffer; }
-	vk::DeviceMemory& IndexBufferMemory() { return m_indexBufferMemory; }
-	//size_t UniformSize() const { return sizeof(m_objectUniform); }
-	//ObjectUniforms& Uniform() { return m_objectUniform; }
+	GAP311::GeometryRange& Geometry() { return m_geometry; }
+
+	const ObjectConstants& Constants() const { return m_objectConstants; }
+	void SetIndices(uint32_t objectIndex, uint32_t materialIndex) { m_objectConstants.objectIndex = objectIndex; m_objectConstants.materialIndex = materialIndex; }
+
+	const MaterialUniforms& MaterialUniform() const { return m_materialUniform; }
+	GAP311::UniformRing::Slot& MaterialSlot() { return m_materialSlot; }
+	void MarkMaterialDirty() { m_materialDirtyFrames = ~0u; }
+	bool IsMaterialDirty(uint32_t frameIndex) const { return (m_materialDirtyFrames & (1u << frameIndex)) != 0; }
+	void ClearMaterialDirty(uint32_t frameIndex) { m_materialDirtyFrames &= ~(1u << frameIndex); }
 	glm::vec3 Position() const { return m_position; }
 };
 
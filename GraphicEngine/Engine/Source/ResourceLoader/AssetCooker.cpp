@@ -0,0 +1,615 @@
+#include "AssetCooker.h"
+#include "CookedAssets.h"
+#include "GraphicsFileLoader.h"
+#include "TextureCompression.h"
+#include "Framework/ThreadPool.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <charconv>
+#include <list>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	// Reorders triangles for the post-transform vertex cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		constexpr int kCacheSize = 32;
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+		for (uint32_t t = 0; t < triangleCount; ++t)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+				vertexTriangles[indices[t * 3 + corner]].emplace_back(t);
+		}
+
+		std::vector<int> remainingValence(vertexCount);
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+			remainingValence[v] = (int)vertexTriangles[v].size();
+
+		auto scoreVertex = [&](uint32_t v) {
+			if (remainingValence[v] == 0)
+				return -1.0f;
+
+			float score = 0.0f;
+			int position = cachePosition[v];
+			if (position >= 0)
+			{
+				// The last triangle's vertices get a fixed score so the next one doesn't simply reuse them
+				score = position < 3 ? 0.75f : std::pow(1.0f - float(position - 3) / (kCacheSize - 3), 1.5f);
+			}
+			// Favour finishing off vertices with few triangles left
+			return score + 2.0f * std::pow(float(remainingValence[v]), -0.5f);
+		};
+
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<bool> triangleEmitted(triangleCount, false);
+		for (size_t v = 0; v < vertexCount; ++v)
+			vertexScore[v] = scoreVertex((uint32_t)v);
+		for (size_t t = 0; t < triangleCount; ++t)
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		std::list<uint32_t> cache;
+		size_t scanCursor = 0;
+
+		int64_t bestTriangle = -1;
+		for (size_t emitted = 0; emitted < triangleCount; ++emitted)
+		{
+			if (bestTriangle < 0)
+			{
+				// Nothing useful in the cache, continue with the best remaining triangle
+				while (triangleEmitted[scanCursor])
+					++scanCursor;
+				bestTriangle = (int64_t)scanCursor;
+				for (size_t t = scanCursor; t < triangleCount; ++t)
+				{
+					if (!triangleEmitted[t] && triangleScore[t] > triangleScore[bestTriangle])
+						bestTriangle = (int64_t)t;
+				}
+			}
+
+			triangleEmitted[bestTriangle] = true;
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				uint32_t v = indices[bestTriangle * 3 + corner];
+				result.emplace_back(v);
+
+				auto& triangles = vertexTriangles[v];
+				triangles.erase(std::find(triangles.begin(), triangles.end(), (uint32_t)bestTriangle));
+				--remainingValence[v];
+
+				cache.remove(v);
+				cache.push_front(v);
+			}
+
+			// Refresh the cache positions and the scores of every triangle touching the cache
+			int position = 0;
+			for (auto it = cache.begin(); it != cache.end(); ++position)
+			{
+				uint32_t v = *it;
+				if (position >= kCacheSize)
+				{
+					cachePosition[v] = -1;
+					vertexScore[v] = scoreVertex(v);
+					it = cache.erase(it);
+					continue;
+				}
+
+				cachePosition[v] = position;
+				vertexScore[v] = scoreVertex(v);
+				++it;
+			}
+
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (uint32_t v : cache)
+			{
+				for (uint32_t t : vertexTriangles[v])
+				{
+					triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+					if (triangleScore[t] > bestScore)
+					{
+						bestScore = triangleScore[t];
+						bestTriangle = t;
+					}
+				}
+			}
+		}
+
+		indices = std::move(result);
+	}
+
+	// Renumbers vertices in the order the index buffer first touches them and drops unused ones
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+		std::vector<Vertex> ordered;
+		ordered.reserve(vertices.size());
+
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] == UINT32_MAX)
+			{
+				remap[index] = (uint32_t)ordered.size();
+				ordered.emplace_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+
+		vertices = std::move(ordered);
+	}
+
+	bool ReadLines(const std::string& filename, std::vector<std::string>& outLines)
+	{
+		std::ifstream file(filename);
+		if (!file.is_open())
+			return false;
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			outLines.emplace_back(std::move(line));
+		}
+		return true;
+	}
+
+	bool WriteFile(const std::string& filename, const void* pData, size_t size)
+	{
+		// Called from the cooker's pool tasks, failures are returned rather than thrown
+		std::error_code error;
+		fs::create_directories(fs::path(filename).parent_path(), error);
+		if (error)
+			return false;
+
+		// Write next to the target and rename, so an interrupted cook never leaves a truncated asset
+		std::string tempFilename = filename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				return false;
+			file.write(static_cast<const char*>(pData), size);
+			if (!file.good())
+				return false;
+		}
+
+		fs::rename(tempFilename, filename, error);
+		return !error;
+	}
+
+	std::string SiblingPath(const std::string& filename, const std::string& sibling)
+	{
+		return (fs::path(filename).parent_path() / sibling).generic_string();
+	}
+}
+
+AssetCooker::AssetCooker(const Settings& settings, ImageDecoder imageDecoder)
+	: m_settings(settings)
+	, m_imageDecoder(std::move(imageDecoder))
+{
+}
+
+AssetCooker::~AssetCooker()
+{
+}
+
+bool AssetCooker::Cook(Stats& outStats)
+{
+	outStats = Stats();
+
+	for (const std::string& input : m_settings.m_inputs)
+	{
+		ScanInput(input);
+	}
+	outStats.m_assetCount = m_nodes.size();
+
+	if (!m_settings.m_force)
+		LoadManifest();
+
+	std::vector<size_t> dirtyNodes;
+	for (size_t i = 0; i < m_nodes.size(); ++i)
+	{
+		AssetNode& node = m_nodes[i];
+		if (!HashNode(node))
+		{
+			std::cout << "Missing input for " << node.m_source << "\n";
+			++outStats.m_failedCount;
+			continue;
+		}
+
+		auto it = m_manifest.find(node.m_output);
+		if (it != m_manifest.end() && it->second == node.m_hash && fs::exists(OutputPath(node)))
+		{
+			++outStats.m_upToDateCount;
+			continue;
+		}
+
+		dirtyNodes.emplace_back(i);
+	}
+
+	// Assets never depend on each other's output, so every dirty node can cook at once
+	GAP311::ThreadPool pool(m_settings.m_threadCount);
+	std::vector<std::future<bool>> results;
+	results.reserve(dirtyNodes.size());
+	for (size_t index : dirtyNodes)
+	{
+		results.emplace_back(pool.Submit([this, index]() {
+			const AssetNode& node = m_nodes[index];
+			switch (node.m_type)
+			{
+			case AssetType::eMesh:	  return CookMesh(node);
+			case AssetType::eTexture: return CookTexture(node);
+			case AssetType::eShader:  return CookShader(node);
+			}
+			return false;
+		}));
+	}
+
+	for (size_t i = 0; i < dirtyNodes.size(); ++i)
+	{
+		const AssetNode& node = m_nodes[dirtyNodes[i]];
+		if (results[i].get())
+		{
+			std::cout << "Cooked " << node.m_source << " -> " << node.m_output << "\n";
+			m_manifest[node.m_output] = node.m_hash;
+			++outStats.m_cookedCount;
+		}
+		else
+		{
+			std::cout << "Failed to cook " << node.m_source << "\n";
+			m_manifest.erase(node.m_output);
+			++outStats.m_failedCount;
+		}
+	}
+
+	if (!SaveManifest())
+	{
+		std::cout << "Failed to write cook manifest.\n";
+		return false;
+	}
+
+	return outStats.m_failedCount == 0;
+}
+
+void AssetCooker::ScanInput(const std::string& path)
+{
+	auto addFile = [this](const fs::path& file) {
+		std::string filename = file.generic_string();
+		std::string extension = file.extension().string();
+		if (extension == ".obj")
+			AddAsset(AssetType::eMesh, filename);
+		else if (extension == ".glsl")
+			AddAsset(AssetType::eShader, filename);
+		// Textures are only cooked when a material references them
+	};
+
+	std::error_code error;
+	if (fs::is_directory(path, error))
+	{
+		for (auto& entry : fs::recursive_directory_iterator(path, error))
+		{
+			if (entry.is_regular_file())
+				addFile(entry.path());
+		}
+	}
+	else if (fs::is_regular_file(path, error))
+	{
+		addFile(path);
+	}
+	else
+	{
+		std::cout << "Input " << path << " does not exist.\n";
+	}
+}
+
+void AssetCooker::AddAsset(AssetType type, const std::string& source)
+{
+	if (m_nodeLookup.find(source) != m_nodeLookup.end())
+		return;
+
+	AssetNode node;
+	node.m_type = type;
+	node.m_source = source;
+	node.m_output = CookedAssetPath(source);
+	node.m_inputs.emplace_back(source);
+	node.m_hash = 0;
+
+	std::vector<std::string> textures;
+	if (type == AssetType::eMesh)
+		CollectMaterialDependencies(source, node.m_inputs, textures);
+	else if (type == AssetType::eShader)
+		CollectShaderIncludes(source, node.m_inputs);
+
+	m_nodeLookup.emplace(source, m_nodes.size());
+	m_nodes.emplace_back(std::move(node));
+
+	for (const std::string& texture : textures)
+	{
+		AddAsset(AssetType::eTexture, texture);
+	}
+}
+
+void AssetCooker::CollectMaterialDependencies(const std::string& objFilename, std::vector<std::string>& outInputs, std::vector<std::string>& outTextures) const
+{
+	std::vector<std::string> objLines;
+	if (!ReadLines(objFilename, objLines))
+		return;
+
+	for (const std::string& objLine : objLines)
+	{
+		if (objLine.compare(0, 7, "mtllib ") != 0)
+			continue;
+
+		std::string mtlFilename = SiblingPath(objFilename, objLine.substr(7));
+		outInputs.emplace_back(mtlFilename);
+
+		std::vector<std::string> mtlLines;
+		ReadLines(mtlFilename, mtlLines);
+		for (const std::string& mtlLine : mtlLines)
+		{
+			if (mtlLine.compare(0, 7, "map_Kd ") == 0)
+				outTextures.emplace_back(SiblingPath(mtlFilename, mtlLine.substr(7)));
+		}
+	}
+}
+
+void AssetCooker::CollectShaderIncludes(const std::string& filename, std::vector<std::string>& outInputs) const
+{
+	std::vector<std::string> lines;
+	ReadLines(filename, lines);
+
+	for (const std::string& line : lines)
+	{
+		size_t directive = line.find("#include");
+		size_t open = line.find('"', directive);
+		size_t close = line.find('"', open + 1);
+		if (directive == std::string::npos || open == std::string::npos || close == std::string::npos)
+			continue;
+
+		std::string include = SiblingPath(filename, line.substr(open + 1, close - open - 1));
+		if (std::find(outInputs.begin(), outInputs.end(), include) != outInputs.end())
+			continue;
+
+		outInputs.emplace_back(include);
+		CollectShaderIncludes(include, outInputs);
+	}
+}
+
+bool AssetCooker::HashNode(AssetNode& node)
+{
+	// Changing the cooker version or the shader compiler invalidates every asset
+	uint64_t hash = HashBytes(&s_kCookedVersion, sizeof(s_kCookedVersion));
+	hash = HashBytes(&node.m_type, sizeof(node.m_type), hash);
+	if (node.m_type == AssetType::eShader)
+		hash = HashString(m_settings.m_shaderCompiler, hash);
+
+	for (const std::string& input : node.m_inputs)
+	{
+		uint64_t fileHash = 0;
+		if (!HashFile(input, fileHash))
+			return false;
+
+		hash = HashString(input, hash);
+		hash = HashBytes(&fileHash, sizeof(fileHash), hash);
+	}
+
+	node.m_hash = hash;
+	return true;
+}
+
+bool AssetCooker::HashFile(const std::string& filename, uint64_t& outHash)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_fileHashMutex);
+		auto it = m_fileHashes.find(filename);
+		if (it != m_fileHashes.end())
+		{
+			outHash = it->second;
+			return true;
+		}
+	}
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	outHash = HashBytes(content.data(), content.size());
+
+	std::lock_guard<std::mutex> lock(m_fileHashMutex);
+	m_fileHashes[filename] = outHash;
+	return true;
+}
+
+bool AssetCooker::CookMesh(const AssetNode& node) const
+{
+	// Each task uses its own loader, the loader's cache is not thread safe
+	GraphicsFileLoader loader;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	if (!loader.LoadOBJFile(node.m_source.c_str(), vertices, indices))
+		return false;
+
+	OptimizeVertexCache(indices, vertices.size());
+	OptimizeVertexFetch(vertices, indices);
+
+	std::vector<CookedMaterial> materials;
+	for (size_t i = 1; i < node.m_inputs.size(); ++i)
+	{
+		std::vector<std::string> lines;
+		ReadLines(node.m_inputs[i], lines);
+
+		for (const std::string& line : lines)
+		{
+			std::istringstream stream(line);
+			std::string keyword;
+			stream >> keyword;
+
+			if (keyword == "newmtl")
+			{
+				materials.emplace_back();
+				std::memset(&materials.back(), 0, sizeof(CookedMaterial));
+				materials.back().diffuse[3] = materials.back().ambient[3] = materials.back().specular[3] = materials.back().emissive[3] = 1.0f;
+				continue;
+			}
+			if (materials.empty())
+				continue;
+
+			CookedMaterial& material = materials.back();
+			if (keyword == "Kd")	  stream >> material.diffuse[0] >> material.diffuse[1] >> material.diffuse[2];
+			else if (keyword == "Ka") stream >> material.ambient[0] >> material.ambient[1] >> material.ambient[2];
+			else if (keyword == "Ks") stream >> material.specular[0] >> material.specular[1] >> material.specular[2];
+			else if (keyword == "Ke") stream >> material.emissive[0] >> material.emissive[1] >> material.emissive[2];
+			else if (keyword == "Ns") stream >> material.shininess;
+			else if (keyword == "map_Kd")
+			{
+				std::string texture = CookedAssetPath(SiblingPath(node.m_inputs[i], line.substr(7)));
+				std::strncpy(material.diffuseTexture, texture.c_str(), sizeof(material.diffuseTexture) - 1);
+			}
+		}
+	}
+
+	CookedMeshHeader header;
+	header.magic = s_kCookedMeshMagic;
+	header.version = s_kCookedVersion;
+	header.vertexStride = sizeof(Vertex);
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = (uint32_t)indices.size();
+	header.materialCount = (uint32_t)materials.size();
+
+	std::vector<uint8_t> blob(sizeof(header) + vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t) + materials.size() * sizeof(CookedMaterial));
+	uint8_t* pWrite = blob.data();
+	std::memcpy(pWrite, &header, sizeof(header));									pWrite += sizeof(header);
+	std::memcpy(pWrite, vertices.data(), vertices.size() * sizeof(Vertex));			pWrite += vertices.size() * sizeof(Vertex);
+	std::memcpy(pWrite, indices.data(), indices.size() * sizeof(uint32_t));			pWrite += indices.size() * sizeof(uint32_t);
+	std::memcpy(pWrite, materials.data(), materials.size() * sizeof(CookedMaterial));
+
+	return WriteFile(OutputPath(node), blob.data(), blob.size());
+}
+
+bool AssetCooker::CookTexture(const AssetNode& node) const
+{
+	if (!m_imageDecoder)
+		return false;
+
+	TextureImage image;
+	if (!m_imageDecoder(node.m_source, image))
+		return false;
+
+	PackedTextureGroup group;
+	group.m_width = image.m_width;
+	group.m_height = image.m_height;
+	group.m_format = image.m_format;
+	group.m_layerCount = 1;
+	group.m_mips.emplace_back(std::move(image.m_pixels));
+	TexturePacker::BuildMips(group, TexturePacker::MipCount(group.m_width, group.m_height));
+
+	bool hasAlpha = TextureCompression::HasAlpha(group.m_mips[0].data(), group.m_width, group.m_height);
+
+	CookedTextureHeader header;
+	header.magic = s_kCookedTextureMagic;
+	header.version = s_kCookedVersion;
+	header.width = group.m_width;
+	header.height = group.m_height;
+	header.mipCount = (uint32_t)group.m_mips.size();
+	header.format = hasAlpha ? CookedTextureFormat::eBC3Srgb : CookedTextureFormat::eBC1Srgb;
+
+	std::vector<uint8_t> blob(sizeof(header));
+	std::memcpy(blob.data(), &header, sizeof(header));
+
+	std::vector<uint8_t> blocks;
+	for (uint32_t mip = 0; mip < header.mipCount; ++mip)
+	{
+		uint32_t width = std::max(group.m_width >> mip, 1u);
+		uint32_t height = std::max(group.m_height >> mip, 1u);
+		if (hasAlpha)
+			TextureCompression::CompressBC3(group.m_mips[mip].data(), width, height, blocks);
+		else
+			TextureCompression::CompressBC1(group.m_mips[mip].data(), width, height, blocks);
+
+		uint32_t byteSize = (uint32_t)blocks.size();
+		size_t offset = blob.size();
+		blob.resize(offset + sizeof(byteSize) + blocks.size());
+		std::memcpy(blob.data() + offset, &byteSize, sizeof(byteSize));
+		std::memcpy(blob.data() + offset + sizeof(byteSize), blocks.data(), blocks.size());
+	}
+
+	return WriteFile(OutputPath(node), blob.data(), blob.size());
+}
+
+bool AssetCooker::CookShader(const AssetNode& node) const
+{
+	std::string output = OutputPath(node);
+	std::error_code error;
+	fs::create_directories(fs::path(output).parent_path(), error);
+	if (error)
+		return false;
+
+	// Same invocation as the project's GLSL build step, compiled next to the target and renamed like WriteFile
+	std::string tempOutput = output + ".tmp";
+	std::string command = "\"" + m_settings.m_shaderCompiler + "\" -V -o \"" + tempOutput + "\" \"" + node.m_source + "\"";
+	if (std::system(command.c_str()) != 0)
+	{
+		fs::remove(tempOutput, error);
+		return false;
+	}
+
+	fs::rename(tempOutput, output, error);
+	return !error;
+}
+
+void AssetCooker::LoadManifest()
+{
+	std::vector<std::string> lines;
+	ReadLines((fs::path(m_settings.m_outputDir) / "cook.manifest").string(), lines);
+
+	for (const std::string& line : lines)
+	{
+		size_t split = line.find_last_of(' ');
+		if (split == std::string::npos)
+			continue;
+
+		// A damaged line is left out, which makes its asset dirty so it gets cooked again
+		uint64_t hash = 0;
+		const char* pEnd = line.data() + line.size();
+		auto result = std::from_chars(line.data() + split + 1, pEnd, hash, 16);
+		if (result.ec != std::errc() || result.ptr != pEnd)
+			continue;
+
+		m_manifest[line.substr(0, split)] = hash;
+	}
+}
+
+bool AssetCooker::SaveManifest() const
+{
+	std::ostringstream stream;
+	for (auto& [output, hash] : m_manifest)
+	{
+		stream << output << ' ' << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << '\n';
+	}
+
+	std::string content = stream.str();
+	return WriteFile((fs::path(m_settings.m_outputDir) / "cook.manifest").string(), content.data(), content.size());
+}
+
+std::string AssetCooker::OutputPath(const AssetNode& node) const
+{
+	return (fs::path(m_settings.m_outputDir) / node.m_output).string();
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+#include "TexturePacker.h"
+
+// Turns source assets (OBJ + MTL, textures, GLSL) into the runtime-ready binaries described in
+// CookedAssets.h. Every asset is a node of a dependency graph whose hash covers the content of
+// all of its input files; only nodes whose hash differs from the last successful cook are rebuilt,
+// and those are cooked in parallel.
+class AssetCooker
+{
+public:
+	// Decodes an image file into RGBA8 texels. Supplied by the host tool so the cooker
+	// itself does not depend on an image library.
+	using ImageDecoder = std::function<bool(const std::string& filename, TextureImage& outImage)>;
+
+	struct Settings
+	{
+		std::vector<std::string> m_inputs;	// files or directories to scan
+		std::string m_outputDir;
+		std::string m_shaderCompiler;
+		size_t m_threadCount;				// 0 uses every hardware thread
+		bool m_force;						// ignore the manifest and cook everything
+
+		Settings() : m_inputs(), m_outputDir("Cooked"), m_shaderCompiler("glslangValidator"), m_threadCount(0), m_force(false) {}
+	};
+
+	struct Stats
+	{
+		size_t m_assetCount;
+		size_t m_cookedCount;
+		size_t m_upToDateCount;
+		size_t m_failedCount;
+
+		Stats() : m_assetCount(0), m_cookedCount(0), m_upToDateCount(0), m_failedCount(0) {}
+	};
+
+private:
+	enum class AssetType
+	{
+		eMesh,
+		eTexture,
+		eShader,
+	};
+
+	struct AssetNode
+	{
+		AssetType m_type;
+		std::string m_source;
+		std::string m_output;				// relative to the output directory
+		std::vector<std::string> m_inputs;	// every file the result depends on, m_source first
+		uint64_t m_hash;
+	};
+
+	Settings m_settings;
+	ImageDecoder m_imageDecoder;
+
+	std::vector<AssetNode> m_nodes;
+	std::unordered_map<std::string, size_t> m_nodeLookup;		// source path -> node
+	std::unordered_map<std::string, uint64_t> m_manifest;		// output path -> hash of last cook
+
+	std::mutex m_fileHashMutex;
+	std::unordered_map<std::string, uint64_t> m_fileHashes;
+
+public:
+	AssetCooker(const Settings& settings, ImageDecoder imageDecoder);
+	~AssetCooker();
+	AssetCooker(const AssetCooker&)			   = delete;
+	AssetCooker& operator=(const AssetCooker&) = delete;
+
+	bool Cook(Stats& outStats);
+
+private:
+	void ScanInput(const std::string& path);
+	void AddAsset(AssetType type, const std::string& source);
+	void CollectMaterialDependencies(const std::string& objFilename, std::vector<std::string>& outInputs, std::vector<std::string>& outTextures) const;
+	void CollectShaderIncludes(const std::string& filename, std::vector<std::string>& outInputs) const;
+
+	bool HashNode(AssetNode& node);
+	bool HashFile(const std::string& filename, uint64_t& outHash);
+
+	bool CookMesh(const AssetNode& node) const;
+	bool CookTexture(const AssetNode& node) const;
+	bool CookShader(const AssetNode& node) const;
+
+	void LoadManifest();
+	bool SaveManifest() const;
+	std::string OutputPath(const AssetNode& node) const;
+};
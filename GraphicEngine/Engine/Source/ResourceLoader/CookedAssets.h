@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Binary layouts written by the offline cooker and read back by the runtime.
+// Every cooked file starts with a magic and version, followed by the payload laid out
+// exactly as the runtime consumes it so loading is a single read.
+
+static constexpr uint32_t s_kCookedVersion = 1;
+
+// 'GEMS' - vertices (Vertex) followed by indices (uint32_t)
+static constexpr uint32_t s_kCookedMeshMagic = 0x534D4547;
+
+struct CookedMeshHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t materialCount;		// CookedMaterial entries after the indices
+};
+
+struct CookedMaterial
+{
+	float diffuse[4];
+	float ambient[4];
+	float specular[4];
+	float emissive[4];
+	float shininess;
+	char diffuseTexture[124];	// cooked texture path relative to the cook output, empty if none
+};
+
+// 'GETX' - mip chain, largest first, each mip prefixed by its uint32_t byte size
+static constexpr uint32_t s_kCookedTextureMagic = 0x58544547;
+
+enum class CookedTextureFormat : uint32_t
+{
+	eRGBA8Srgb,
+	eBC1Srgb,	// opaque textures, 8 bytes per 4x4 block
+	eBC3Srgb,	// textures with alpha, 16 bytes per 4x4 block
+};
+
+struct CookedTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	CookedTextureFormat format;
+};
+
+// 64-bit FNV-1a, used for content hashes of cooker inputs and runtime caches
+inline uint64_t HashBytes(const void* pData, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= pBytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+inline uint64_t HashString(const std::string& str, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	return HashBytes(str.data(), str.size(), hash);
+}
+
+// Cooked files mirror the source tree under this directory, relative to the working directory
+static constexpr const char* s_kCookedDirectory = "Cooked";
+
+// Maps a source asset path to the path of its cooked counterpart (without the cooked directory)
+inline std::string CookedAssetPath(const std::string& source)
+{
+	auto replaceExtension = [&source](size_t length, const char* pCookedExtension) {
+		return source.substr(0, source.size() - length) + pCookedExtension;
+	};
+	auto endsWith = [&source](const char* pSuffix) {
+		size_t length = std::char_traits<char>::length(pSuffix);
+		return source.size() >= length && source.compare(source.size() - length, length, pSuffix) == 0;
+	};
+
+	if (endsWith(".obj"))  return replaceExtension(4, ".mesh");
+	if (endsWith(".jpg"))  return replaceExtension(4, ".tex");
+	if (endsWith(".png"))  return replaceExtension(4, ".tex");
+	if (endsWith(".glsl")) return replaceExtension(5, ".spv");
+	return source;
+}
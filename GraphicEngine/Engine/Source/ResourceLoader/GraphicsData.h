@@ -37,24 +37,45 @@ struct Uniforms
 	glm::vec4 cameraPosition;
 };
 
-struct ObjectUniforms
+// Switches of a material, mirroring the specialization constants of its pipeline so the
+// ubershader permutation can draw it the same way while the specialized pipeline compiles
+enum MaterialFeature : uint32_t
+{
+	kMaterialFeatureLighting = 1 << 0,
+};
+
+struct MaterialUniforms
 {
-	glm::mat4 worldMatrix;
 	glm::vec4 materialDiffuse;
 	glm::vec4 materialEmissive;
 	glm::vec4 materialAmbient;
 	glm::vec4 materialSpecular;
 	float materialShininess;
-	bool enableLighting;
+	uint32_t materialFeatures;
 
-	ObjectUniforms() 
-		: worldMatrix(glm::identity<glm::mat4>())
-		, materialDiffuse()
+	MaterialUniforms() 
+		: materialDiffuse()
 		, materialEmissive()
 		, materialAmbient()
 		, materialSpecular()
 		, materialShininess(32)
-		, enableLighting(false) 
+		, materialFeatures(0)
+	{
+
+	}
+};
+
+// Pushed into the command buffer for every draw, see VulkanApp::CreateSceneLayout
+struct ObjectConstants
+{
+	glm::mat4 worldMatrix;
+	uint32_t objectIndex;	// position of the object in the scene
+	uint32_t materialIndex;	// every object owns its material, so this matches objectIndex for now
+
+	ObjectConstants() 
+		: worldMatrix(glm::identity<glm::mat4>())
+		, objectIndex(0)
+		, materialIndex(0)
 	{
 
 	}
@@ -1,7 +1,9 @@
 #include "GraphicsFileLoader.h"
+#include "CookedAssets.h"
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <filesystem>
 
 FileData::FileData(const std::vector<Vertex>& outVertices, const std::vector<uint32_t>& outIndices)
 	: m_vertices(outVertices.size())
@@ -167,4 +169,64 @@ bool GraphicsFileLoader::LoadOBJFile(const char* pFilename, std::vector<Vertex>&
 	//});
 
 	return true;
+}
+
+bool GraphicsFileLoader::LoadCookedMesh(const char* pFilename, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices)
+{
+	std::ifstream meshFile(pFilename, std::ios::in | std::ios::binary);
+	if (!meshFile.is_open())
+		return false;
+
+	CookedMeshHeader header;
+	meshFile.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!meshFile.good() || header.magic != s_kCookedMeshMagic || header.version != s_kCookedVersion || header.vertexStride != sizeof(Vertex))
+	{
+		std::cout << pFilename << " is not a compatible cooked mesh.\n";
+		return false;
+	}
+
+	// The counts are only trusted once the file is known to hold that much, a corrupt header can't request huge allocations
+	uint64_t payloadSize = uint64_t(header.vertexCount) * sizeof(Vertex) + uint64_t(header.indexCount) * sizeof(uint32_t)
+		+ uint64_t(header.materialCount) * sizeof(CookedMaterial);
+	meshFile.seekg(0, std::ios::end);
+	uint64_t fileSize = static_cast<uint64_t>(meshFile.tellg());
+	meshFile.seekg(sizeof(header), std::ios::beg);
+	if (!meshFile.good() || fileSize < sizeof(header) + payloadSize)
+	{
+		std::cout << pFilename << " is truncated.\n";
+		return false;
+	}
+
+	// The payload is already laid out the way the GPU buffers want it
+	outVertices.resize(header.vertexCount);
+	outIndices.resize(header.indexCount);
+	meshFile.read(reinterpret_cast<char*>(outVertices.data()), header.vertexCount * sizeof(Vertex));
+	meshFile.read(reinterpret_cast<char*>(outIndices.data()), header.indexCount * sizeof(uint32_t));
+	if (!meshFile.good())
+		return false;
+
+	if (std::any_of(outIndices.begin(), outIndices.end(), [&](uint32_t index) { return index >= header.vertexCount; }))
+	{
+		std::cout << pFilename << " has indices past its vertices.\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool GraphicsFileLoader::LoadMesh(const char* pObjFilename, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices)
+{
+	// A cooked mesh written before the source was last saved is stale, the source is loaded until it is cooked again.
+	// Without the source, as in a build shipping only cooked assets, the cooked mesh is used as is.
+	std::string cookedFilename = std::string(s_kCookedDirectory) + "/" + CookedAssetPath(pObjFilename);
+	std::error_code sourceError, cookedError;
+	auto sourceTime = std::filesystem::last_write_time(pObjFilename, sourceError);
+	auto cookedTime = std::filesystem::last_write_time(cookedFilename, cookedError);
+	bool stale = !sourceError && !cookedError && cookedTime < sourceTime;
+	if (!stale && LoadCookedMesh(cookedFilename.c_str(), outVertices, outIndices))
+		return true;
+
+	outVertices.clear();
+	outIndices.clear();
+	return LoadOBJFile(pObjFilename, outVertices, outIndices);
 }
\ No newline at end of file
@@ -28,4 +28,8 @@ public:
 	GraphicsFileLoader& operator=(GraphicsFileLoader&&)		 = default;
 
 	bool LoadOBJFile(const char* pFilename, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices);
+	// Reads a mesh written by the offline cooker
+	bool LoadCookedMesh(const char* pFilename, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices);
+	// Loads the cooked version of an OBJ file when one exists and isn't older than the OBJ, otherwise parses the OBJ itself
+	bool LoadMesh(const char* pObjFilename, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices);
 };
\ No newline at end of file
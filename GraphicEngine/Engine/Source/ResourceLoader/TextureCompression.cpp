@@ -0,0 +1,190 @@
+#include "TextureCompression.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Gathers one 4x4 block, clamping reads at the image border
+	void FetchBlock(const uint8_t* pRGBA, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t outBlock[16][4])
+	{
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			uint32_t srcY = std::min(blockY * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				uint32_t srcX = std::min(blockX * 4 + x, width - 1);
+				std::memcpy(outBlock[y * 4 + x], pRGBA + (size_t(srcY) * width + srcX) * 4, 4);
+			}
+		}
+	}
+
+	uint16_t To565(const uint8_t* pColor)
+	{
+		return uint16_t(((pColor[0] >> 3) << 11) | ((pColor[1] >> 2) << 5) | (pColor[2] >> 3));
+	}
+
+	void From565(uint16_t color, int outColor[3])
+	{
+		int r = (color >> 11) & 0x1f;
+		int g = (color >> 5) & 0x3f;
+		int b = color & 0x1f;
+		outColor[0] = (r << 3) | (r >> 2);
+		outColor[1] = (g << 2) | (g >> 4);
+		outColor[2] = (b << 3) | (b >> 2);
+	}
+
+	// Writes the 8 byte colour part of a BC1/BC3 block using the luminance extremes as endpoints
+	void EncodeColorBlock(const uint8_t block[16][4], uint8_t* pOut)
+	{
+		auto luma = [](const uint8_t* c) { return c[0] * 299 + c[1] * 587 + c[2] * 114; };
+
+		int minIndex = 0;
+		int maxIndex = 0;
+		for (int i = 1; i < 16; ++i)
+		{
+			if (luma(block[i]) < luma(block[minIndex])) minIndex = i;
+			if (luma(block[i]) > luma(block[maxIndex])) maxIndex = i;
+		}
+
+		uint16_t color0 = To565(block[maxIndex]);
+		uint16_t color1 = To565(block[minIndex]);
+		// color0 > color1 selects the four colour mode
+		if (color0 < color1)
+			std::swap(color0, color1);
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			int palette[4][3];
+			From565(color0, palette[0]);
+			From565(color1, palette[1]);
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				int bestDistance = INT32_MAX;
+				for (int p = 0; p < 4; ++p)
+				{
+					int dr = block[i][0] - palette[p][0];
+					int dg = block[i][1] - palette[p][1];
+					int db = block[i][2] - palette[p][2];
+					int distance = dr * dr + dg * dg + db * db;
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= uint32_t(best) << (i * 2);
+			}
+		}
+
+		std::memcpy(pOut + 0, &color0, 2);
+		std::memcpy(pOut + 2, &color1, 2);
+		std::memcpy(pOut + 4, &indices, 4);
+	}
+
+	// Writes the 8 byte interpolated alpha part of a BC3 block
+	void EncodeAlphaBlock(const uint8_t block[16][4], uint8_t* pOut)
+	{
+		uint8_t alpha0 = 0;
+		uint8_t alpha1 = 255;
+		for (int i = 0; i < 16; ++i)
+		{
+			alpha0 = std::max(alpha0, block[i][3]);
+			alpha1 = std::min(alpha1, block[i][3]);
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			// alpha0 > alpha1 selects the eight value mode
+			int palette[8] = { alpha0, alpha1 };
+			for (int p = 1; p < 7; ++p)
+			{
+				palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				int bestDistance = INT32_MAX;
+				for (int p = 0; p < 8; ++p)
+				{
+					int distance = std::abs(block[i][3] - palette[p]);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= uint64_t(best) << (i * 3);
+			}
+		}
+
+		pOut[0] = alpha0;
+		pOut[1] = alpha1;
+		for (int i = 0; i < 6; ++i)
+		{
+			pOut[2 + i] = uint8_t(indices >> (i * 8));
+		}
+	}
+}
+
+namespace TextureCompression
+{
+	bool HasAlpha(const uint8_t* pRGBA, uint32_t width, uint32_t height)
+	{
+		for (size_t i = 0; i < size_t(width) * height; ++i)
+		{
+			if (pRGBA[i * 4 + 3] != 255)
+				return true;
+		}
+		return false;
+	}
+
+	size_t CompressedSize(uint32_t width, uint32_t height, uint32_t bytesPerBlock)
+	{
+		return size_t((width + 3) / 4) * ((height + 3) / 4) * bytesPerBlock;
+	}
+
+	void CompressBC1(const uint8_t* pRGBA, uint32_t width, uint32_t height, std::vector<uint8_t>& outBlocks)
+	{
+		outBlocks.resize(CompressedSize(width, height, 8));
+
+		uint8_t* pOut = outBlocks.data();
+		uint8_t block[16][4];
+		for (uint32_t blockY = 0; blockY < (height + 3) / 4; ++blockY)
+		{
+			for (uint32_t blockX = 0; blockX < (width + 3) / 4; ++blockX)
+			{
+				FetchBlock(pRGBA, width, height, blockX, blockY, block);
+				EncodeColorBlock(block, pOut);
+				pOut += 8;
+			}
+		}
+	}
+
+	void CompressBC3(const uint8_t* pRGBA, uint32_t width, uint32_t height, std::vector<uint8_t>& outBlocks)
+	{
+		outBlocks.resize(CompressedSize(width, height, 16));
+
+		uint8_t* pOut = outBlocks.data();
+		uint8_t block[16][4];
+		for (uint32_t blockY = 0; blockY < (height + 3) / 4; ++blockY)
+		{
+			for (uint32_t blockX = 0; blockX < (width + 3) / 4; ++blockX)
+			{
+				FetchBlock(pRGBA, width, height, blockX, blockY, block);
+				EncodeAlphaBlock(block, pOut);
+				EncodeColorBlock(block, pOut + 8);
+				pOut += 16;
+			}
+		}
+	}
+}
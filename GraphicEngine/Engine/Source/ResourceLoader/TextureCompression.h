@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Block compression of RGBA8 texels into the BC formats sampled natively by desktop GPUs.
+// Images whose sides are not multiples of 4 are padded by repeating the last row/column.
+
+namespace TextureCompression
+{
+	// True when any texel has alpha below 255
+	bool HasAlpha(const uint8_t* pRGBA, uint32_t width, uint32_t height);
+
+	size_t CompressedSize(uint32_t width, uint32_t height, uint32_t bytesPerBlock);
+
+	void CompressBC1(const uint8_t* pRGBA, uint32_t width, uint32_t height, std::vector<uint8_t>& outBlocks);
+	void CompressBC3(const uint8_t* pRGBA, uint32_t width, uint32_t height, std::vector<uint8_t>& outBlocks);
+}
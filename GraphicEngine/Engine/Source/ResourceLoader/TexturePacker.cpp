@@ -0,0 +1,303 @@
+#include "TexturePacker.h"
+#include <map>
+#include <tuple>
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <algorithm>
+
+size_t PackedTextureGroup::LayerByteSize(uint32_t mip) const
+{
+	size_t width = std::max(m_width >> mip, 1u);
+	size_t height = std::max(m_height >> mip, 1u);
+	return width * height * TexturePacker::s_kBytesPerTexel;
+}
+
+TexturePacker::TexturePacker()
+	: m_settings()
+	, m_textures()
+{
+}
+
+TexturePacker::TexturePacker(const Settings& settings)
+	: m_settings(settings)
+	, m_textures()
+{
+}
+
+TexturePacker::~TexturePacker()
+{
+}
+
+size_t TexturePacker::AddTexture(TextureImage&& image)
+{
+	m_textures.emplace_back(std::move(image));
+	return m_textures.size() - 1;
+}
+
+uint32_t TexturePacker::MipCount(uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	while ((width | height) > 1)
+	{
+		width >>= 1;
+		height >>= 1;
+		++count;
+	}
+	return count;
+}
+
+bool TexturePacker::Pack(std::vector<PackedTextureGroup>& outGroups, std::vector<TextureSlot>& outSlots) const
+{
+	// Padding has to be a power of two so that every padded mip level still lands on whole texels.
+	// Sizes are added up in 64 bits, huge settings would wrap around in 32.
+	uint32_t padding = m_settings.m_atlasPadding;
+	if (padding == 0 || (padding & (padding - 1)) != 0 || uint64_t(m_settings.m_atlasThreshold) + 2ull * padding > m_settings.m_atlasSize)
+	{
+		return Error("Invalid texture packer settings.");
+	}
+
+	outSlots.assign(m_textures.size(), TextureSlot());
+
+	std::vector<size_t> arrayCandidates;
+	std::vector<size_t> atlasCandidates;
+	for (size_t i = 0; i < m_textures.size(); ++i)
+	{
+		const TextureImage& texture = m_textures[i];
+		if (texture.m_width == 0 || texture.m_height == 0 ||
+			texture.m_pixels.size() != size_t(texture.m_width) * texture.m_height * s_kBytesPerTexel)
+		{
+			return Error("Texture %s has no valid pixel data.", texture.m_name.c_str());
+		}
+
+		if (texture.m_width <= m_settings.m_atlasThreshold && texture.m_height <= m_settings.m_atlasThreshold)
+			atlasCandidates.emplace_back(i);
+		else
+			arrayCandidates.emplace_back(i);
+	}
+
+	PackArrays(arrayCandidates, outGroups, outSlots);
+	return PackAtlas(atlasCandidates, outGroups, outSlots);
+}
+
+void TexturePacker::PackArrays(const std::vector<size_t>& textureIds, std::vector<PackedTextureGroup>& outGroups, std::vector<TextureSlot>& outSlots) const
+{
+	// Textures of identical size and format become the layers of one array
+	std::map<std::tuple<uint32_t, uint32_t, TextureFormat>, std::vector<size_t>> buckets;
+	for (size_t id : textureIds)
+	{
+		const TextureImage& texture = m_textures[id];
+		buckets[{ texture.m_width, texture.m_height, texture.m_format }].emplace_back(id);
+	}
+
+	for (auto& [key, ids] : buckets)
+	{
+		int32_t groupIndex = (int32_t)outGroups.size();
+		outGroups.emplace_back();
+		PackedTextureGroup& group = outGroups.back();
+		group.m_kind = PackedTextureGroup::Kind::eArray;
+		group.m_width = std::get<0>(key);
+		group.m_height = std::get<1>(key);
+		group.m_format = std::get<2>(key);
+		group.m_layerCount = (uint32_t)ids.size();
+
+		size_t layerSize = group.LayerByteSize(0);
+		group.m_mips.emplace_back(layerSize * ids.size());
+		for (uint32_t layer = 0; layer < group.m_layerCount; ++layer)
+		{
+			std::memcpy(group.m_mips[0].data() + layerSize * layer, m_textures[ids[layer]].m_pixels.data(), layerSize);
+
+			TextureSlot& slot = outSlots[ids[layer]];
+			slot.m_group = groupIndex;
+			slot.m_layer = layer;
+		}
+
+		BuildMips(group, MipCount(group.m_width, group.m_height));
+	}
+}
+
+bool TexturePacker::PackAtlas(const std::vector<size_t>& textureIds, std::vector<PackedTextureGroup>& outGroups, std::vector<TextureSlot>& outSlots) const
+{
+	const uint32_t atlasSize = m_settings.m_atlasSize;
+	const uint32_t padding = m_settings.m_atlasPadding;
+
+	// In 64 bits so it can't wrap around, the result is checked against the page size before it is narrowed
+	auto alignUp = [padding](uint64_t value) { return (value + padding - 1) & ~uint64_t(padding - 1); };
+
+	// One atlas (with as many pages as needed) per format
+	std::map<TextureFormat, std::vector<size_t>> buckets;
+	for (size_t id : textureIds)
+	{
+		buckets[m_textures[id].m_format].emplace_back(id);
+	}
+
+	for (auto& [format, ids] : buckets)
+	{
+		// Shelf packing works best when the tallest textures are placed first
+		std::sort(ids.begin(), ids.end(), [this](size_t a, size_t b) {
+			return m_textures[a].m_height > m_textures[b].m_height;
+		});
+
+		struct Placement
+		{
+			size_t id;
+			uint32_t page, x, y;
+		};
+		std::vector<Placement> placements;
+		placements.reserve(ids.size());
+
+		uint32_t page = 0;
+		uint32_t cursorX = 0;
+		uint32_t cursorY = 0;
+		uint32_t shelfHeight = 0;
+		for (size_t id : ids)
+		{
+			// Keep every padded rect aligned to the padding so mip texels never straddle two textures
+			uint64_t alignedWidth = alignUp(uint64_t(m_textures[id].m_width) + 2ull * padding);
+			uint64_t alignedHeight = alignUp(uint64_t(m_textures[id].m_height) + 2ull * padding);
+			if (alignedWidth > atlasSize || alignedHeight > atlasSize)
+			{
+				return Error("Texture %s doesn't fit an atlas page once padded.", m_textures[id].m_name.c_str());
+			}
+			uint32_t paddedWidth = (uint32_t)alignedWidth;
+			uint32_t paddedHeight = (uint32_t)alignedHeight;
+
+			if (cursorX + paddedWidth > atlasSize)
+			{
+				cursorX = 0;
+				cursorY += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (cursorY + paddedHeight > atlasSize)
+			{
+				++page;
+				cursorX = 0;
+				cursorY = 0;
+				shelfHeight = 0;
+			}
+
+			placements.push_back({ id, page, cursorX, cursorY });
+			cursorX += paddedWidth;
+			shelfHeight = std::max(shelfHeight, paddedHeight);
+		}
+
+		int32_t groupIndex = (int32_t)outGroups.size();
+		outGroups.emplace_back();
+		PackedTextureGroup& group = outGroups.back();
+		group.m_kind = PackedTextureGroup::Kind::eAtlas;
+		group.m_width = atlasSize;
+		group.m_height = atlasSize;
+		group.m_format = format;
+		group.m_layerCount = page + 1;
+
+		size_t layerSize = group.LayerByteSize(0);
+		group.m_mips.emplace_back(layerSize * group.m_layerCount, uint8_t(0));
+
+		for (const Placement& placement : placements)
+		{
+			const TextureImage& texture = m_textures[placement.id];
+			uint8_t* pPage = group.m_mips[0].data() + layerSize * placement.page;
+
+			// Copy the texture and replicate its edges into the padding
+			for (uint32_t y = 0; y < texture.m_height + 2 * padding; ++y)
+			{
+				uint32_t srcY = (uint32_t)std::clamp<int64_t>(int64_t(y) - padding, 0, texture.m_height - 1);
+				for (uint32_t x = 0; x < texture.m_width + 2 * padding; ++x)
+				{
+					uint32_t srcX = (uint32_t)std::clamp<int64_t>(int64_t(x) - padding, 0, texture.m_width - 1);
+					const uint8_t* pSrc = texture.m_pixels.data() + (size_t(srcY) * texture.m_width + srcX) * s_kBytesPerTexel;
+					uint8_t* pDst = pPage + (size_t(placement.y + y) * atlasSize + placement.x + x) * s_kBytesPerTexel;
+					std::memcpy(pDst, pSrc, s_kBytesPerTexel);
+				}
+			}
+
+			TextureSlot& slot = outSlots[placement.id];
+			slot.m_group = groupIndex;
+			slot.m_layer = placement.page;
+			slot.m_uvTransform = glm::vec4(
+				float(texture.m_width) / atlasSize,
+				float(texture.m_height) / atlasSize,
+				float(placement.x + padding) / atlasSize,
+				float(placement.y + padding) / atlasSize);
+		}
+
+		// The padding halves with every level, stop before it disappears
+		uint32_t paddedMips = 1;
+		while ((padding >> paddedMips) > 0)
+			++paddedMips;
+
+		BuildMips(group, std::min(paddedMips, MipCount(atlasSize, atlasSize)));
+	}
+
+	return true;
+}
+
+void TexturePacker::BuildMips(PackedTextureGroup& group, uint32_t mipCount)
+{
+	// Filter colour in linear space when the texels are sRGB encoded
+	const bool srgb = group.m_format == TextureFormat::eRGBA8Srgb;
+	auto toLinear = [srgb](uint8_t value, uint32_t channel) {
+		float f = value / 255.0f;
+		return (srgb && channel < 3) ? std::pow(f, 2.2f) : f;
+	};
+	auto fromLinear = [srgb](float value, uint32_t channel) {
+		float f = (srgb && channel < 3) ? std::pow(value, 1.0f / 2.2f) : value;
+		return (uint8_t)std::clamp(f * 255.0f + 0.5f, 0.0f, 255.0f);
+	};
+
+	for (uint32_t mip = 1; mip < mipCount; ++mip)
+	{
+		uint32_t srcWidth = std::max(group.m_width >> (mip - 1), 1u);
+		uint32_t srcHeight = std::max(group.m_height >> (mip - 1), 1u);
+		uint32_t dstWidth = std::max(group.m_width >> mip, 1u);
+		uint32_t dstHeight = std::max(group.m_height >> mip, 1u);
+
+		size_t srcLayerSize = group.LayerByteSize(mip - 1);
+		size_t dstLayerSize = group.LayerByteSize(mip);
+		group.m_mips.emplace_back(dstLayerSize * group.m_layerCount);
+
+		const std::vector<uint8_t>& src = group.m_mips[mip - 1];
+		std::vector<uint8_t>& dst = group.m_mips[mip];
+
+		for (uint32_t layer = 0; layer < group.m_layerCount; ++layer)
+		{
+			const uint8_t* pSrc = src.data() + srcLayerSize * layer;
+			uint8_t* pDst = dst.data() + dstLayerSize * layer;
+
+			for (uint32_t y = 0; y < dstHeight; ++y)
+			{
+				uint32_t y0 = std::min(y * 2, srcHeight - 1);
+				uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+				for (uint32_t x = 0; x < dstWidth; ++x)
+				{
+					uint32_t x0 = std::min(x * 2, srcWidth - 1);
+					uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+					for (uint32_t c = 0; c < s_kBytesPerTexel; ++c)
+					{
+						float sum = toLinear(pSrc[(size_t(y0) * srcWidth + x0) * s_kBytesPerTexel + c], c)
+							+ toLinear(pSrc[(size_t(y0) * srcWidth + x1) * s_kBytesPerTexel + c], c)
+							+ toLinear(pSrc[(size_t(y1) * srcWidth + x0) * s_kBytesPerTexel + c], c)
+							+ toLinear(pSrc[(size_t(y1) * srcWidth + x1) * s_kBytesPerTexel + c], c);
+						pDst[(size_t(y) * dstWidth + x) * s_kBytesPerTexel + c] = fromLinear(sum * 0.25f, c);
+					}
+				}
+			}
+		}
+	}
+}
+
+bool TexturePacker::Error(const char* pMessage, ...) const
+{
+	if (!m_settings.m_onError)
+		return false;
+
+	char buffer[512];
+	va_list args;
+	va_start(args, pMessage);
+	std::vsnprintf(buffer, sizeof(buffer), pMessage, args);
+	va_end(args);
+
+	m_settings.m_onError(buffer);
+	return false;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+
+// Texel layout of a texture. Every format is stored with 4 bytes per texel.
+enum class TextureFormat : uint32_t
+{
+	eRGBA8Unorm,
+	eRGBA8Srgb,
+};
+
+// A single decoded texture, top mip only.
+struct TextureImage
+{
+	std::string m_name;
+	uint32_t m_width;
+	uint32_t m_height;
+	TextureFormat m_format;
+	std::vector<uint8_t> m_pixels;
+
+	TextureImage() : m_name(), m_width(0), m_height(0), m_format(TextureFormat::eRGBA8Srgb), m_pixels() {}
+};
+
+// Where a material finds its texture after packing.
+// uv' = uv * m_uvTransform.xy + m_uvTransform.zw, sampled from layer m_layer of group m_group.
+struct TextureSlot
+{
+	int32_t m_group;
+	uint32_t m_layer;
+	glm::vec4 m_uvTransform;
+
+	TextureSlot() : m_group(-1), m_layer(0), m_uvTransform(1.0f, 1.0f, 0.0f, 0.0f) {}
+	bool IsValid() const { return m_group >= 0; }
+};
+
+// A set of textures that can be bound with a single 2D array image.
+struct PackedTextureGroup
+{
+	enum class Kind
+	{
+		eArray,		// every layer is one whole texture
+		eAtlas,		// every layer is a page holding several padded sub textures
+	};
+
+	Kind m_kind;
+	TextureFormat m_format;
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_layerCount;
+
+	// m_mips[level] holds all layers of that level back to back
+	std::vector<std::vector<uint8_t>> m_mips;
+
+	PackedTextureGroup() : m_kind(Kind::eArray), m_format(TextureFormat::eRGBA8Srgb), m_width(0), m_height(0), m_layerCount(0), m_mips() {}
+	size_t LayerByteSize(uint32_t mip) const;
+};
+
+class TexturePacker
+{
+public:
+	static constexpr uint32_t s_kBytesPerTexel = 4;
+
+	// Receives the reason packing failed, e.g. VulkanApp::OnError
+	using ErrorCallback = std::function<void(const char* pMessage)>;
+
+	struct Settings
+	{
+		uint32_t m_atlasThreshold;	// textures with both sides <= this go into an atlas
+		uint32_t m_atlasSize;		// width and height of one atlas page
+		uint32_t m_atlasPadding;	// texels of edge replication around each sub texture
+		ErrorCallback m_onError;	// optional
+
+		Settings() : m_atlasThreshold(256), m_atlasSize(2048), m_atlasPadding(8), m_onError() {}
+	};
+
+private:
+	Settings m_settings;
+	std::vector<TextureImage> m_textures;
+
+public:
+	TexturePacker();
+	TexturePacker(const Settings& settings);
+	~TexturePacker();
+	TexturePacker(const TexturePacker&)			   = delete;
+	TexturePacker& operator=(const TexturePacker&) = delete;
+	TexturePacker(TexturePacker&&)				   = default;
+	TexturePacker& operator=(TexturePacker&&)	   = default;
+
+	// Returns the texture id used to index the slots produced by Pack()
+	size_t AddTexture(TextureImage&& image);
+	size_t TextureCount() const { return m_textures.size(); }
+
+	// Groups all added textures. outSlots[textureId] tells where each texture ended up.
+	bool Pack(std::vector<PackedTextureGroup>& outGroups, std::vector<TextureSlot>& outSlots) const;
+
+	static uint32_t MipCount(uint32_t width, uint32_t height);
+	// Box filters m_mips[0] of every layer down to mipCount levels
+	static void BuildMips(PackedTextureGroup& group, uint32_t mipCount);
+
+private:
+	void PackArrays(const std::vector<size_t>& textureIds, std::vector<PackedTextureGroup>& outGroups, std::vector<TextureSlot>& outSlots) const;
+	bool PackAtlas(const std::vector<size_t>& textureIds, std::vector<PackedTextureGroup>& outGroups, std::vector<TextureSlot>& outSlots) const;
+
+	// Reports the formatted message through m_onError, always returns false
+	bool Error(const char* pMessage, ...) const;
+};
@@ -1,9 +1,19 @@
 #include "Application.h"
 
-int main()
+#include <cstring>
+
+int main(int argc, char* argv[])
 {
     Application app;
 
+    // --force-staging routes every static buffer through the staging ring, which lets the
+    // copy path be exercised on unified memory devices such as lavapipe
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--force-staging") == 0)
+            app.SetForceStagedUploads(true);
+    }
+
     if (!app.Initialize(1920, 1280, GAP311::FrameworkType::eGLFW))
     {
         printf("Failed to initialize application!\n");
@@ -0,0 +1,83 @@
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "ResourceLoader/AssetCooker.h"
+
+#include <stdio.h>
+#include <cstring>
+#include <string>
+
+// Offline asset cooker
+//
+// usage: cook [-o <output dir>] [-j <threads>] [-f] [inputs...]
+//   -o  directory receiving the cooked files (default: Cooked)
+//   -j  number of worker threads (default: all hardware threads)
+//   -f  cook everything, ignoring the manifest of the previous run
+//   inputs are files or directories, default: TestFiles Shaders
+
+static bool DecodeImage(const std::string& filename, TextureImage& outImage)
+{
+	SDL_Surface* pSurface = IMG_Load(filename.c_str());
+	if (!pSurface)
+	{
+		printf("Failed to decode %s: %s\n", filename.c_str(), IMG_GetError());
+		return false;
+	}
+
+	SDL_Surface* pRGBA = SDL_ConvertSurfaceFormat(pSurface, SDL_PIXELFORMAT_RGBA32, 0);
+	SDL_FreeSurface(pSurface);
+	if (!pRGBA)
+		return false;
+
+	outImage.m_name = filename;
+	outImage.m_width = (uint32_t)pRGBA->w;
+	outImage.m_height = (uint32_t)pRGBA->h;
+	outImage.m_format = TextureFormat::eRGBA8Srgb;
+	outImage.m_pixels.resize(size_t(outImage.m_width) * outImage.m_height * TexturePacker::s_kBytesPerTexel);
+
+	SDL_LockSurface(pRGBA);
+	size_t rowSize = size_t(outImage.m_width) * TexturePacker::s_kBytesPerTexel;
+	for (uint32_t y = 0; y < outImage.m_height; ++y)
+	{
+		std::memcpy(outImage.m_pixels.data() + rowSize * y, static_cast<uint8_t*>(pRGBA->pixels) + size_t(pRGBA->pitch) * y, rowSize);
+	}
+	SDL_UnlockSurface(pRGBA);
+	SDL_FreeSurface(pRGBA);
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	AssetCooker::Settings settings;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			settings.m_outputDir = argv[++i];
+		else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			settings.m_threadCount = (size_t)std::stoul(argv[++i]);
+		else if (std::strcmp(argv[i], "-f") == 0)
+			settings.m_force = true;
+		else
+			settings.m_inputs.emplace_back(argv[i]);
+	}
+
+	if (settings.m_inputs.empty())
+	{
+		settings.m_inputs.emplace_back("TestFiles");
+		settings.m_inputs.emplace_back("Shaders");
+	}
+
+	IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+	AssetCooker cooker(settings, DecodeImage);
+	AssetCooker::Stats stats;
+	bool success = cooker.Cook(stats);
+
+	printf("%zu assets: %zu cooked, %zu up to date, %zu failed\n",
+		stats.m_assetCount, stats.m_cookedCount, stats.m_upToDateCount, stats.m_failedCount);
+
+	IMG_Quit();
+	return success ? 0 : -1;
+}
@@ -0,0 +1,68 @@
+#version 450
+
+// Bindless permutation of simple.frag, the material comes from the bindless table
+layout(set = 0, binding = 0) uniform Uniforms
+{
+	mat4 viewMatrix;
+	mat4 projMatrix;
+	vec4 lightPosition;
+	vec4 lightColor;
+	vec4 cameraPosition;
+};
+
+struct Material
+{
+	vec4 materialDiffuse;
+	vec4 materialEmissive;
+	vec4 materialAmbient;
+	vec4 materialSpecular;
+	float materialShininess;
+	uint materialFeatures;	// MaterialFeature bits, only read by the ubershader permutation
+};
+
+layout(set = 2, binding = 1, std430) readonly buffer Materials
+{
+	Material materials[];
+};
+
+// Resolved when the pipeline is compiled, see PipelineDescription::specializationConstants
+layout(constant_id = 0) const bool ENABLE_LIGHTING = true;
+// Generic permutation drawing while the specialized pipeline compiles, the features come from the material
+layout(constant_id = 1) const bool UBERSHADER = false;
+
+const uint MATERIAL_FEATURE_LIGHTING = 1u;
+
+layout(location = 0) in vec4 worldPosition;
+layout(location = 1) in vec4 fragColour;
+layout(location = 2) in vec4 normal;
+layout(location = 3) flat in uint fragMaterialIndex;
+layout(location = 0) out vec4 outColour;
+
+void main()
+{
+	Material material = materials[fragMaterialIndex];
+
+	bool lightingEnabled = UBERSHADER ? (material.materialFeatures & MATERIAL_FEATURE_LIGHTING) != 0u : ENABLE_LIGHTING;
+	if (lightingEnabled)
+	{
+		vec4 globalAmbient = vec4(0.1f, 0.1f, 0.1f, 1.0f);
+
+		// per-vertex lighting
+		vec4 L = normalize(lightPosition - worldPosition);
+		vec4 V = normalize(cameraPosition - worldPosition);
+		vec4 H = normalize(L + V);
+		float NdotL = dot(normal, L);
+		float facing = NdotL;
+
+		vec4 diffuse = lightColor * (max(NdotL, 0.0) * material.materialDiffuse);
+		vec4 ambient = material.materialAmbient * globalAmbient * lightColor;
+		vec4 emissive = material.materialEmissive;
+		vec4 specular = (material.materialSpecular * facing * pow(max(dot(normal, H), 0), material.materialShininess)) * lightColor;
+
+		outColour = diffuse + ambient + specular + emissive;
+	}
+	else
+	{
+		outColour = fragColour;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#version 450
+
+// Bindless permutation of simple.vert, every object reads its data from the bindless table.
+// Draws only differ by the indices they push, see GAP311::BindlessTable
+layout(set = 0, binding = 0) uniform Uniforms
+{
+	mat4 viewMatrix;
+	mat4 projMatrix;
+	vec4 lightPosition;
+	vec4 lightColor;
+	vec4 cameraPosition;
+};
+
+struct Object
+{
+	mat4 worldMatrix;
+};
+
+layout(set = 2, binding = 2, std430) readonly buffer Objects
+{
+	Object objects[];
+};
+
+// Same block as simple.vert, only the indices are read
+layout(push_constant) uniform ObjectConstants
+{
+	layout(offset = 64) uint objectIndex;
+	uint materialIndex;
+};
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColour;
+layout(location = 0) out vec4 worldPosition;
+layout(location = 1) out vec4 fragColour;
+layout(location = 2) out vec4 normal;
+layout(location = 3) flat out uint fragMaterialIndex;
+
+void main()
+{
+	worldPosition = objects[objectIndex].worldMatrix * vec4(inPosition, 1.0);
+
+	gl_Position = projMatrix * viewMatrix * worldPosition;
+
+	normal = normalize(vec4(inPosition, 0.0));
+	fragColour = vec4(inColour, 1.0);
+	fragMaterialIndex = materialIndex;
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #version 450
 
-layout(binding = 0) uniform Uniforms
+// Descriptor sets are split by update frequency, see VulkanApp::CreateSceneLayout
+layout(set = 0, binding = 0) uniform Uniforms
 {
 	mat4 viewMatrix;
 	mat4 projMatrix;
@@ -9,17 +10,31 @@ layout(binding = 0) uniform Uniforms
 	vec4 cameraPosition;
 };
 
-layout(binding = 1) uniform ObjectUniforms
+layout(set = 1, binding = 0) uniform MaterialUniforms
 {
-	mat4 worldMatrix;
 	vec4 materialDiffuse;
 	vec4 materialEmissive;
 	vec4 materialAmbient;
 	vec4 materialSpecular;
 	float materialShininess;
-	bool enableLighting;
+	uint materialFeatures;	// MaterialFeature bits, only read by the ubershader permutation
 };
 
+// Pushed with every draw, see ObjectConstants
+layout(push_constant) uniform ObjectConstants
+{
+	mat4 worldMatrix;
+	uint objectIndex;
+	uint materialIndex;
+};
+
+// Resolved when the pipeline is compiled, see PipelineDescription::specializationConstants
+layout(constant_id = 0) const bool ENABLE_LIGHTING = true;
+// Generic permutation drawing while the specialized pipeline compiles, the features come from the material
+layout(constant_id = 1) const bool UBERSHADER = false;
+
+const uint MATERIAL_FEATURE_LIGHTING = 1u;
+
 layout(location = 0) in vec4 worldPosition;
 layout(location = 1) in vec4 fragColour;
 layout(location = 2) in vec4 normal;
@@ -27,7 +42,8 @@ layout(location = 0) out vec4 outColour;
 
 void main()
 {
-	if (enableLighting)
+	bool lightingEnabled = UBERSHADER ? (materialFeatures & MATERIAL_FEATURE_LIGHTING) != 0u : ENABLE_LIGHTING;
+	if (lightingEnabled)
 	{
 		vec4 globalAmbient = vec4(0.1f, 0.1f, 0.1f, 1.0f);
 
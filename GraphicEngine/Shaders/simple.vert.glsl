@@ -1,6 +1,7 @@
 #version 450
 
-layout(binding = 0) uniform Uniforms
+// Descriptor sets are split by update frequency, see VulkanApp::CreateSceneLayout
+layout(set = 0, binding = 0) uniform Uniforms
 {
 	mat4 viewMatrix;
 	mat4 projMatrix;
@@ -9,15 +10,22 @@ layout(binding = 0) uniform Uniforms
 	vec4 cameraPosition;
 };
 
-layout(binding = 1) uniform ObjectUniforms
+layout(set = 1, binding = 0) uniform MaterialUniforms
 {
-	mat4 worldMatrix;
 	vec4 materialDiffuse;
 	vec4 materialEmissive;
 	vec4 materialAmbient;
 	vec4 materialSpecular;
 	float materialShininess;
-	bool enableLighting;
+	uint materialFeatures;	// MaterialFeature bits, only read by the ubershader permutation
+};
+
+// Pushed with every draw, see ObjectConstants
+layout(push_constant) uniform ObjectConstants
+{
+	mat4 worldMatrix;
+	uint objectIndex;
+	uint materialIndex;
 };
 
 layout(location = 0) in vec3 inPosition;